@@ -1,35 +1,378 @@
 // KarplusStrongTest.cpp : This file contains the 'main' function. Program execution begins and ends there.
+// Renders notes through the SynthEngine or runs the benchmarks, see --help.
 //
 
-#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <new>
+#include <vector>
 #include "PluckedNote.h"
 #include "src/MattsAudioTools.h"
+#include "src/AsyncWavWriter.hpp"
+#include "src/CommandLine.hpp"
+#include "src/LatencyHarness.hpp"
+#include "src/MemoryAccounting.hpp"
+#include "src/RealtimeGuard.hpp"
+#include "src/RealtimeSetup.hpp"
+#include "src/RegressionHarness.hpp"
+#include "src/Resampler.hpp"
+#include "src/SimdKernels.hpp"
+#include "src/StressHarness.hpp"
+#include "src/SynthEngine.hpp"
+#include "src/ThreadPool.hpp"
+#include "src/Trace.hpp"
 
-
-int main()
+namespace
 {
-    PluckedNote gNote;
+    //==============================================================================
+    /** takes rendered stereo blocks, resamples them if asked, and hands them to the sink */
+    class Output
+    {
+    public:
+        /** @returns false if the file, resampler or buffers could not be set up
+           @param meter told about disk stalls of the file sink
+         */
+        bool prepare(const CommandLine::Options &options, uint64_t renderFrames, LoadMeter &meter)
+        {
+            sink = options.sink;
+            inputRate = options.sampleRate;
+            outputRate = (options.outputRate > 0.0f) ? options.outputRate : options.sampleRate;
+            blockSize = options.blockSize;
+            totalFrames = (uint64_t)std::llround((double)renderFrames * outputRate / inputRate);
+
+            try
+            {
+                size_t maxFrames = blockSize;
+                if (outputRate != inputRate)
+                {
+                    if (!resampler.prepare(inputRate, outputRate, 2, blockSize))
+                    {
+                        fprintf(stderr, "cannot resample from %g to %g Hz\n", inputRate, outputRate);
+                        return false;
+                    }
+                    resampling = true;
+                    latencyFrames = resampler.getLatency();
+                    maxFrames = resampler.getMaxOutputFrames(blockSize);
+                    resampled.setSize(2, maxFrames);
+                    silence.setSize(2, blockSize);
+                }
+
+                if (sink == CommandLine::Sink::file)
+                {
+                    if (!writer.open(options.outputPath.c_str(), 2, outputRate, options.format))
+                    {
+                        fprintf(stderr, "could not open %s\n", options.outputPath.c_str());
+                        return false;
+                    }
+                    writer.setLoadMeter(&meter);
+                    interleaved.assign(2 * maxFrames, 0.0f);
+                }
+                else if (sink == CommandLine::Sink::play)
+                {
+                    playBuffer.setCategory(MemoryAccounting::Category::ioBuffers);
+                    playBuffer.setSize(2, (size_t)totalFrames);
+                }
+            }
+            catch (const std::bad_alloc&)
+            {
+                fprintf(stderr, "output buffers for %llu frames do not fit in memory or its budget\n",
+                        (unsigned long long)totalFrames);
+                writer.close();
+                return false;
+            }
+            return true;
+        }
 
-    gNote.setFrequency(196.0f);
-    gNote.setSampleRate(48000.0f);
-    gNote.setNoteLength(2.0f);
-    gNote.generateNote();
+        /** keeps the output buffers resident */
+        bool lockMemory(bool hugePages) const
+        {
+            const bool writerLocked = (sink != CommandLine::Sink::file) || writer.lockMemory(hugePages);
+            const bool resamplerLocked = resampled.lockMemory(hugePages) && silence.lockMemory(hugePages);
+            return writerLocked && resamplerLocked && playBuffer.lockMemory(hugePages);
+        }
 
-    float durationInSamples = 2.0f * 48000.0f;
+        /** takes one rendered block */
+        void write(const float *const *block, size_t numFrames)
+        {
+            if (!resampling)
+            {
+                deliver(block, numFrames);
+                return;
+            }
 
-    float* samples = new float[durationInSamples];
+            size_t frames = resampler.process(block, numFrames, resampled.getChannelPointers());
+            // the filter delay is dropped so the output lines up with the render
+            const size_t skip = std::min(frames, latencyFrames);
+            latencyFrames -= skip;
+            frames -= skip;
+            const float *const shifted[2] = {resampled.getChannel(0) + skip, resampled.getChannel(1) + skip};
+            deliver(shifted, frames);
+        }
 
-    for (int i = 0; i < durationInSamples - 1; i++)
+        /** flushes the resampler and the sink
+           @returns true if the file was written
+         */
+        bool finish()
+        {
+            // silence pushes the last rendered samples out of the filter
+            if (resampling)
+            {
+                const double filterInputFrames = (double)resampler.getLatency() * inputRate / outputRate;
+                const int flushBlocks = (int)(filterInputFrames / blockSize) + 2;
+                for (int i = 0; i < flushBlocks && framesDelivered < totalFrames; ++i)
+                {
+                    write(silence.getChannelPointers(), blockSize);
+                }
+            }
+
+            if (sink == CommandLine::Sink::file)
+            {
+                const bool written = writer.close();
+                printf("wrote %llu frames at %g Hz to the output file, %llu disk stalls\n",
+                       (unsigned long long)framesDelivered, outputRate, (unsigned long long)writer.getStallCount());
+                return written;
+            }
+            if (sink == CommandLine::Sink::play)
+            {
+                AudioPlayerOpenAL player;
+                player.playAudioData(playBuffer, (unsigned int)outputRate, 16);
+            }
+            return true;
+        }
+
+    private:
+        /** sends frames to the sink, never more than totalFrames in all */
+        void deliver(const float *const *block, size_t numFrames)
+        {
+            numFrames = (size_t)std::min<uint64_t>(numFrames, totalFrames - framesDelivered);
+            if (sink == CommandLine::Sink::file)
+            {
+                SimdKernels::interleave(block, 2, numFrames, interleaved.data());
+                writer.write(interleaved.data(), numFrames);
+            }
+            else if (sink == CommandLine::Sink::play)
+            {
+                for (int channel = 0; channel < 2; ++channel)
+                {
+                    std::copy(block[channel], block[channel] + numFrames, playBuffer.getChannel(channel) + framesDelivered);
+                }
+            }
+            framesDelivered += numFrames;
+        }
+
+    private:
+        CommandLine::Sink sink = CommandLine::Sink::none;
+        float inputRate = 48000.0f, outputRate = 48000.0f;
+        int blockSize = 0;
+        /// frames the sink receives in all, and so far
+        uint64_t totalFrames = 0, framesDelivered = 0;
+        Resampler resampler;
+        bool resampling = false;
+        /// resampler output still to be dropped
+        size_t latencyFrames = 0;
+        AudioBuffer resampled, silence;
+        AsyncWavWriter writer;
+        std::vector<float> interleaved;
+        AudioBuffer playBuffer;
+    };
+    //==============================================================================
+    /** renders the notes of options to its sink
+       @returns exit code
+     */
+    int render(const CommandLine::Options &options)
     {
-        samples[i] = gNote.process();
-    }
+        std::vector<CommandLine::Note> notes = options.notes;
+        std::stable_sort(notes.begin(), notes.end(),
+                         [](const CommandLine::Note &a, const CommandLine::Note &b) {return a.start < b.start;});
 
-    AudioPlayerOpenAL myAudioPlayer;
-    myAudioPlayer.playAudioData(samples, durationInSamples, 1, 48000, 16);
+        const float rate = options.sampleRate;
+        uint64_t totalFrames = 0;
+        // the delay lines must reach the lowest note or its pitch is clamped
+        float minFrequency = 20.0f;
+        for (const CommandLine::Note &note : notes)
+        {
+            totalFrames = std::max(totalFrames, (uint64_t)std::ceil((note.start + note.length) * rate));
+            minFrequency = std::min(minFrequency, note.frequency);
+        }
 
+        std::unique_ptr<ThreadPool> pool(options.threads != 1 ? new ThreadPool(options.threads) : nullptr);
+        SynthEngine engine;
+        engine.setThreadPool(pool.get());
+        if (!engine.prepare(rate, options.blockSize, options.voices, minFrequency))
+        {
+            return 1;
+        }
+        if (options.seed)
+        {
+            for (int voice = 0; voice < engine.getMaxVoices(); ++voice)
+            {
+                engine.getVoice(voice)->setSeed(options.seed + (uint32_t)voice);
+            }
+        }
 
+        AudioBuffer block;
+        try
+        {
+            block.setSize(2, options.blockSize);
+        }
+        catch (const std::bad_alloc&)
+        {
+            fprintf(stderr, "a %d frame block does not fit in memory or its budget\n", options.blockSize);
+            return 1;
+        }
 
-    return 0;
+        Output output;
+        if (!output.prepare(options, totalFrames, engine.getLoadMeter()))
+        {
+            return 1;
+        }
+        RealtimeSetup::apply(options.realtime, pool.get());
+        if (options.lockBuffers)
+        {
+            engine.lockMemory(options.hugePages);
+            output.lockMemory(options.hugePages);
+        }
 
+        // the workers poll between blocks so the render thread never locks
+        if (pool)
+        {
+            pool->setSpinWaiting(true);
+        }
+
+        printf("rendering %zu notes, %.2f s at %g Hz, block %d, %d voices, %d threads\n",
+               notes.size(), totalFrames / rate, rate, options.blockSize, options.voices,
+               pool ? pool->getNumThreads() : 1);
+
+        if (options.loadReportSeconds > 0.0f)
+        {
+            engine.getLoadMeter().startReporting(options.loadReportSeconds, options.loadJson);
+        }
+        const auto startTime = std::chrono::steady_clock::now();
+        size_t nextNote = 0;
+        uint64_t frame = 0;
+        while (frame < totalFrames)
+        {
+            while (nextNote < notes.size() && (uint64_t)(notes[nextNote].start * rate) <= frame)
+            {
+                const CommandLine::Note &note = notes[nextNote++];
+                engine.noteOn(note.frequency, note.gain, note.pan, note.length);
+            }
+
+            // blocks are split at note starts so every note starts on its sample
+            uint64_t end = std::min<uint64_t>(frame + options.blockSize, totalFrames);
+            if (nextNote < notes.size())
+            {
+                end = std::min(end, (uint64_t)(notes[nextNote].start * rate));
+            }
+            const int numFrames = (int)(end - frame);
+            engine.renderBlock(block.getChannel(0), block.getChannel(1), numFrames);
+            output.write(block.getChannelPointers(), numFrames);
+            frame = end;
+        }
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+        if (pool)
+        {
+            pool->setSpinWaiting(false);
+        }
+        printf("rendered in %.3f s, %.1fx real time\n", seconds, seconds > 0.0 ? totalFrames / rate / seconds : 0.0);
+
+        engine.getLoadMeter().stopReporting();
+        // finishing may still stall on the disk, so the load is printed after it
+        const bool finished = output.finish();
+        if (options.printLoad)
+        {
+            engine.getLoadMeter().dump(stdout, options.loadJson);
+        }
+        if (RealtimeGuard::getViolationCount())
+        {
+            printf("%llu real time violations\n", (unsigned long long)RealtimeGuard::getViolationCount());
+        }
+        return finished ? 0 : 1;
+    }
+    //==============================================================================
+    /** runs the benchmarks of options
+       @returns exit code, 1 if a regression check failed
+     */
+    int runBenchmarks(const CommandLine::Options &options)
+    {
+        int result = 0;
+        for (const std::string &benchmark : options.benchmarks)
+        {
+            if (benchmark == "latency")
+            {
+                LatencyHarness::Config config;
+                config.sampleRate = options.sampleRate;
+                LatencyHarness::print(LatencyHarness::run(config), stdout);
+            }
+            else if (benchmark == "stress")
+            {
+                StressHarness::Config config;
+                config.sampleRate = options.sampleRate;
+                config.blockSize = options.blockSize;
+                config.soakSeconds = options.soakSeconds;
+                if (options.threads != 1)
+                {
+                    config.threadCounts = {options.threads};
+                }
+                StressHarness::run(config, stdout);
+            }
+            else if (benchmark == "regression")
+            {
+                RegressionHarness::Config config;
+                config.goldenDirectory = options.goldenDirectory;
+                if (!RegressionHarness::print(RegressionHarness::run(config), stdout))
+                {
+                    result = 1;
+                }
+            }
+        }
+        return result;
+    }
 }
 
+int main(int argc, char *argv[])
+{
+    CommandLine::Options options;
+    if (!CommandLine::parse(argc, argv, options))
+    {
+        return 2;
+    }
+    if (options.showHelp)
+    {
+        CommandLine::printUsage(stdout, argv[0]);
+        return 0;
+    }
+
+    if (options.abortOnViolation)
+    {
+#ifndef KS_REALTIME_GUARD
+        fprintf(stderr, "--abort-on-violation has no effect, build with KS_REALTIME_GUARD defined\n");
+#endif
+        RealtimeGuard::setAbortOnViolation(true);
+    }
+    if (options.printMemory)
+    {
+        MemoryAccounting::setDumpOnExit(true, options.memoryJson);
+    }
+    if (options.memoryBudget)
+    {
+        MemoryAccounting::setTotalBudget(options.memoryBudget);
+        MemoryAccounting::setEnforceBudgets(true);
+    }
+    KS_TRACE_THREAD("main");
+
+    const int result = options.benchmarks.empty() ? render(options) : runBenchmarks(options);
+
+    if (!options.tracePath.empty())
+    {
+#ifdef KS_TRACE
+        Trace::writeChromeJson(options.tracePath.c_str());
+#else
+        fprintf(stderr, "--trace has no effect, build with KS_TRACE defined\n");
+#endif
+    }
+    return result;
+}
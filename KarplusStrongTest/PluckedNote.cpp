@@ -10,14 +10,22 @@
 
 #define _USE_MATH_DEFINES
 #include "PluckedNote.h"
+#include "src/Trace.hpp"
 #include <iostream>
 #include <math.h>
 #include <ctime>
 
 //=======================================================================
-PluckedNote::PluckedNote()
+PluckedNote::PluckedNote(bool generate)
 {
-  generateNote();
+  noiseState = clockSeed();
+  waveTable.setCategory(MemoryAccounting::Category::wavetables);
+  excitation.setCategory(MemoryAccounting::Category::wavetables);
+  delayLine.setCategory(MemoryAccounting::Category::delayLines);
+  if (generate)
+  {
+    generateNote();
+  }
 }
 //=======================================================================
 PluckedNote::~PluckedNote()
@@ -25,6 +33,8 @@ PluckedNote::~PluckedNote()
 //=======================================================================
 void PluckedNote::generateNote()
 {
+  KS_TRACE_SCOPE("generateNote");
+
   //=======================================================================
   // KARPLUS-STRONG ALGORITHM
 
@@ -32,36 +42,35 @@ void PluckedNote::generateNote()
   float rho = exp(-1 / ((float)frequency * T60 / log(1000))) / (abs(cos(2 * M_PI * frequency / sampleRate)));
 
   wtSize = floor(sampleRate * T60);               // duration of simulation in samples
+  currentSampleIndex = 0;                         // a new note plays from its attack
 
   float Nexact = (sampleRate / frequency) - 0.5f; // ideal number of samples in delay line
   float N = floor(Nexact);                        // truncated delay line length
   float P = Nexact - N;                           // fractional delay length
   float C = (1 - P) / (1 + P);                    // calculate allpass filter coefficient
 
-  srand(time(NULL));                              //random seed
-  float* v = new float[N+1];                      //initialize input vector
+  noiseState = seed ? seed : clockSeed();         //random seed
+  excitation.setSize(1, (size_t)N + 1, false);    //initialize input vector
+  float* v = excitation.getChannel(0);
 
   // fill input vector with white noise
   for (int count = 0; count < N + 1; count++)
   {
-    float randNum = ((rand() % 10001) / 5000.0f) - 1.0f;
-    v[count] = randNum;
+    v[count] = nextNoise();
   }
 
   float x0;
   float x1 = 0;
 
-  if (waveTable != nullptr)
-  {
-      delete[] waveTable;
-  }
-  waveTable = new float[wtSize];
+  // only reallocates when the note is longer than any before it
+  waveTable.setSize(1, wtSize, false);
+  float* wt = waveTable.getChannel(0);
 
   // dynamics filter loop
   for (int n = 0; n < (N + 1); n++)
   {
     x0 = (1 - dynParam) * v[(int) n] + (dynParam * x1);
-    waveTable[n] = x0;
+    wt[n] = x0;
     x1 = x0;
   }
 
@@ -71,11 +80,13 @@ void PluckedNote::generateNote()
   // karplus-strong algorithm loop
   for (int n = (N + 1); n < wtSize; n++)
   {
-    yp0 = C * (waveTable[int(n - N)] - yp1) + waveTable[int(n - N - 1)];
-    waveTable[n] = (rho / 2) * (yp0 + yp1);
+    yp0 = C * (wt[int(n - N)] - yp1) + wt[int(n - N - 1)];
+    wt[n] = (rho / 2) * (yp0 + yp1);
     yp1 = yp0;
   }
 
+  // printing is slow and floods the console when many notes are generated
+#ifdef KS_PRINT_NOTE_COEFFICIENTS
   std::cout << "rho:\t\t" << rho << '\n';
   std::cout << "wtSize:\t\t" << wtSize << '\n';
   std::cout << "Nexact:\t\t" << Nexact << '\n';
@@ -86,13 +97,14 @@ void PluckedNote::generateNote()
   std::cout << "yp0:\t\t" << yp0 << '\n';
   std::cout << "x1:\t\t" << x1 << '\n';
   std::cout << "x0:\t\t" << x0 << '\n';
+#endif
 }
 //=============================================================================
 // PROCESS FUNCTION
 
 float PluckedNote::process()
 {
-  float sample = waveTable[currentSampleIndex];
+  float sample = waveTable.getChannel(0)[currentSampleIndex];
 
   currentSampleIndex++;
   currentSampleIndex %= wtSize;
@@ -106,12 +118,212 @@ float PluckedNote::process()
 void PluckedNote::setFrequency(float freq)
 {
   frequency = freq;
+  updateTargets();
 }
 void PluckedNote::setSampleRate(float SR)
 {
+  // the delay line holds time, not samples, so its history is resampled and
+  // the delay jumps to the new rate instead of gliding through a pitch change
+  if (delayMask > 0 && SR != sampleRate)
+  {
+    resampleDelayLine(SR / sampleRate);
+  }
+  currentDelay *= SR / sampleRate;
   sampleRate = SR;
+  setGlideTime(glideTime);
+  updateTargets();
 }
 void PluckedNote::setNoteLength(float noteLength)
 {
   T60 = noteLength;
+  updateTargets();
+}
+void PluckedNote::setSeed(uint32_t newSeed)
+{
+  seed = newSeed;
+  noiseState = newSeed ? newSeed : clockSeed();
+}
+size_t PluckedNote::getAllocatedBytes() const
+{
+  return waveTable.getAllocatedBytes() + excitation.getAllocatedBytes() + delayLine.getAllocatedBytes();
+}
+bool PluckedNote::lockMemory(bool hugePages) const
+{
+  const bool tableLocked = waveTable.lockMemory(hugePages);
+  const bool excitationLocked = excitation.lockMemory(hugePages);
+  const bool delayLineLocked = delayLine.lockMemory(hugePages);
+  return tableLocked && excitationLocked && delayLineLocked;
+}
+void PluckedNote::setGlideTime(float seconds)
+{
+  glideTime = seconds;
+  smoothing = (seconds > 0.0f) ? 1.0f - exp(-controlInterval / (seconds * sampleRate)) : 1.0f;
+}
+//=============================================================================
+// NOISE
+
+float PluckedNote::nextNoise()
+{
+  // the C library's reference rand(), kept per note so the noise no longer
+  // depends on what else in the program calls rand()
+  noiseState = noiseState * 1103515245u + 12345u;
+  const int randNum = (int)((noiseState >> 16) & 0x7fff);
+  return ((randNum % 10001) / 5000.0f) - 1.0f;
+}
+
+uint32_t PluckedNote::clockSeed() const
+{
+  // the address keeps notes created in the same second apart
+  return (uint32_t)time(NULL) ^ (uint32_t)((uintptr_t)this * 2654435761u);
+}
+//=============================================================================
+// DELAY LINE ENGINE
+
+void PluckedNote::prepareToPlay(float maxSampleRate, float minFrequency)
+{
+  // the only allocation, sized for the longest delay the note can reach
+  const int maxDelay = (int)ceil(maxSampleRate / minFrequency) + warmupLength + 2;
+  int length = 1;
+  while (length < maxDelay)
+  {
+    length <<= 1;
+  }
+  delayLine.setSize(2, length); // second channel is scratch for resampleDelayLine()
+  excitation.setSize(1, length, false);
+  delayMask = length - 1;
+  writeIndex = 0;
+  excitationRemaining = 0;
+  allpassState = 0.0f;
+
+  setGlideTime(glideTime);
+  updateTargets();
+  currentDelay = targetDelay;
+  currentRho = targetRho;
+  delayN = 0;
+  controlCountdown = 0;
+}
+
+void PluckedNote::pluck()
+{
+  KS_TRACE_SCOPE("pluck");
+
+  // settle on the target pitch so the burst matches the new note
+  currentDelay = targetDelay;
+  currentRho = targetRho;
+  updateControl();
+  controlCountdown = controlInterval;
+
+  excitationLength = delayN + 1;
+  float* v = excitation.getChannel(0);
+  float x1 = 0;
+
+  // white noise through the dynamics filter, as in generateNote()
+  for (int n = 0; n < excitationLength; n++)
+  {
+    v[n] = (1 - dynParam) * nextNoise() + (dynParam * x1);
+    x1 = v[n];
+  }
+  excitationRemaining = excitationLength;
+  allpassState = 0.0f;
+}
+
+void PluckedNote::processBlock(float* output, int numFrames)
+{
+  float* line = delayLine.getChannel(0);
+  const float* v = excitation.getChannel(0);
+
+  for (int n = 0; n < numFrames; n++)
+  {
+    if (controlCountdown == 0)
+    {
+      updateControl();
+      controlCountdown = controlInterval;
+    }
+    controlCountdown--;
+
+    float y;
+    if (excitationRemaining > 0)
+    {
+      y = v[excitationLength - excitationRemaining];
+      excitationRemaining--;
+    }
+    else
+    {
+      // the same allpass tuned loop as generateNote(), run on a circular buffer
+      const float yp0 = allpassC * (line[(writeIndex - delayN) & delayMask] - allpassState)
+                      + line[(writeIndex - delayN - 1) & delayMask];
+      y = (currentRho / 2) * (yp0 + allpassState);
+      allpassState = yp0;
+    }
+
+    line[writeIndex] = y;
+    writeIndex = (writeIndex + 1) & delayMask;
+    output[n] = y;
+  }
+}
+
+void PluckedNote::updateTargets()
+{
+  targetRho = exp(-1 / ((float)frequency * T60 / log(1000))) / (abs(cos(2 * M_PI * frequency / sampleRate)));
+
+  // longest delay the allocated line can hold with room for the allpass warm up
+  const float maxDelay = (float)(delayMask - warmupLength - 2);
+  targetDelay = (sampleRate / frequency) - 0.5f;
+  targetDelay = fmax(1.0f + minFraction, fmin(targetDelay, maxDelay));
+}
+
+void PluckedNote::updateControl()
+{
+  currentDelay += smoothing * (targetDelay - currentDelay);
+  currentRho += smoothing * (targetRho - currentRho);
+
+  // P stays in [minFraction, 1 + minFraction) so C never approaches 1
+  const int N = (int)floor(currentDelay - minFraction);
+  const float P = currentDelay - N;
+  allpassC = (1 - P) / (1 + P);
+
+  if (N != delayN)
+  {
+    delayN = N;
+    warmAllpass();
+  }
+}
+
+void PluckedNote::resampleDelayLine(float ratio)
+{
+  float* line = delayLine.getChannel(0);
+  float* scratch = delayLine.getChannel(1);
+  const int length = delayMask + 1;
+
+  // linear interpolation backwards from the newest sample
+  for (int j = 0; j < length; j++)
+  {
+    const float position = j / ratio;
+    const int i = (int)position;
+    const float frac = position - i;
+    const float a = (i < length) ? line[(writeIndex - 1 - i) & delayMask] : 0.0f;
+    const float b = (i + 1 < length) ? line[(writeIndex - 2 - i) & delayMask] : 0.0f;
+    scratch[j] = a + frac * (b - a);
+  }
+  for (int j = 0; j < length; j++)
+  {
+    line[(writeIndex - 1 - j) & delayMask] = scratch[j];
+  }
+  allpassState = 0.0f;
+  controlCountdown = 0;
+  delayN = -1; // forces warmAllpass() at the next control update
+}
+
+void PluckedNote::warmAllpass()
+{
+  // the allpass state belongs to the old taps, rebuilding it from the
+  // output history at the new taps avoids the click of a state jump
+  const float* line = delayLine.getChannel(0);
+  float state = 0.0f;
+  for (int k = warmupLength; k > 0; k--)
+  {
+    const int index = writeIndex - k;
+    state = allpassC * (line[(index - delayN) & delayMask] - state) + line[(index - delayN - 1) & delayMask];
+  }
+  allpassState = state;
 }
@@ -11,20 +11,46 @@
 #pragma once
 
 #include <tgmath.h>
+#include <cstdint>
+#include "src/AudioBuffer.hpp"
 
 /// <#Description#>
 class PluckedNote
 {
 public:    
-    PluckedNote();
+    /// @param generate generates the default note, voices that only use processBlock() skip it
+    explicit PluckedNote(bool generate = true);
     ~PluckedNote();
     
     //=============================================================================
-    /// <#Description#>
+    /// renders the whole note into the wavetable, the reference the delay line engine is checked against.
+    /// The noise burst comes from the note's own generator with the C standard's example rand()
+    /// constants, seeded by setSeed(), not from the library rand() shared by the whole program,
+    /// so its samples differ from notes generated before per note seeds
     void generateNote();
-    /// <#Description#>
+    /// @returns the next wavetable sample, wrapping at the end of the note
     float process();
     //=============================================================================
+    // Delay line engine: plays the note live so frequency, note length and
+    // sample rate changes take effect while it sounds, without regenerating.
+
+    /// allocates the delay line once, before any processBlock()
+    /// @param maxSampleRate highest sample rate the note will be played at
+    /// @param minFrequency lowest frequency the note will be tuned to
+    void prepareToPlay(float maxSampleRate, float minFrequency = 20.0f);
+    /// restarts the note with a new noise burst at the current frequency
+    void pluck();
+    /// renders the delay line engine
+    /// @param output buffer for numFrames samples
+    /// @param numFrames number of samples to render
+    void processBlock(float* output, int numFrames);
+    /// time for frequency and note length changes to settle in the delay line engine
+    /// @param seconds one pole glide time constant, 0 jumps at the next control update
+    void setGlideTime(float seconds);
+    /// lowest fractional delay, keeps |C| small so the allpass settles quickly;
+    /// below it the engine uses one sample less of integer delay than generateNote()
+    static constexpr float minFraction = 0.2f;
+    //=============================================================================
 #pragma mark getters and setters
     
     /// <#Description#>
@@ -36,6 +62,15 @@ public:
     /// <#Description#>
     /// @param noteLength <#noteLength description#>
     void setNoteLength(float noteLength);
+    /// makes the noise bursts repeatable, every generateNote() restarts from the seed
+    /// @param newSeed noise seed, 0 seeds from the clock as before
+    void setSeed(uint32_t newSeed);
+    /// @returns bytes held by the wavetable, excitation and delay line
+    size_t getAllocatedBytes() const;
+    /// keeps the wavetable, excitation and delay line resident, after prepareToPlay()
+    /// @param hugePages advise transparent huge pages first
+    /// @returns true if all were locked
+    bool lockMemory(bool hugePages = false) const;
     
 private:
     /// frequency of plucked note variable
@@ -48,8 +83,63 @@ private:
     float T60 = 2.0f;
     /// initialize phase
     int currentSampleIndex = 0;
-    /// storing note data
-    float* waveTable;
+    /// storing note data, one aligned channel reused between notes
+    AudioBuffer waveTable;
+    /// white noise excitation, reused between notes
+    AudioBuffer excitation;
     /// length in samples
     int wtSize = floor(sampleRate * T60);
+    /// noise seed, 0 for the clock
+    uint32_t seed = 0;
+    /// noise generator state, per note so voices do not share rand()
+    uint32_t noiseState = 1;
+    //=============================================================================
+    /// @returns the next white noise sample between -1 and 1
+    float nextNoise();
+    /// @returns a seed from the clock for notes without setSeed()
+    uint32_t clockSeed() const;
+    //=============================================================================
+    /// computes the delay line engine targets from frequency, T60 and sample rate
+    void updateTargets();
+    /// moves the smoothed parameters one control step towards their targets
+    void updateControl();
+    /// runs the allpass over recent output so a new integer delay starts without a click
+    void warmAllpass();
+    /// stretches the delay line history in place when the sample rate changes
+    /// @param ratio new sample rate / old sample rate
+    void resampleDelayLine(float ratio);
+
+    /// samples between parameter updates of the delay line engine
+    static constexpr int controlInterval = 32;
+    /// samples the allpass is run over when the integer delay changes
+    static constexpr int warmupLength = 32;
+
+    /// circular history of the delay line engine output
+    AudioBuffer delayLine;
+    /// delay line length - 1, the length is a power of two
+    int delayMask = 0;
+    /// delay line index written next
+    int writeIndex = 0;
+    /// excitation samples still to be played after pluck()
+    int excitationRemaining = 0;
+    /// excitation samples written by pluck()
+    int excitationLength = 0;
+    /// samples until the next control update
+    int controlCountdown = 0;
+    /// smoothed and target delay in samples, N + P
+    float currentDelay = 0.0f;
+    float targetDelay = 0.0f;
+    /// smoothed and target loop gain
+    float currentRho = 0.0f;
+    float targetRho = 0.0f;
+    /// integer delay in use
+    int delayN = 0;
+    /// allpass coefficient in use
+    float allpassC = 0.0f;
+    /// previous allpass output
+    float allpassState = 0.0f;
+    /// fraction of the remaining distance to the targets covered per control update
+    float smoothing = 1.0f;
+    /// glide time constant in seconds
+    float glideTime = 0.01f;
 };
@@ -0,0 +1,208 @@
+//
+//  AsyncWavWriter.cpp
+//  KarplusStrongTest
+//
+#include "AsyncWavWriter.hpp"
+#include "RealtimeSetup.hpp"
+#include "Trace.hpp"
+#include <cstdio>
+#include <cstring>
+#include <new>
+//==============================================================================
+AsyncWavWriter::AsyncWavWriter()
+{
+}
+
+AsyncWavWriter::~AsyncWavWriter()
+{
+    if (running)
+    {
+        close();
+    }
+}
+//==============================================================================
+bool AsyncWavWriter::open(const char *filename, int channels, float sampleRate,
+                          WavCodec::SampleFormat format, size_t framesPerBlock, size_t numBlocks)
+{
+    if (running)
+    {
+        close();
+    }
+
+    if (framesPerBlock == 0 || numBlocks < 2 ||
+        !writer.open(filename, channels, sampleRate, format))
+    {
+        return false;
+    }
+
+    numChannels = channels;
+    blockFrames = framesPerBlock;
+    try
+    {
+        storage.assign(blockFrames * numChannels * numBlocks, 0.0f);
+        storageMemory.setBytes(storage.capacity() * sizeof(float));
+
+        freeBlocks.reset(new SpscQueue<size_t>(numBlocks));
+        fullBlocks.reset(new SpscQueue<Block>(numBlocks));
+    }
+    catch (const std::bad_alloc&)
+    {
+        printf("AsyncWavWriter: %zu blocks do not fit in memory or its budget\n", numBlocks);
+        writer.close();
+        std::vector<float>().swap(storage);
+        storageMemory.setBytes(0);
+        freeBlocks.reset();
+        fullBlocks.reset();
+        return false;
+    }
+    for (size_t i = 0; i < numBlocks; ++i)
+    {
+        freeBlocks->push(i);
+    }
+
+    holdingBlock = false;
+    currentFrames = 0;
+    stallCount = 0;
+    finishing.store(false);
+    running = true;
+    thread = std::thread(&AsyncWavWriter::run, this);
+    return true;
+}
+//==============================================================================
+float* AsyncWavWriter::acquireBlock()
+{
+    if (!holdingBlock)
+    {
+        if (!freeBlocks->pop(currentBlock))
+        {
+            // backpressure: the disk is behind, sleep until a block comes back
+            ++stallCount;
+            if (loadMeter)
+            {
+                loadMeter->reportUnderrun();
+            }
+            std::unique_lock<std::mutex> lock(mutex);
+            producerWaiting.store(true);
+            // pairs with the fence in wake() so the returned block or the flag is seen
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            wakeUp.wait(lock, [this] {return freeBlocks->pop(currentBlock);});
+            producerWaiting.store(false);
+        }
+        holdingBlock = true;
+        currentFrames = 0;
+    }
+    return &storage[currentBlock * blockFrames * numChannels];
+}
+
+void AsyncWavWriter::submitBlock(size_t numberOfFrames)
+{
+    if (!holdingBlock)
+    {
+        return;
+    }
+    const Block block = {currentBlock, numberOfFrames < blockFrames ? numberOfFrames : blockFrames};
+    // there are never more blocks than queue slots, so this cannot fail
+    fullBlocks->push(block);
+    wake(writerWaiting);
+    holdingBlock = false;
+    currentFrames = 0;
+}
+//==============================================================================
+void AsyncWavWriter::write(const float *audio, size_t numberOfFrames)
+{
+    while (numberOfFrames > 0)
+    {
+        float *block = acquireBlock();
+        const size_t framesNow = (blockFrames - currentFrames < numberOfFrames) ? blockFrames - currentFrames : numberOfFrames;
+        memcpy(block + currentFrames * numChannels, audio, framesNow * numChannels * sizeof(float));
+        currentFrames += framesNow;
+        audio += framesNow * numChannels;
+        numberOfFrames -= framesNow;
+
+        if (currentFrames == blockFrames)
+        {
+            submitBlock(blockFrames);
+        }
+    }
+}
+//==============================================================================
+bool AsyncWavWriter::close()
+{
+    if (!running)
+    {
+        return false;
+    }
+
+    // a partly filled block from write() still needs to go out
+    if (holdingBlock && currentFrames > 0)
+    {
+        submitBlock(currentFrames);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        finishing.store(true, std::memory_order_release);
+    }
+    wakeUp.notify_all();
+    thread.join();
+    running = false;
+
+    freeBlocks.reset();
+    fullBlocks.reset();
+    return writer.close();
+}
+//==============================================================================
+bool AsyncWavWriter::lockMemory(bool hugePages) const
+{
+    bool locked = RealtimeSetup::lockMemory(storage.data(), storage.size() * sizeof(float), hugePages);
+    locked &= !freeBlocks || freeBlocks->lockMemory();
+    locked &= !fullBlocks || fullBlocks->lockMemory();
+    return locked;
+}
+//==============================================================================
+void AsyncWavWriter::run()
+{
+    KS_TRACE_THREAD("AsyncWavWriter");
+    Block block;
+    while (true)
+    {
+        if (fullBlocks->pop(block))
+        {
+            KS_TRACE_SCOPE("writeBlock");
+            writer.write(&storage[block.index * blockFrames * numChannels], block.frames);
+            freeBlocks->push(block.index);
+            wake(producerWaiting);
+        }
+        else if (finishing.load(std::memory_order_acquire))
+        {
+            // the producer has stopped, anything it pushed is now visible
+            if (fullBlocks->empty())
+            {
+                return;
+            }
+        }
+        else
+        {
+            // nothing to write, sleep until a block is submitted or close()
+            std::unique_lock<std::mutex> lock(mutex);
+            writerWaiting.store(true);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            wakeUp.wait(lock, [this] {return !fullBlocks->empty() || finishing.load(std::memory_order_acquire);});
+            writerWaiting.store(false);
+        }
+    }
+}
+
+void AsyncWavWriter::wake(const std::atomic<bool> &flag)
+{
+    // the queue push before this and the flag store before the sleeper's
+    // check must not pass each other, or a wake up could be missed
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (flag.load(std::memory_order_relaxed))
+    {
+        // the sleeper holds the mutex until it waits, so this cannot slip in between
+        std::lock_guard<std::mutex> lock(mutex);
+        wakeUp.notify_all();
+    }
+}
+//EOF
@@ -0,0 +1,159 @@
+/*
+ *  AsyncWavWriter: wav writing on a background thread
+ */
+//==============================================================================
+#ifndef AsyncWavWriter_hpp
+#define AsyncWavWriter_hpp
+//==============================================================================
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "LoadMeter.hpp"
+#include "SpscQueue.hpp"
+#include "WavWriter.hpp"
+//==============================================================================
+/*!
+   @class AsyncWavWriter
+   @brief pipelines rendering and disk I/O through a pool of blocks.
+
+   @discussion All blocks are allocated on open(). The render thread fills a
+   free block and submits it; a writer thread converts and writes completed
+   blocks through a WavWriter and hands them back. Blocks travel between the
+   two threads through lock-free queues. When every block is in flight the
+   render thread waits for the writer (backpressure), so memory use stays
+   bounded when the disk is slower than the synth.
+
+   Neither thread spins. The writer sleeps on a condition variable while
+   there is nothing to write and the render thread sleeps on it while it
+   waits for a free block; each side only takes the mutex to wake the other
+   when that one is asleep, so a render thread that keeps ahead of the disk
+   never locks.
+
+   - open() the file and start the writer thread
+   - acquireBlock() / submitBlock() to render straight into a block, or
+     write() to copy an existing buffer
+   - close() to drain the queue, join the thread and patch the header
+
+   Only one thread may produce blocks.
+ */
+//==============================================================================
+class AsyncWavWriter
+{
+public:
+    AsyncWavWriter();
+    /** Destructor: closes the file if it is still open */
+    ~AsyncWavWriter();
+
+    AsyncWavWriter(const AsyncWavWriter&) = delete;
+    AsyncWavWriter& operator=(const AsyncWavWriter&) = delete;
+    //==============================================================================
+    /** opens a file and starts the writer thread
+       @param filename path and filename of the file to write
+       @param numChannels number of interleaved channels
+       @param sampleRate sampling rate of file
+       @param format sample encoding of the file
+       @param blockFrames number of frames in each block
+       @param numBlocks number of blocks in the pool, the depth of the pipeline
+       @returns true on success, false if the file cannot be opened or the
+       blocks do not fit in memory or its budget
+     */
+    bool open(const char *filename, int numChannels, float sampleRate,
+              WavCodec::SampleFormat format = WavCodec::SampleFormat::pcm16,
+              size_t blockFrames = 4096, size_t numBlocks = 16);
+
+    /** gets an empty block to render into, waiting if all are in flight
+       @returns interleaved block of getBlockFrames() frames
+     */
+    float* acquireBlock();
+
+    /** queues the block returned by the last acquireBlock() for writing
+       @param numberOfFrames number of frames filled, up to getBlockFrames()
+     */
+    void submitBlock(size_t numberOfFrames);
+
+    /** copies interleaved audio into blocks and submits them
+       @param audio interleaved audio data
+       @param numberOfFrames number of frames in audio
+     */
+    void write(const float *audio, size_t numberOfFrames);
+
+    /** writes all queued blocks, stops the thread and closes the file
+       @returns true if every write succeeded
+     */
+    bool close();
+    //==============================================================================
+    /** @returns frames per block */
+    size_t getBlockFrames() const {return blockFrames;}
+    /** @returns number of times acquireBlock() had to wait for the disk */
+    uint64_t getStallCount() const {return stallCount;}
+    /** reports every stall to meter as an underrun as well, nullptr for none
+       @param meter meter owned by the caller, such as SynthEngine::getLoadMeter()
+     */
+    void setLoadMeter(LoadMeter *meter) {loadMeter = meter;}
+    /** @returns the underlying writer, only safe to inspect after close() */
+    const WavWriter& getWriter() const {return writer;}
+    /** keeps the block storage and queues resident, after open()
+       @returns true if all were locked
+     */
+    bool lockMemory(bool hugePages = false) const;
+
+private:
+    /** writer thread loop */
+    void run();
+    /** wakes the other thread if flag says it is asleep */
+    void wake(const std::atomic<bool> &flag);
+
+    /** a block in flight */
+    struct Block
+    {
+        /// index into blocks
+        size_t index;
+        /// frames filled
+        size_t frames;
+    };
+
+private:
+    /// file writer, used only by the writer thread while open
+    WavWriter writer;
+    /// writer thread
+    std::thread thread;
+    /// contiguous storage for all blocks
+    std::vector<float> storage;
+    /// accounts storage
+    MemoryAccounting::Tracker storageMemory {MemoryAccounting::Category::ioBuffers};
+    /// blocks ready to be filled
+    std::unique_ptr<SpscQueue<size_t>> freeBlocks;
+    /// blocks ready to be written
+    std::unique_ptr<SpscQueue<Block>> fullBlocks;
+    /// block currently held by the producer
+    size_t currentBlock = 0;
+    /// true while the producer holds currentBlock
+    bool holdingBlock = false;
+    /// number of frames the producer has copied into currentBlock
+    size_t currentFrames = 0;
+    /// frames in one block
+    size_t blockFrames = 0;
+    /// channels per frame
+    int numChannels = 0;
+    /// producer waits on a full pipeline
+    uint64_t stallCount = 0;
+    /// also told about stalls, nullptr for none
+    LoadMeter *loadMeter = nullptr;
+    /// tells the writer thread to finish
+    std::atomic<bool> finishing {false};
+    /// guards sleeping on wakeUp
+    std::mutex mutex;
+    /// signalled when a block is submitted or returned, or on close()
+    std::condition_variable wakeUp;
+    /// set while the writer thread sleeps on an empty queue
+    std::atomic<bool> writerWaiting {false};
+    /// set while the producer sleeps on a full pipeline
+    std::atomic<bool> producerWaiting {false};
+    /// true between open() and close()
+    bool running = false;
+};
+#endif /* AsyncWavWriter_hpp */
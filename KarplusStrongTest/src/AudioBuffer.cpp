@@ -0,0 +1,177 @@
+//
+//  AudioBuffer.cpp
+//  KarplusStrongTest
+//
+#include "AudioBuffer.hpp"
+#include "RealtimeGuard.hpp"
+#include "RealtimeSetup.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <utility>
+#if defined _WIN32 || defined _WIN64
+#include <malloc.h>
+#endif
+//==============================================================================
+namespace
+{
+    float* alignedAllocate(size_t numFloats, MemoryAccounting::Category category)
+    {
+        RealtimeGuard::check("AudioBuffer allocation", numFloats * sizeof(float));
+        if (!MemoryAccounting::reserve(category, numFloats * sizeof(float)))
+        {
+            throw std::bad_alloc();
+        }
+        void *p = nullptr;
+#if defined _WIN32 || defined _WIN64
+        p = _aligned_malloc(numFloats * sizeof(float), AudioBuffer::alignment);
+#else
+        if (posix_memalign(&p, AudioBuffer::alignment, numFloats * sizeof(float)) != 0)
+        {
+            p = nullptr;
+        }
+#endif
+        if (!p)
+        {
+            MemoryAccounting::release(category, numFloats * sizeof(float));
+            throw std::bad_alloc();
+        }
+        return static_cast<float*>(p);
+    }
+
+    void alignedFree(float *p, size_t numFloats, MemoryAccounting::Category category)
+    {
+        MemoryAccounting::release(category, numFloats * sizeof(float));
+#if defined _WIN32 || defined _WIN64
+        _aligned_free(p);
+#else
+        free(p);
+#endif
+    }
+}
+//==============================================================================
+AudioBuffer::AudioBuffer()
+{
+}
+
+AudioBuffer::AudioBuffer(int channels, size_t frames)
+{
+    setSize(channels, frames);
+}
+
+AudioBuffer::~AudioBuffer()
+{
+    release();
+}
+//==============================================================================
+AudioBuffer::AudioBuffer(AudioBuffer &&other) noexcept
+: data(other.data),
+  allocatedFloats(other.allocatedFloats),
+  numChannels(other.numChannels),
+  numFrames(other.numFrames),
+  stride(other.stride),
+  channelPointers(std::move(other.channelPointers)),
+  category(other.category)
+{
+    other.data = nullptr;
+    other.allocatedFloats = 0;
+    other.numChannels = 0;
+    other.numFrames = 0;
+    other.stride = 0;
+    other.channelPointers.clear();
+}
+
+AudioBuffer& AudioBuffer::operator=(AudioBuffer &&other) noexcept
+{
+    if (this != &other)
+    {
+        release();
+        std::swap(data, other.data);
+        std::swap(allocatedFloats, other.allocatedFloats);
+        std::swap(numChannels, other.numChannels);
+        std::swap(numFrames, other.numFrames);
+        std::swap(stride, other.stride);
+        std::swap(channelPointers, other.channelPointers);
+        // the bytes taken over are accounted under this buffer's category
+        MemoryAccounting::release(other.category, getAllocatedBytes());
+        MemoryAccounting::record(category, getAllocatedBytes());
+    }
+    return *this;
+}
+//==============================================================================
+void AudioBuffer::setSize(int channels, size_t frames, bool clearData)
+{
+    const size_t floatsPerLine = alignment / sizeof(float);
+    const size_t newStride = ((frames + floatsPerLine - 1) / floatsPerLine) * floatsPerLine;
+    const size_t required = newStride * (channels > 0 ? channels : 0);
+
+    if (required > allocatedFloats)
+    {
+        alignedFree(data, allocatedFloats, category);
+        data = nullptr;
+        allocatedFloats = 0;
+        data = alignedAllocate(required, category);
+        allocatedFloats = required;
+    }
+
+    numChannels = channels > 0 ? channels : 0;
+    numFrames = frames;
+    stride = newStride;
+    updateChannelPointers();
+
+    if (clearData)
+    {
+        clear();
+    }
+}
+//==============================================================================
+void AudioBuffer::copyFrom(const AudioBuffer &other)
+{
+    setSize(other.numChannels, other.numFrames, false);
+    if (data && other.data)
+    {
+        memcpy(data, other.data, stride * numChannels * sizeof(float));
+    }
+}
+
+void AudioBuffer::clear()
+{
+    if (data)
+    {
+        memset(data, 0, stride * numChannels * sizeof(float));
+    }
+}
+
+void AudioBuffer::release()
+{
+    alignedFree(data, allocatedFloats, category);
+    data = nullptr;
+    allocatedFloats = 0;
+    numChannels = 0;
+    numFrames = 0;
+    stride = 0;
+    channelPointers.clear();
+}
+
+void AudioBuffer::setCategory(MemoryAccounting::Category newCategory)
+{
+    const size_t bytes = allocatedFloats * sizeof(float);
+    MemoryAccounting::release(category, bytes);
+    MemoryAccounting::record(newCategory, bytes);
+    category = newCategory;
+}
+
+bool AudioBuffer::lockMemory(bool hugePages) const
+{
+    return RealtimeSetup::lockMemory(data, getAllocatedBytes(), hugePages);
+}
+//==============================================================================
+void AudioBuffer::updateChannelPointers()
+{
+    channelPointers.resize(numChannels);
+    for (int channel = 0; channel < numChannels; ++channel)
+    {
+        channelPointers[channel] = data + channel * stride;
+    }
+}
+//EOF
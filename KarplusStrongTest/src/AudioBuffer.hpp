@@ -0,0 +1,117 @@
+/*
+ *  AudioBuffer: owning, aligned, planar multi-channel audio storage
+ */
+//==============================================================================
+#ifndef AudioBuffer_hpp
+#define AudioBuffer_hpp
+//==============================================================================
+#include "MemoryAccounting.hpp"
+#include <cstddef>
+#include <vector>
+//==============================================================================
+/*!
+   @class AudioBuffer
+   @brief planar float audio in a single 64-byte aligned allocation.
+
+   @discussion All channels live in one block of memory. Each channel starts
+   on a 64 byte boundary because the channel stride is padded to a multiple
+   of 16 floats, so SIMD kernels can use aligned loads on any channel.
+
+   The buffer owns its memory and frees it on destruction. It can be moved but
+   not copied; use copyFrom() when a deep copy is really wanted.
+   getChannelPointers() gives a float** view for code that still takes the
+   old audioData[channel][sample] arrays.
+
+   Allocations are counted by MemoryAccounting under the buffer's category,
+   and throw std::bad_alloc if they would break an enforced budget.
+ */
+//==============================================================================
+class AudioBuffer
+{
+public:
+    /** creates an empty buffer */
+    AudioBuffer();
+    /**
+       creates a zeroed buffer
+       @param numChannels number of channels
+       @param numFrames samples per channel
+     */
+    AudioBuffer(int numChannels, size_t numFrames);
+    ~AudioBuffer();
+
+    AudioBuffer(AudioBuffer &&other) noexcept;
+    AudioBuffer& operator=(AudioBuffer &&other) noexcept;
+    AudioBuffer(const AudioBuffer&) = delete;
+    AudioBuffer& operator=(const AudioBuffer&) = delete;
+    //==============================================================================
+    /** changes the size of the buffer. Memory is only reallocated when the new
+       size does not fit the current allocation. Contents are not kept.
+       @param numChannels number of channels
+       @param numFrames samples per channel
+       @param clearData zero the samples
+     */
+    void setSize(int numChannels, size_t numFrames, bool clearData = true);
+
+    /** makes this buffer a deep copy of another */
+    void copyFrom(const AudioBuffer &other);
+
+    /** sets every sample to zero */
+    void clear();
+
+    /** frees the memory and sets the size to zero */
+    void release();
+
+    /** sets what the memory is accounted as, moving any bytes already held */
+    void setCategory(MemoryAccounting::Category newCategory);
+    /** @returns what the memory is accounted as */
+    MemoryAccounting::Category getCategory() const {return category;}
+
+    /** keeps the allocation resident, see RealtimeSetup::lockMemory()
+       @param hugePages advise transparent huge pages first
+       @returns true if locked
+     */
+    bool lockMemory(bool hugePages = false) const;
+    //==============================================================================
+    /** @returns pointer to the first sample of a channel, 64 byte aligned */
+    float* getChannel(int channel) {return data + channel * stride;}
+    /** @returns pointer to the first sample of a channel, 64 byte aligned */
+    const float* getChannel(int channel) const {return data + channel * stride;}
+    /** @returns array of getNumChannels() channel pointers */
+    float* const* getChannelPointers() {return channelPointers.data();}
+    /** @returns array of getNumChannels() channel pointers */
+    const float* const* getChannelPointers() const {return channelPointers.data();}
+    /** @returns number of channels */
+    int getNumChannels() const {return numChannels;}
+    /** @returns samples per channel */
+    size_t getNumFrames() const {return numFrames;}
+    /** @returns distance in floats between the start of adjacent channels */
+    size_t getStride() const {return stride;}
+    /** @returns bytes held by the allocation */
+    size_t getAllocatedBytes() const {return allocatedFloats * sizeof(float);}
+    /** @returns true if there are no samples */
+    bool empty() const {return numChannels == 0 || numFrames == 0;}
+
+    /// alignment of every channel in bytes
+    static constexpr size_t alignment = 64;
+
+private:
+    /** sets channelPointers from data and stride */
+    void updateChannelPointers();
+
+private:
+    /// aligned allocation
+    float *data = nullptr;
+    /// floats in the allocation
+    size_t allocatedFloats = 0;
+    /// channel count
+    int numChannels = 0;
+    /// frames per channel
+    size_t numFrames = 0;
+    /// floats between channels, a multiple of alignment / sizeof(float)
+    size_t stride = 0;
+    /// float** view of the channels
+    std::vector<float*> channelPointers;
+    /// MemoryAccounting category of the allocation
+    MemoryAccounting::Category category = MemoryAccounting::Category::other;
+};
+#endif /* AudioBuffer_hpp */
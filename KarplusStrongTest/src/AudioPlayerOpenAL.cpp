@@ -1,5 +1,11 @@
 //==============================================================================
 #include "AudioPlayerOpenAL.hpp"
+#include "SimdKernels.hpp"
+#include "StreamingFilePlayer.hpp"
+#include "Trace.hpp"
+#include <chrono>
+#include <thread>
+#include <vector>
 //==============================================================================
 
 AudioPlayerOpenAL::AudioPlayerOpenAL()
@@ -38,33 +44,12 @@ void AudioPlayerOpenAL::playAudio(ALvoid *data,
                                   ALsizei samplingRate,
                                   uint8_t bitDepth)
 {
-    
-    ALboolean enumeration = alcIsExtensionPresent(nullptr, "ALC_ENUMERATION_EXT");
-    if (enumeration == AL_FALSE)
-        fprintf(stderr, "enumeration extension not available\n");
-    
-    listAudioDevices();
-    
-    const ALCchar *defaultDeviceName = alcGetString(nullptr, ALC_DEFAULT_DEVICE_SPECIFIER);
-    
-    ALCdevice *device = alcOpenDevice(defaultDeviceName);
-    if (!device)
+    ALCcontext *context = openContext();
+    if (!context)
     {
-        testError("unable to open default device\n");
+        return;
     }
     
-    fprintf(stdout, "Device: %s\n\n", alcGetString(device, ALC_DEVICE_SPECIFIER));
-    
-    alGetError();
-    
-    ALCcontext *context = alcCreateContext(device, nullptr);
-    if (!alcMakeContextCurrent(context))
-    {
-        fprintf(stderr, "failed to make default context\n");
-    }
-    
-    testError("make default context");
-    
     ALuint source;
     alGenSources((ALuint)1, &source);
     testError("source generation");
@@ -75,7 +60,7 @@ void AudioPlayerOpenAL::playAudio(ALvoid *data,
     
     if (!data)
     {
-        std::cout << "LOAD ERROR: check the file name is correct" << '\n' << '\n';
+        fprintf(stderr, "LOAD ERROR: check the file name is correct\n\n");
     }
     
     alBufferData(buffer, getAlFormat(channelCount,bitDepth), data, numberOfBytes, samplingRate);
@@ -99,7 +84,49 @@ void AudioPlayerOpenAL::playAudio(ALvoid *data,
     /* exit context */
     alDeleteSources(1, &source);
     alDeleteBuffers(1, &buffer);
-    device = alcGetContextsDevice(context);
+    closeContext(context);
+}
+//==============================================================================
+ALCcontext* AudioPlayerOpenAL::openContext()
+{
+    ALboolean enumeration = alcIsExtensionPresent(nullptr, "ALC_ENUMERATION_EXT");
+    if (enumeration == AL_FALSE)
+        fprintf(stderr, "enumeration extension not available\n");
+    
+    listAudioDevices();
+    
+    const ALCchar *defaultDeviceName = alcGetString(nullptr, ALC_DEFAULT_DEVICE_SPECIFIER);
+    
+    ALCdevice *device = alcOpenDevice(defaultDeviceName);
+    if (!device)
+    {
+        fprintf(stderr, "unable to open default device\n");
+        return nullptr;
+    }
+    
+    fprintf(stdout, "Device: %s\n\n", alcGetString(device, ALC_DEVICE_SPECIFIER));
+    
+    alGetError();
+    
+    ALCcontext *context = alcCreateContext(device, nullptr);
+    if (!context || !alcMakeContextCurrent(context))
+    {
+        fprintf(stderr, "failed to make default context\n");
+        if (context)
+        {
+            alcDestroyContext(context);
+        }
+        alcCloseDevice(device);
+        return nullptr;
+    }
+    
+    testError("make default context");
+    return context;
+}
+
+void AudioPlayerOpenAL::closeContext(ALCcontext *context)
+{
+    ALCdevice *device = alcGetContextsDevice(context);
     alcMakeContextCurrent(nullptr);
     alcDestroyContext(context);
     alcCloseDevice(device);
@@ -107,9 +134,119 @@ void AudioPlayerOpenAL::playAudio(ALvoid *data,
 //==============================================================================
 void AudioPlayerOpenAL::playFile(const char *inputfname)
 {
-    ALsizei numberOfBytes, samplingRate;
-    ALvoid *data = wavReadWrite.readRawData(inputfname, &numberOfBytes, &samplingRate);
-    playAudio(data, wavReadWrite.getFileChannelNumber(), numberOfBytes, samplingRate, wavReadWrite.getFileBitDepth());
+    uint64_t dataSize;
+    FILE *f = wavReadWrite.openRawData(inputfname, &dataSize);
+    if (!f)
+    {
+        fprintf(stderr, "LOAD ERROR: check the file name is correct\n\n");
+        return;
+    }
+    
+    const uint8_t channelCount = (uint8_t)wavReadWrite.getFileChannelNumber();
+    const uint8_t bitDepth = (uint8_t)wavReadWrite.getFileBitDepth();
+    const ALenum format = getAlFormat(channelCount, bitDepth);
+    
+    // 8 and 16 bit PCM is already in OpenAL's layout and can be uploaded
+    // straight from the file, anything else is decoded ahead on a thread
+    if (format == -1 || channelCount > 2)
+    {
+        fclose(f);
+        StreamingFilePlayer player;
+        player.play(inputfname);
+        return;
+    }
+    
+    streamRawData(f, dataSize, format, (size_t)channelCount * bitDepth / 8, wavReadWrite.getFileSampleRate());
+    fclose(f);
+}
+//==============================================================================
+void AudioPlayerOpenAL::streamRawData(FILE *f,
+                                      uint64_t dataSize,
+                                      ALenum format,
+                                      size_t blockAlign,
+                                      ALsizei samplingRate)
+{
+    ALCcontext *context = openContext();
+    if (!context)
+    {
+        return;
+    }
+    
+    ALuint source;
+    alGenSources((ALuint)1, &source);
+    testError("source generation");
+    
+    ALuint buffers[numStreamBuffers];
+    alGenBuffers(numStreamBuffers, buffers);
+    testError("buffer generation");
+    
+    // the only copy of the audio held here is one chunk, read straight from
+    // the file and handed to OpenAL
+    const size_t chunkBytes = streamChunkFrames * blockAlign;
+    std::vector<uint8_t> chunk(chunkBytes);
+    uint64_t bytesRemaining = dataSize - dataSize % blockAlign;
+    
+    auto fillBuffer = [&](ALuint buffer)
+    {
+        KS_TRACE_SCOPE("sinkQueue");
+        const size_t bytes = (size_t)std::min<uint64_t>(chunkBytes, bytesRemaining);
+        if (bytes == 0 || fread(chunk.data(), 1, bytes, f) != bytes)
+        {
+            return false;
+        }
+        bytesRemaining -= bytes;
+        alBufferData(buffer, format, chunk.data(), (ALsizei)bytes, samplingRate);
+        testError("Fail at alBufferData\n");
+        return true;
+    };
+    
+    int buffersQueued = 0;
+    for (int i = 0; i < numStreamBuffers && fillBuffer(buffers[i]); ++i)
+    {
+        alSourceQueueBuffers(source, 1, &buffers[i]);
+        ++buffersQueued;
+    }
+    testError("buffer queueing");
+    
+    alSourcePlay(source);
+    testError("source playing");
+    
+    while (buffersQueued > 0)
+    {
+        // refill every buffer the source has finished with
+        ALint processed = 0;
+        alGetSourcei(source, AL_BUFFERS_PROCESSED, &processed);
+        for (; processed > 0; --processed)
+        {
+            ALuint buffer;
+            alSourceUnqueueBuffers(source, 1, &buffer);
+            --buffersQueued;
+            if (fillBuffer(buffer))
+            {
+                alSourceQueueBuffers(source, 1, &buffer);
+                ++buffersQueued;
+            }
+        }
+        
+        // a source that ran dry stops, restart it if more data was queued
+        ALint sourceState;
+        alGetSourcei(source, AL_SOURCE_STATE, &sourceState);
+        testError("source state get");
+        if (sourceState != AL_PLAYING && buffersQueued > 0)
+        {
+            alGetSourcei(source, AL_BUFFERS_PROCESSED, &processed);
+            if (processed == 0)
+            {
+                alSourcePlay(source);
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    
+    /* exit context */
+    alDeleteSources(1, &source);
+    alDeleteBuffers(numStreamBuffers, buffers);
+    closeContext(context);
 }
 //==============================================================================
 void AudioPlayerOpenAL::playAudioData(float *audioData,
@@ -131,6 +268,18 @@ void AudioPlayerOpenAL::playAudioData(float *audioData,
     }
     
     playAudio(audioDataConversion, channelCount, numberOfBytes, samplingRate, bitDepth);
+    delete[] audioDataConversion;
+}
+
+void AudioPlayerOpenAL::playAudioData(const AudioBuffer &audioData,
+                                      unsigned int samplingRate,
+                                      uint8_t bitDepth)
+{
+    const int channelCount = audioData.getNumChannels();
+    const size_t numFrames = audioData.getNumFrames();
+    AudioBuffer interleaved(1, numFrames * channelCount);
+    SimdKernels::interleave(audioData.getChannelPointers(), channelCount, numFrames, interleaved.getChannel(0));
+    playAudioData(interleaved.getChannel(0), (unsigned int)numFrames, (uint8_t)channelCount, samplingRate, bitDepth);
 }
 
 uint8_t AudioPlayerOpenAL::audioFloat2Byte(float val, float maxValue, uint8_t byteNum)
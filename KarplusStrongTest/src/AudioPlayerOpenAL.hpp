@@ -27,7 +27,10 @@ public:
     static void listAudioDevices();
     //==========================================================================
     /**
-     Play a given .wav file
+     Play a given .wav file. 8 and 16 bit files are streamed from disk in
+     chunks through a queue of OpenAL buffers so playback starts at once and
+     the whole file is never held in memory, other formats are decoded ahead
+     of playback by a StreamingFilePlayer.
      
      @param inputfname path to wav file
      */
@@ -67,8 +70,55 @@ public:
                        uint8_t channelCount,
                        unsigned int samplingRate,
                        uint8_t bitDepth);
-private:
+    /**
+     play a planar audio buffer, channels are interleaved for OpenAL
+
+     @param audioData buffer of values between -1 and 1, one or two channels
+     @param samplingRate sampling rate in hz
+     @param bitDepth bit depth of output (only 8 and 16 supported by OpenAL)
+     */
+    void playAudioData(const AudioBuffer &audioData,
+                       unsigned int samplingRate,
+                       uint8_t bitDepth);
+    /**
+     open the default device and make a context current on it
+
+     @return the context, nullptr on failure
+     */
+    static ALCcontext* openContext();
+    /**
+     release a context from openContext() and close its device
+     */
+    static void closeContext(ALCcontext *context);
+    /**
+     get al format given a bit depth and channel count.
+     
+     @return OpenAL Format enum, -1 if OpenAL has no matching format
+     */
+    static ALenum getAlFormat(uint8_t channelCount, uint8_t bitDepth);
+    /**
+     print message to stderr if OpenAL reported an error since the last check
+     */
     static void testError(const char *message);
+    //==========================================================================
+    /** number of OpenAL buffers cycled while streaming a file */
+    static constexpr int numStreamBuffers = 4;
+    /** frames uploaded to each OpenAL buffer while streaming a file */
+    static constexpr size_t streamChunkFrames = 16384;
+private:
+    /**
+     stream the data chunk of an open wav file through queued buffers
+
+     @param f file positioned at the first byte of audio data
+     @param dataSize bytes of audio data
+     @param format OpenAL format matching the file
+     @param blockAlign bytes per frame
+     */
+    void streamRawData(FILE *f,
+                       uint64_t dataSize,
+                       ALenum format,
+                       size_t blockAlign,
+                       ALsizei samplingRate);
     void playAudio(ALvoid *data,
                    uint8_t channelCount,
                    ALsizei numberOfBytes,
@@ -82,12 +132,6 @@ private:
      @return byte value
      */
     static uint8_t audioFloat2Byte(float val, float maxValue, uint8_t byteNum);
-    /**
-     get al format given a bit depth and channel count of the last read file.
-     
-     @return OpenAL Format enum
-     */
-    ALenum getAlFormat(uint8_t channelCount, uint8_t bitDepth);
 private:
     /// internal file reader
     WavCodec wavReadWrite;
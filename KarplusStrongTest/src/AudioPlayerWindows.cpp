@@ -223,6 +223,14 @@ HRESULT AudioPlayerWindows::playAudioData (float* audioInData, unsigned long num
     PlayAudioStream();
 }
 
+HRESULT AudioPlayerWindows::playAudioData (const AudioBuffer& audioInData)
+{
+    // the stream is rendered as mono, so only the first channel is played
+    return playAudioData (const_cast<float*> (audioInData.getChannel (0)),
+                          (unsigned long) audioInData.getNumFrames (),
+                          1);
+}
+
 float AudioPlayerWindows::getSystemSampleRate ()
 {
     return format.Format.nSamplesPerSec;
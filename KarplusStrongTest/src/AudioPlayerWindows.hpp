@@ -67,6 +67,12 @@ public:
     HRESULT playAudioData (float* audioData,
                            unsigned long numSamples,
                            uint8_t channelCount);
+    /**
+     play the first channel of an audio buffer
+
+     @param audioData buffer of values between -1 and 1
+     */
+    HRESULT playAudioData (const AudioBuffer& audioData);
     //==========================================================================
     // Getters and Setters
 
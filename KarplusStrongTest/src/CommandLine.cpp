@@ -0,0 +1,440 @@
+//
+//  CommandLine.cpp
+//  KarplusStrongTest
+//
+#include "CommandLine.hpp"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+//==============================================================================
+namespace
+{
+    /** @returns true if text is entirely a number, stored in value */
+    bool toNumber(const char *text, double &value)
+    {
+        char *end;
+        value = strtod(text, &end);
+        return end != text && *end == '\0';
+    }
+
+    /** @returns true if text is entirely a whole number, stored in value */
+    bool toInteger(const char *text, long &value)
+    {
+        char *end;
+        value = strtol(text, &end, 10);
+        return end != text && *end == '\0';
+    }
+
+    /** @returns true if text is entirely an unsigned whole number, stored in value
+       @discussion strtoull rather than strtol, long is 32 bits on Windows
+     */
+    bool toUnsigned(const char *text, uint64_t &value)
+    {
+        // strtoull would wrap a minus sign round to a huge value
+        if (strchr(text, '-'))
+        {
+            return false;
+        }
+        char *end;
+        errno = 0;
+        const unsigned long long parsed = strtoull(text, &end, 10);
+        value = (uint64_t)parsed;
+        return end != text && *end == '\0' && errno != ERANGE;
+    }
+}
+//==============================================================================
+bool CommandLine::parse(int argc, const char *const *argv, Options &options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string argument = argv[i];
+
+        // the value of an option, nullptr with a message if it is missing
+        auto value = [&]() -> const char*
+        {
+            if (i + 1 >= argc)
+            {
+                fprintf(stderr, "%s needs a value\n", argument.c_str());
+                return nullptr;
+            }
+            return argv[++i];
+        };
+        auto number = [&](double low, double high, double &result)
+        {
+            const char *text = value();
+            if (!text)
+            {
+                return false;
+            }
+            if (!toNumber(text, result) || result < low || result > high)
+            {
+                fprintf(stderr, "%s must be a number from %g to %g, not %s\n", argument.c_str(), low, high, text);
+                return false;
+            }
+            return true;
+        };
+        auto integer = [&](long low, long high, long &result)
+        {
+            const char *text = value();
+            if (!text)
+            {
+                return false;
+            }
+            if (!toInteger(text, result) || result < low || result > high)
+            {
+                fprintf(stderr, "%s must be a whole number from %ld to %ld, not %s\n", argument.c_str(), low, high, text);
+                return false;
+            }
+            return true;
+        };
+
+        double real;
+        long whole;
+        const char *text;
+        if (argument == "-h" || argument == "--help")
+        {
+            options.showHelp = true;
+        }
+        //==============================================================================
+        else if (argument == "--notes")
+        {
+            if (!(text = value()) || !parseNotes(text, options.notes)) {return false;}
+        }
+        else if (argument == "--notes-file")
+        {
+            if (!(text = value()) || !readNotesFile(text, options.notes)) {return false;}
+        }
+        else if (argument == "--rate")
+        {
+            if (!number(8000.0, 768000.0, real)) {return false;}
+            options.sampleRate = (float)real;
+        }
+        else if (argument == "--output-rate")
+        {
+            if (!number(8000.0, 768000.0, real)) {return false;}
+            options.outputRate = (float)real;
+        }
+        else if (argument == "--block")
+        {
+            if (!integer(1, 65536, whole)) {return false;}
+            options.blockSize = (int)whole;
+        }
+        else if (argument == "--voices")
+        {
+            if (!integer(1, 65536, whole)) {return false;}
+            options.voices = (int)whole;
+        }
+        else if (argument == "--threads")
+        {
+            if (!integer(0, 1024, whole)) {return false;}
+            options.threads = (int)whole;
+        }
+        else if (argument == "--seed")
+        {
+            uint64_t seed;
+            if (!(text = value())) {return false;}
+            if (!toUnsigned(text, seed) || seed > UINT32_MAX)
+            {
+                fprintf(stderr, "%s must be a whole number from 0 to %lu, not %s\n",
+                        argument.c_str(), (unsigned long)UINT32_MAX, text);
+                return false;
+            }
+            options.seed = (uint32_t)seed;
+        }
+        //==============================================================================
+        else if (argument == "--out")
+        {
+            if (!(text = value())) {return false;}
+            options.outputPath = text;
+            options.sink = Sink::file;
+        }
+        else if (argument == "--play")
+        {
+            options.sink = Sink::play;
+        }
+        else if (argument == "--no-output")
+        {
+            options.sink = Sink::none;
+        }
+        else if (argument == "--format")
+        {
+            if (!(text = value())) {return false;}
+            const std::string format = text;
+            if (format == "pcm16") {options.format = WavCodec::SampleFormat::pcm16;}
+            else if (format == "pcm24") {options.format = WavCodec::SampleFormat::pcm24;}
+            else if (format == "float32") {options.format = WavCodec::SampleFormat::float32;}
+            else
+            {
+                fprintf(stderr, "--format must be pcm16, pcm24 or float32, not %s\n", text);
+                return false;
+            }
+        }
+        //==============================================================================
+        else if (argument == "--bench")
+        {
+            if (!(text = value())) {return false;}
+            const std::string benchmark = text;
+            if (benchmark == "all")
+            {
+                options.benchmarks = {"latency", "stress", "regression"};
+            }
+            else if (benchmark == "latency" || benchmark == "stress" || benchmark == "regression")
+            {
+                options.benchmarks.push_back(benchmark);
+            }
+            else
+            {
+                fprintf(stderr, "--bench must be latency, stress, regression or all, not %s\n", text);
+                return false;
+            }
+        }
+        else if (argument == "--soak")
+        {
+            if (!number(0.0, 1e6, real)) {return false;}
+            options.soakSeconds = (float)real;
+        }
+        else if (argument == "--golden")
+        {
+            if (!(text = value())) {return false;}
+            options.goldenDirectory = text;
+        }
+        //==============================================================================
+        else if (argument == "--abort-on-violation")
+        {
+            options.abortOnViolation = true;
+        }
+        else if (argument == "--trace")
+        {
+            if (!(text = value())) {return false;}
+            options.tracePath = text;
+        }
+        else if (argument == "--load" || argument == "--load-json")
+        {
+            options.printLoad = true;
+            options.loadJson = (argument == "--load-json");
+        }
+        else if (argument == "--load-report")
+        {
+            if (!number(0.001, 3600.0, real)) {return false;}
+            options.loadReportSeconds = (float)real;
+        }
+        else if (argument == "--memory" || argument == "--memory-json")
+        {
+            options.printMemory = true;
+            options.memoryJson = (argument == "--memory-json");
+        }
+        else if (argument == "--memory-budget")
+        {
+            if (!number(0.0, 1e7, real)) {return false;}
+            options.memoryBudget = (size_t)(real * 1024.0 * 1024.0);
+        }
+        //==============================================================================
+        else if (argument == "--rt-policy")
+        {
+            if (!(text = value())) {return false;}
+            const std::string policy = text;
+            if (policy == "fifo") {options.realtime.policy = RealtimeSetup::Policy::fifo;}
+            else if (policy == "rr") {options.realtime.policy = RealtimeSetup::Policy::roundRobin;}
+            else if (policy == "normal") {options.realtime.policy = RealtimeSetup::Policy::normal;}
+            else
+            {
+                fprintf(stderr, "--rt-policy must be fifo, rr or normal, not %s\n", text);
+                return false;
+            }
+        }
+        else if (argument == "--rt-priority")
+        {
+            if (!integer(1, 99, whole)) {return false;}
+            options.realtime.renderPriority = (int)whole;
+            options.realtime.workerPriority = (int)whole > 1 ? (int)whole - 1 : 1;
+        }
+        else if (argument == "--render-cores" || argument == "--worker-cores")
+        {
+            std::vector<int> &cores = (argument == "--render-cores") ? options.realtime.renderCores
+                                                                      : options.realtime.workerCores;
+            if (!(text = value())) {return false;}
+            if (!RealtimeSetup::parseCores(text, cores))
+            {
+                fprintf(stderr, "%s must be a core list such as 0,2-3, not %s\n", argument.c_str(), text);
+                return false;
+            }
+        }
+        else if (argument == "--lock-memory")
+        {
+            options.realtime.lockAllMemory = true;
+        }
+        else if (argument == "--lock-buffers")
+        {
+            options.lockBuffers = true;
+        }
+        else if (argument == "--huge-pages")
+        {
+            options.lockBuffers = true;
+            options.hugePages = true;
+        }
+        else
+        {
+            fprintf(stderr, "unknown option %s, see --help\n", argument.c_str());
+            return false;
+        }
+    }
+
+    if (options.notes.empty())
+    {
+        // the note the program always played
+        options.notes.push_back(Note());
+    }
+
+    // checked once the rate is known, it may follow the notes
+    const float nyquist = options.sampleRate / 2.0f;
+    for (const Note &note : options.notes)
+    {
+        if (note.frequency >= nyquist)
+        {
+            fprintf(stderr, "note frequency %g Hz must be below half the sample rate, %g Hz\n",
+                    note.frequency, nyquist);
+            return false;
+        }
+    }
+    return true;
+}
+//==============================================================================
+void CommandLine::printUsage(FILE *file, const char *program)
+{
+    fprintf(file,
+            "usage: %s [options]\n"
+            "\n"
+            "render\n"
+            "  --notes LIST            freq[:start[:length[:gain[:pan]]]],...  (196:0:2)\n"
+            "  --notes-file PATH       one note per line, fields by ':' or spaces, # comments\n"
+            "  --rate HZ               rendering sample rate (48000)\n"
+            "  --block FRAMES          block size (256)\n"
+            "  --voices N              polyphony (32)\n"
+            "  --threads N             render threads, 0 for every core (1); the extra\n"
+            "                          threads spin between blocks, so give them free cores\n"
+            "  --seed N                repeatable noise, 0 seeds from the clock (0)\n"
+            "\n"
+            "output\n"
+            "  --out PATH              write a WAV file while rendering\n"
+            "  --format F              pcm16, pcm24 or float32 (pcm16)\n"
+            "  --output-rate HZ        resample the output to this rate\n"
+            "  --play                  play through OpenAL once rendered (default)\n"
+            "  --no-output             render only, for timing\n"
+            "\n"
+            "benchmarks, instead of rendering\n"
+            "  --bench NAME            latency, stress, regression or all, may be repeated\n"
+            "  --soak SECONDS          soak length of the stress benchmark (60)\n"
+            "  --golden DIR            golden notes of the regression benchmark\n"
+            "\n"
+            "diagnostics\n"
+            "  --load                  print render load statistics, --load-json as JSON\n"
+            "  --load-report SECONDS   print them to stderr at this interval while rendering\n"
+            "  --memory                print memory use on exit, --memory-json as JSON\n"
+            "  --memory-budget MB      refuse voices that do not fit in this total\n"
+            "  --trace PATH            write a Chrome trace (KS_TRACE builds)\n"
+            "  --abort-on-violation    abort on real time violations (KS_REALTIME_GUARD builds)\n"
+            "\n"
+            "real time\n"
+            "  --rt-policy P           fifo, rr or normal (normal)\n"
+            "  --rt-priority N         priority of the render thread, workers get N - 1 (80)\n"
+            "  --render-cores LIST     pin the render thread, e.g. 0 or 0,2-3\n"
+            "  --worker-cores LIST     pin each worker to one of these cores\n"
+            "  --lock-memory           mlockall current and future memory\n"
+            "  --lock-buffers          mlock the engine and output buffers\n"
+            "  --huge-pages            as --lock-buffers, advising transparent huge pages\n",
+            program);
+}
+//==============================================================================
+bool CommandLine::parseNotes(const char *list, std::vector<Note> &notes)
+{
+    std::stringstream stream(list);
+    std::string text;
+    while (std::getline(stream, text, ','))
+    {
+        Note note;
+        if (!parseNote(text, note))
+        {
+            return false;
+        }
+        notes.push_back(note);
+    }
+    return true;
+}
+
+bool CommandLine::readNotesFile(const char *path, std::vector<Note> &notes)
+{
+    FILE *file = fopen(path, "r");
+    if (!file)
+    {
+        fprintf(stderr, "could not open notes file %s\n", path);
+        return false;
+    }
+
+    char line[1024];
+    int lineNumber = 0;
+    bool success = true;
+    while (success && fgets(line, sizeof(line), file))
+    {
+        ++lineNumber;
+        std::string text = line;
+        text = text.substr(0, text.find('#'));
+        if (text.find_first_not_of(" \t\r\n") == std::string::npos)
+        {
+            continue;
+        }
+        Note note;
+        success = parseNote(text, note);
+        if (success)
+        {
+            notes.push_back(note);
+        }
+        else
+        {
+            fprintf(stderr, "in %s line %d\n", path, lineNumber);
+        }
+    }
+    fclose(file);
+    return success;
+}
+
+bool CommandLine::parseNote(const std::string &text, Note &note)
+{
+    std::string fields = text;
+    for (char &c : fields)
+    {
+        if (c == ':' || c == '\t' || c == '\r' || c == '\n')
+        {
+            c = ' ';
+        }
+    }
+
+    std::stringstream stream(fields);
+    std::string field;
+    float *const values[] = {&note.frequency, &note.start, &note.length, &note.gain, &note.pan};
+    int count = 0;
+    while (stream >> field)
+    {
+        double value;
+        if (count == 5 || !toNumber(field.c_str(), value))
+        {
+            count = -1;
+            break;
+        }
+        *values[count++] = (float)value;
+    }
+
+    if (count < 1 || note.frequency <= 0.0f || note.start < 0.0f || note.length <= 0.0f ||
+        note.pan < -1.0f || note.pan > 1.0f)
+    {
+        fprintf(stderr, "bad note \"%s\", expected freq[:start[:length[:gain[:pan]]]]\n", text.c_str());
+        return false;
+    }
+    if (note.frequency < lowestFrequency)
+    {
+        fprintf(stderr, "note frequency %g Hz must be at least %g Hz\n", note.frequency, lowestFrequency);
+        return false;
+    }
+    return true;
+}
+//EOF
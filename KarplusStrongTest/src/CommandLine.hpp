@@ -0,0 +1,128 @@
+/*
+ *  CommandLine: options of the KarplusStrongTest front end
+ */
+//==============================================================================
+#ifndef CommandLine_hpp
+#define CommandLine_hpp
+//==============================================================================
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "RealtimeSetup.hpp"
+#include "WavCodec.hpp"
+//==============================================================================
+/*!
+   @class CommandLine
+   @brief parses the render, output, benchmark and tuning options of the
+   command line front end.
+
+   @discussion Notes are given as freq[:start[:length[:gain[:pan]]]] in Hz,
+   seconds, seconds, linear gain and -1..1 pan, comma separated on the
+   command line or one per line in a notes file, where fields may also be
+   separated by spaces and # starts a comment. Frequencies must lie from
+   lowestFrequency up to, not including, half the sample rate; the renderer
+   sizes its delay lines for the lowest note so no pitch is clamped. Run with
+   --help for the list of options.
+ */
+//==============================================================================
+class CommandLine
+{
+public:
+    /** one note to render */
+    struct Note
+    {
+        float frequency = 196.0f;
+        /// seconds from the start of the render
+        float start = 0.0f;
+        /// T60 in seconds
+        float length = 2.0f;
+        float gain = 1.0f;
+        float pan = 0.0f;
+    };
+
+    /** where the render goes */
+    enum class Sink
+    {
+        play,           ///< OpenAL playback once rendered
+        file,           ///< WAV file written while rendering
+        none            ///< render only, for timing
+    };
+
+    /** everything the front end can be told */
+    struct Options
+    {
+        std::vector<Note> notes;
+        /// rendering sample rate
+        float sampleRate = 48000.0f;
+        /// output sample rate, 0 for the rendering rate
+        float outputRate = 0.0f;
+        int blockSize = 256;
+        int voices = 32;
+        /// render threads including the calling one, 0 for the hardware count;
+        /// the others spin waiting while rendering so the render thread never locks
+        int threads = 1;
+        /// noise seed of the voices, 0 seeds from the clock
+        uint32_t seed = 0;
+        Sink sink = Sink::play;
+        std::string outputPath;
+        WavCodec::SampleFormat format = WavCodec::SampleFormat::pcm16;
+        //==============================================================================
+        /// benchmarks to run instead of rendering: latency, stress, regression
+        std::vector<std::string> benchmarks;
+        /// soak length of the stress benchmark in seconds
+        float soakSeconds = 60.0f;
+        /// golden note directory of the regression benchmark, empty skips them
+        std::string goldenDirectory;
+        //==============================================================================
+        /// abort at the first real time violation, needs a KS_REALTIME_GUARD build
+        bool abortOnViolation = false;
+        /// Chrome trace written after the render, needs a KS_TRACE build
+        std::string tracePath;
+        /// print the LoadMeter statistics after the render
+        bool printLoad = false;
+        /// seconds between LoadMeter prints to stderr while rendering, 0 for none
+        float loadReportSeconds = 0.0f;
+        /// print the LoadMeter statistics as JSON lines
+        bool loadJson = false;
+        /// print MemoryAccounting on exit
+        bool printMemory = false;
+        bool memoryJson = false;
+        /// total memory budget in bytes, 0 for none
+        size_t memoryBudget = 0;
+        /// priority, pinning and mlockall of the render threads
+        RealtimeSetup::Config realtime;
+        /// mlock the engine and output buffers
+        bool lockBuffers = false;
+        bool hugePages = false;
+        //==============================================================================
+        /// --help was given
+        bool showHelp = false;
+    };
+    //==============================================================================
+    /** reads the arguments, printing what is wrong on failure
+       @returns false on a bad argument
+     */
+    static bool parse(int argc, const char *const *argv, Options &options);
+
+    /** prints the options */
+    static void printUsage(FILE *file, const char *program);
+
+    /** parses a comma separated note list
+       @returns false if a note is malformed
+     */
+    static bool parseNotes(const char *list, std::vector<Note> &notes);
+
+    /** reads a notes file
+       @returns false if it cannot be read or a note is malformed
+     */
+    static bool readNotesFile(const char *path, std::vector<Note> &notes);
+
+private:
+    /// lowest note frequency, lower ones would need delay lines seconds long
+    static constexpr float lowestFrequency = 1.0f;
+
+    /** parses one note, fields separated by ':' or spaces */
+    static bool parseNote(const std::string &text, Note &note);
+};
+#endif /* CommandLine_hpp */
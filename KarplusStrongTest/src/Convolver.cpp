@@ -0,0 +1,172 @@
+//
+//  Convolver.cpp
+//  KarplusStrongTest
+//
+#include "Convolver.hpp"
+#include "Resampler.hpp"
+#include "SimdKernels.hpp"
+#include "Trace.hpp"
+#include "WavCodec.hpp"
+#include <algorithm>
+#include <cstring>
+//==============================================================================
+std::shared_ptr<const ConvolutionIR> ConvolutionIR::fromBuffer(const AudioBuffer &impulse, int blockSize,
+                                                               size_t maxFrames)
+{
+    if (impulse.empty() || blockSize < 2 || (blockSize & (blockSize - 1)) != 0)
+    {
+        return nullptr;
+    }
+
+    const size_t length = (maxFrames > 0) ? std::min(maxFrames, impulse.getNumFrames()) : impulse.getNumFrames();
+    auto partitioned = std::make_shared<ConvolutionIR>();
+    partitioned->blockSize = blockSize;
+    partitioned->numChannels = impulse.getNumChannels();
+    partitioned->numPartitions = (int)((length + blockSize - 1) / blockSize);
+
+    const int rows = partitioned->numChannels * partitioned->numPartitions;
+    partitioned->real.setCategory(MemoryAccounting::Category::caches);
+    partitioned->imag.setCategory(MemoryAccounting::Category::caches);
+    partitioned->real.setSize(rows, partitioned->getNumBins());
+    partitioned->imag.setSize(rows, partitioned->getNumBins());
+
+    FFT fft(2 * blockSize);
+    AudioBuffer padded(1, 2 * blockSize);
+    for (int channel = 0; channel < partitioned->numChannels; ++channel)
+    {
+        for (int partition = 0; partition < partitioned->numPartitions; ++partition)
+        {
+            const size_t start = (size_t)partition * blockSize;
+            const size_t count = std::min((size_t)blockSize, length - start);
+            padded.clear();
+            memcpy(padded.getChannel(0), impulse.getChannel(channel) + start, count * sizeof(float));
+
+            const int row = channel * partitioned->numPartitions + partition;
+            fft.forward(padded.getChannel(0), partitioned->real.getChannel(row), partitioned->imag.getChannel(row));
+        }
+    }
+    return partitioned;
+}
+
+std::shared_ptr<const ConvolutionIR> ConvolutionIR::fromFile(const char *filename, int blockSize,
+                                                             float sampleRate, size_t maxFrames)
+{
+    WavCodec wavReadWrite;
+    int fileSampleRate;
+    AudioBuffer impulse = wavReadWrite.readMultiChannelWav(filename, &fileSampleRate);
+    if (impulse.empty())
+    {
+        return nullptr;
+    }
+    if ((float)fileSampleRate != sampleRate)
+    {
+        impulse = Resampler::resampleBuffer(impulse, fileSampleRate, sampleRate);
+    }
+    return fromBuffer(impulse, blockSize, maxFrames);
+}
+//==============================================================================
+Convolver::Convolver()
+{
+}
+
+Convolver::~Convolver()
+{
+}
+//==============================================================================
+bool Convolver::prepare(std::shared_ptr<const ConvolutionIR> impulse, int channel)
+{
+    if (!impulse || channel < 0 || channel >= impulse->getNumChannels())
+    {
+        return false;
+    }
+
+    ir = impulse;
+    irChannel = channel;
+    blockSize = ir->getBlockSize();
+    numPartitions = ir->getNumPartitions();
+    fft.setSize(2 * blockSize);
+
+    for (AudioBuffer *buffer : {&delayReal, &delayImag, &timeBuffer, &accumulator, &result})
+    {
+        buffer->setCategory(MemoryAccounting::Category::workBuffers);
+    }
+    delayReal.setSize(numPartitions, ir->getNumBins());
+    delayImag.setSize(numPartitions, ir->getNumBins());
+    timeBuffer.setSize(1, 2 * blockSize);
+    accumulator.setSize(2, ir->getNumBins());
+    result.setSize(1, 2 * blockSize);
+    reset();
+    return true;
+}
+
+void Convolver::reset()
+{
+    delayReal.clear();
+    delayImag.clear();
+    timeBuffer.clear();
+    result.clear();
+    delayIndex = 0;
+    position = 0;
+}
+//==============================================================================
+void Convolver::process(const float *input, float *output, int numFrames)
+{
+    KS_TRACE_SCOPE("convolve");
+    if (!ir)
+    {
+        memmove(output, input, numFrames * sizeof(float));
+        return;
+    }
+
+    float *collected = timeBuffer.getChannel(0) + blockSize;
+    const float *ready = result.getChannel(0) + blockSize;
+
+    while (numFrames > 0)
+    {
+        const int framesNow = std::min(numFrames, blockSize - position);
+
+        // input is taken before output is written so the two may alias
+        memcpy(collected + position, input, framesNow * sizeof(float));
+        memcpy(output, ready + position, framesNow * sizeof(float));
+
+        position += framesNow;
+        input += framesNow;
+        output += framesNow;
+        numFrames -= framesNow;
+
+        if (position == blockSize)
+        {
+            processPartition();
+            position = 0;
+        }
+    }
+}
+//==============================================================================
+void Convolver::processPartition()
+{
+    const int numBins = ir->getNumBins();
+    float *time = timeBuffer.getChannel(0);
+
+    fft.forward(time, delayReal.getChannel(delayIndex), delayImag.getChannel(delayIndex));
+
+    // newest input with the first partition, the oldest with the last
+    float *accReal = accumulator.getChannel(0);
+    float *accImag = accumulator.getChannel(1);
+    memset(accReal, 0, numBins * sizeof(float));
+    memset(accImag, 0, numBins * sizeof(float));
+    int slot = delayIndex;
+    for (int partition = 0; partition < numPartitions; ++partition)
+    {
+        SimdKernels::complexMultiplyAccumulate(delayReal.getChannel(slot), delayImag.getChannel(slot),
+                                               ir->getReal(irChannel, partition), ir->getImag(irChannel, partition),
+                                               accReal, accImag, numBins);
+        slot = (slot == 0) ? numPartitions - 1 : slot - 1;
+    }
+
+    // overlap-save: the second half of the inverse transform is the output
+    fft.inverse(accReal, accImag, result.getChannel(0));
+
+    memcpy(time, time + blockSize, blockSize * sizeof(float));
+    delayIndex = (delayIndex + 1 == numPartitions) ? 0 : delayIndex + 1;
+}
+//EOF
@@ -0,0 +1,157 @@
+/*
+ *  Convolver: uniformly partitioned FFT convolution for body resonance
+ */
+//==============================================================================
+#ifndef Convolver_hpp
+#define Convolver_hpp
+//==============================================================================
+#include <memory>
+#include "AudioBuffer.hpp"
+#include "FFT.hpp"
+//==============================================================================
+/*!
+   @class ConvolutionIR
+   @brief the spectra of an impulse response cut into equal partitions.
+
+   @discussion An impulse response is split into partitions of blockSize
+   samples, each zero padded to 2 * blockSize and transformed once. The
+   result is immutable and held through a shared_ptr, so any number of
+   Convolvers can use one response without copying it.
+ */
+//==============================================================================
+class ConvolutionIR
+{
+public:
+    /** partitions an impulse response held in memory
+       @param impulse one or more channels of impulse response
+       @param blockSize partition size, a power of two
+       @param maxFrames truncates the response, 0 uses all of it
+       @returns the partitioned response, nullptr if impulse is empty
+     */
+    static std::shared_ptr<const ConvolutionIR> fromBuffer(const AudioBuffer &impulse, int blockSize,
+                                                           size_t maxFrames = 0);
+
+    /** reads, resamples if needed and partitions an impulse response file
+       @param filename wav file of the response
+       @param blockSize partition size, a power of two
+       @param sampleRate rate the response will run at
+       @param maxFrames truncates the response, 0 uses all of it
+       @returns the partitioned response, nullptr if the file cannot be read
+     */
+    static std::shared_ptr<const ConvolutionIR> fromFile(const char *filename, int blockSize,
+                                                         float sampleRate, size_t maxFrames = 0);
+    //==============================================================================
+    /** @returns samples per partition */
+    int getBlockSize() const {return blockSize;}
+    /** @returns number of partitions per channel */
+    int getNumPartitions() const {return numPartitions;}
+    /** @returns channels of the response */
+    int getNumChannels() const {return numChannels;}
+    /** @returns bins in each partition spectrum */
+    int getNumBins() const {return blockSize + 1;}
+    /** @returns real part of the spectrum of one partition */
+    const float* getReal(int channel, int partition) const {return real.getChannel(channel * numPartitions + partition);}
+    /** @returns imaginary part of the spectrum of one partition */
+    const float* getImag(int channel, int partition) const {return imag.getChannel(channel * numPartitions + partition);}
+
+private:
+    /// samples per partition
+    int blockSize = 0;
+    /// partitions per channel
+    int numPartitions = 0;
+    /// channels of the response
+    int numChannels = 0;
+    /// one row per channel and partition
+    AudioBuffer real, imag;
+};
+//==============================================================================
+/*!
+   @class Convolver
+   @brief convolves one channel with a ConvolutionIR, uniformly partitioned.
+
+   @discussion Each block of input is transformed once and kept in a
+   frequency domain delay line; the output spectrum is the sum of every
+   delayed input spectrum times the matching partition spectrum, computed
+   with SimdKernels::complexMultiplyAccumulate(), followed by one inverse
+   transform (overlap-save). Latency is one partition, whatever block size
+   process() is called with.
+
+   All memory is allocated by prepare(), process() does not allocate.
+
+   Convolution is linear, so a body resonance shared by many voices is best
+   applied once to their sum on the mix bus rather than per voice.
+ */
+//==============================================================================
+class Convolver
+{
+public:
+    Convolver();
+    ~Convolver();
+    //==============================================================================
+    /** allocates the delay line and work buffers for a response
+       @param impulse partitioned response, shared with other convolvers
+       @param channel channel of the response to convolve with
+       @returns false if impulse is null or channel is out of range
+     */
+    bool prepare(std::shared_ptr<const ConvolutionIR> impulse, int channel = 0);
+
+    /** convolves a block of samples, input and output may be the same array
+       @param input numFrames samples
+       @param output numFrames samples delayed by getLatency()
+       @param numFrames any number of samples
+     */
+    void process(const float *input, float *output, int numFrames);
+
+    /** clears the delay line so the next output starts from silence */
+    void reset();
+    //==============================================================================
+    /** @returns delay of the output in samples */
+    int getLatency() const {return blockSize;}
+    /** @returns bytes of the delay line and work buffers, the shared response is not included */
+    size_t getAllocatedBytes() const
+    {
+        return delayReal.getAllocatedBytes() + delayImag.getAllocatedBytes() + timeBuffer.getAllocatedBytes() +
+               accumulator.getAllocatedBytes() + result.getAllocatedBytes();
+    }
+    /** keeps the delay line and work buffers resident, the shared response is not locked
+       @returns true if all were locked
+     */
+    bool lockMemory(bool hugePages = false) const
+    {
+        bool locked = true;
+        for (const AudioBuffer *buffer : {&delayReal, &delayImag, &timeBuffer, &accumulator, &result})
+        {
+            locked &= buffer->lockMemory(hugePages);
+        }
+        return locked;
+    }
+
+private:
+    /** convolves the block collected in timeBuffer */
+    void processPartition();
+
+private:
+    /// partitioned response
+    std::shared_ptr<const ConvolutionIR> ir;
+    /// channel of the response in use
+    int irChannel = 0;
+    /// transform of size 2 * blockSize
+    FFT fft;
+    /// samples per partition
+    int blockSize = 0;
+    /// partitions in the response
+    int numPartitions = 0;
+    /// spectra of past input blocks, one row per partition
+    AudioBuffer delayReal, delayImag;
+    /// row of the delay line holding the newest spectrum
+    int delayIndex = 0;
+    /// previous and current input block
+    AudioBuffer timeBuffer;
+    /// summed output spectrum, real then imaginary
+    AudioBuffer accumulator;
+    /// inverse transform of the accumulator, the second half is output
+    AudioBuffer result;
+    /// samples collected into the current block
+    int position = 0;
+};
+#endif /* Convolver_hpp */
@@ -0,0 +1,159 @@
+//
+//  FFT.cpp
+//  KarplusStrongTest
+//
+#define _USE_MATH_DEFINES
+#include "FFT.hpp"
+#include <cmath>
+#include <utility>
+//==============================================================================
+FFT::FFT(int fftSize)
+{
+    setSize(fftSize);
+}
+//==============================================================================
+void FFT::setSize(int fftSize)
+{
+    size = fftSize;
+    const int half = size / 2;
+
+    int bits = 0;
+    while ((1 << bits) < half)
+    {
+        ++bits;
+    }
+    bitReverse.resize(half);
+    for (int i = 0; i < half; ++i)
+    {
+        int reversed = 0;
+        for (int b = 0; b < bits; ++b)
+        {
+            reversed |= ((i >> b) & 1) << (bits - 1 - b);
+        }
+        bitReverse[i] = reversed;
+    }
+
+    twiddleReal.resize(half / 2);
+    twiddleImag.resize(half / 2);
+    for (int k = 0; k < half / 2; ++k)
+    {
+        twiddleReal[k] = (float)std::cos(2.0 * M_PI * k / half);
+        twiddleImag[k] = (float)-std::sin(2.0 * M_PI * k / half);
+    }
+
+    splitReal.resize(half + 1);
+    splitImag.resize(half + 1);
+    for (int k = 0; k <= half; ++k)
+    {
+        splitReal[k] = (float)std::cos(2.0 * M_PI * k / size);
+        splitImag[k] = (float)-std::sin(2.0 * M_PI * k / size);
+    }
+
+    scratchReal.assign(half, 0.0f);
+    scratchImag.assign(half, 0.0f);
+}
+//==============================================================================
+void FFT::transform()
+{
+    const int n = size / 2;
+    float *re = scratchReal.data();
+    float *im = scratchImag.data();
+
+    for (int i = 0; i < n; ++i)
+    {
+        const int j = bitReverse[i];
+        if (j > i)
+        {
+            std::swap(re[i], re[j]);
+            std::swap(im[i], im[j]);
+        }
+    }
+
+    for (int length = 2; length <= n; length <<= 1)
+    {
+        const int halfLength = length / 2;
+        const int step = n / length;
+        for (int start = 0; start < n; start += length)
+        {
+            for (int k = 0; k < halfLength; ++k)
+            {
+                const float wr = twiddleReal[k * step];
+                const float wi = twiddleImag[k * step];
+                const int a = start + k;
+                const int b = a + halfLength;
+                const float tr = re[b] * wr - im[b] * wi;
+                const float ti = re[b] * wi + im[b] * wr;
+                re[b] = re[a] - tr;
+                im[b] = im[a] - ti;
+                re[a] += tr;
+                im[a] += ti;
+            }
+        }
+    }
+}
+//==============================================================================
+void FFT::forward(const float *input, float *real, float *imag)
+{
+    const int half = size / 2;
+
+    // even samples as the real part, odd samples as the imaginary part
+    for (int i = 0; i < half; ++i)
+    {
+        scratchReal[i] = input[2 * i];
+        scratchImag[i] = input[2 * i + 1];
+    }
+    transform();
+
+    // split the half size spectrum into the spectra of the even and odd
+    // samples and combine them into the full spectrum
+    for (int k = 0; k <= half; ++k)
+    {
+        const int a = (k == half) ? 0 : k;
+        const int b = (k == 0) ? 0 : half - k;
+        const float zr = scratchReal[a], zi = scratchImag[a];
+        const float cr = scratchReal[b], ci = -scratchImag[b];
+
+        const float evenR = 0.5f * (zr + cr);
+        const float evenI = 0.5f * (zi + ci);
+        // (z - conj) / 2i
+        const float oddR = 0.5f * (zi - ci);
+        const float oddI = -0.5f * (zr - cr);
+
+        real[k] = evenR + splitReal[k] * oddR - splitImag[k] * oddI;
+        imag[k] = evenI + splitReal[k] * oddI + splitImag[k] * oddR;
+    }
+}
+//==============================================================================
+void FFT::inverse(const float *real, const float *imag, float *output)
+{
+    const int half = size / 2;
+
+    // undo the split step, then an inverse complex transform done as a
+    // forward transform of the conjugate
+    for (int k = 0; k < half; ++k)
+    {
+        const float xr = real[k], xi = imag[k];
+        const float cr = real[half - k], ci = -imag[half - k];
+
+        const float evenR = 0.5f * (xr + cr);
+        const float evenI = 0.5f * (xi + ci);
+        const float diffR = 0.5f * (xr - cr);
+        const float diffI = 0.5f * (xi - ci);
+        // odd = diff * conj(split)
+        const float oddR = diffR * splitReal[k] + diffI * splitImag[k];
+        const float oddI = diffI * splitReal[k] - diffR * splitImag[k];
+
+        // z = even + i odd, conjugated for the forward transform
+        scratchReal[k] = evenR - oddI;
+        scratchImag[k] = -(evenI + oddR);
+    }
+    transform();
+
+    const float scale = 1.0f / half;
+    for (int i = 0; i < half; ++i)
+    {
+        output[2 * i] = scratchReal[i] * scale;
+        output[2 * i + 1] = -scratchImag[i] * scale;
+    }
+}
+//EOF
@@ -0,0 +1,75 @@
+/*
+ *  FFT: real to complex transforms for block convolution
+ */
+//==============================================================================
+#ifndef FFT_hpp
+#define FFT_hpp
+//==============================================================================
+#include <cstddef>
+#include <vector>
+//==============================================================================
+/*!
+   @class FFT
+   @brief power of two real FFT with precomputed tables.
+
+   @discussion A real transform of size N is computed as a complex radix-2
+   transform of N / 2 points on the even and odd samples, followed by a split
+   step. Spectra are kept in split form, separate real and imaginary arrays of
+   N / 2 + 1 bins, which is the layout SimdKernels::complexMultiplyAccumulate()
+   works on.
+
+   All tables are built by the constructor; forward() and inverse() do not
+   allocate, but use internal scratch, so one FFT must not be shared between
+   threads.
+ */
+//==============================================================================
+class FFT
+{
+public:
+    /**
+       Constructor
+       @param size transform size, a power of two of at least 4
+     */
+    explicit FFT(int size = 4);
+
+    /** rebuilds the tables for a new size
+       @param size transform size, a power of two of at least 4
+     */
+    void setSize(int size);
+    //==============================================================================
+    /** real to complex transform
+       @param input size samples
+       @param real output of getNumBins() values
+       @param imag output of getNumBins() values
+     */
+    void forward(const float *input, float *real, float *imag);
+
+    /** complex to real transform, scaled by 1 / size so inverse(forward(x)) == x
+       @param real getNumBins() values
+       @param imag getNumBins() values
+       @param output size samples
+     */
+    void inverse(const float *real, const float *imag, float *output);
+    //==============================================================================
+    /** @returns transform size */
+    int getSize() const {return size;}
+    /** @returns number of bins in a spectrum, size / 2 + 1 */
+    int getNumBins() const {return size / 2 + 1;}
+
+private:
+    /** in place complex transform of size / 2 points on scratchReal / scratchImag */
+    void transform();
+
+private:
+    /// real transform size
+    int size = 0;
+    /// bit reversed index of each of the size / 2 complex points
+    std::vector<int> bitReverse;
+    /// exp(-2 pi i k / (size / 2)) for the complex stages
+    std::vector<float> twiddleReal, twiddleImag;
+    /// exp(-2 pi i k / size) for the split step
+    std::vector<float> splitReal, splitImag;
+    /// complex working buffer
+    std::vector<float> scratchReal, scratchImag;
+};
+#endif /* FFT_hpp */
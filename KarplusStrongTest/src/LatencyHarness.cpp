@@ -0,0 +1,181 @@
+//
+//  LatencyHarness.cpp
+//  KarplusStrongTest
+//
+#include "LatencyHarness.hpp"
+#include "SynthEngine.hpp"
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <random>
+//==============================================================================
+std::vector<LatencyHarness::Result> LatencyHarness::run(const Config &config)
+{
+    std::vector<Result> results;
+    for (Mode mode : {Mode::wavetable, Mode::streaming})
+    {
+        for (int blockSize : config.blockSizes)
+        {
+            for (int voices : config.voiceCounts)
+            {
+                results.push_back(measure(mode, blockSize, std::max(voices, 1), config));
+            }
+        }
+    }
+    return results;
+}
+//==============================================================================
+LatencyHarness::Result LatencyHarness::measure(Mode mode, int blockSize, int voices, const Config &config)
+{
+    typedef std::chrono::steady_clock Clock;
+
+    const double blockSeconds = blockSize / (double)config.sampleRate;
+    const double sinkSeconds = config.sinkBlocks * blockSeconds;
+    const float gain = 1.0f / voices;
+
+    std::mt19937 random(config.seed);
+    std::uniform_real_distribution<float> pitch(82.41f, 659.26f); // E2 to E5
+    std::uniform_real_distribution<double> arrival(0.0, 1.0);
+
+    std::vector<double> renderLatency, sinkLatency;
+    renderLatency.reserve(config.notesPerRun);
+    sinkLatency.reserve(config.notesPerRun);
+    std::vector<float> left(blockSize), right(blockSize);
+
+    // adds one note on, given the blocks rendered before its first sample,
+    // where that sample sits in its block and the wall clock time taken
+    auto record = [&](double wait, int blocksBefore, int firstSample, double elapsed)
+    {
+        const double deadline = (blocksBefore + 1) * blockSeconds;
+        const double overrun = std::max(0.0, elapsed - deadline);
+        renderLatency.push_back(wait + elapsed);
+        sinkLatency.push_back(wait + blocksBefore * blockSeconds + sinkSeconds
+                              + firstSample / (double)config.sampleRate + overrun);
+    };
+
+    if (mode == Mode::streaming)
+    {
+        SynthEngine engine;
+        engine.prepare(config.sampleRate, blockSize, voices);
+        for (int voice = 0; voice < voices - 1; ++voice)
+        {
+            engine.noteOn(pitch(random), gain, 0.0f, 60.0f);
+        }
+        for (int block = 0; block < 4; ++block)
+        {
+            engine.renderBlock(left.data(), right.data(), blockSize);
+        }
+
+        for (int note = 0; note < config.notesPerRun; ++note)
+        {
+            const double wait = (1.0 - arrival(random)) * blockSeconds;
+            const float frequency = pitch(random);
+
+            const Clock::time_point start = Clock::now();
+            const int voice = engine.noteOn(frequency, gain, 0.0f, config.noteLength);
+            int blocksBefore = 0;
+            int firstSample = -1;
+            double elapsed = 0.0;
+            while (firstSample < 0 && blocksBefore < 16)
+            {
+                engine.renderBlock(left.data(), right.data(), blockSize);
+                elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+                const float *output = engine.getVoiceOutput(voice);
+                for (int n = 0; output && n < blockSize; ++n)
+                {
+                    if (output[n] != 0.0f)
+                    {
+                        firstSample = n;
+                        break;
+                    }
+                }
+                blocksBefore += (firstSample < 0);
+            }
+            record(wait, blocksBefore, std::max(firstSample, 0), elapsed);
+        }
+    }
+    else
+    {
+        std::vector<std::unique_ptr<PluckedNote>> notes;
+        for (int voice = 0; voice < voices; ++voice)
+        {
+            notes.emplace_back(new PluckedNote(false));
+            notes.back()->setSampleRate(config.sampleRate);
+            notes.back()->setNoteLength(config.noteLength);
+            notes.back()->setFrequency(pitch(random));
+            notes.back()->generateNote();
+        }
+        PluckedNote &measured = *notes.back();
+
+        for (int note = 0; note < config.notesPerRun; ++note)
+        {
+            const double wait = (1.0 - arrival(random)) * blockSeconds;
+            const float frequency = pitch(random);
+
+            const Clock::time_point start = Clock::now();
+            measured.setFrequency(frequency);
+            measured.generateNote();
+            int blocksBefore = 0;
+            int firstSample = -1;
+            double elapsed = 0.0;
+            while (firstSample < 0 && blocksBefore < 16)
+            {
+                for (int n = 0; n < blockSize; ++n)
+                {
+                    float sum = 0.0f;
+                    for (int voice = 0; voice < voices - 1; ++voice)
+                    {
+                        sum += gain * notes[voice]->process();
+                    }
+                    const float sample = measured.process();
+                    if (firstSample < 0 && sample != 0.0f)
+                    {
+                        firstSample = n;
+                    }
+                    left[n] = sum + gain * sample;
+                }
+                elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+                blocksBefore += (firstSample < 0);
+            }
+            record(wait, blocksBefore, std::max(firstSample, 0), elapsed);
+        }
+    }
+
+    Result result;
+    result.mode = mode;
+    result.blockSize = blockSize;
+    result.voices = voices;
+    result.render = summarise(renderLatency);
+    result.sink = summarise(sinkLatency);
+    return result;
+}
+//==============================================================================
+LatencyHarness::Distribution LatencyHarness::summarise(std::vector<double> &values)
+{
+    Distribution distribution;
+    if (values.empty())
+    {
+        return distribution;
+    }
+    std::sort(values.begin(), values.end());
+    distribution.median = 1000.0 * values[values.size() / 2];
+    distribution.p99 = 1000.0 * values[std::min(values.size() - 1, (size_t)(0.99 * values.size()))];
+    distribution.max = 1000.0 * values.back();
+    return distribution;
+}
+//==============================================================================
+void LatencyHarness::print(const std::vector<Result> &results, FILE *file)
+{
+    fprintf(file, "%-10s %6s %6s | %26s | %26s\n", "mode", "block", "voices",
+            "render ms  median  p99  max", "sink ms  median  p99  max");
+    for (const Result &result : results)
+    {
+        fprintf(file, "%-10s %6d %6d | %8.3f %8.3f %8.3f | %8.3f %8.3f %8.3f\n",
+                result.mode == Mode::wavetable ? "wavetable" : "streaming",
+                result.blockSize, result.voices,
+                result.render.median, result.render.p99, result.render.max,
+                result.sink.median, result.sink.p99, result.sink.max);
+    }
+    fflush(file);
+}
+//EOF
@@ -0,0 +1,97 @@
+/*
+ *  LatencyHarness: note on to first sample latency of the render paths
+ */
+//==============================================================================
+#ifndef LatencyHarness_hpp
+#define LatencyHarness_hpp
+//==============================================================================
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+//==============================================================================
+/*!
+   @class LatencyHarness
+   @brief measures how long a note on takes to be heard, per block size,
+   voice count and generation mode.
+
+   @discussion Note ons arrive at a random point of a block period and are
+   handled at the next block boundary, as a real time callback would. The
+   latency of each note on is split into
+
+   - render: the wait for the block boundary plus the measured wall clock
+     time of the block that holds the first non-zero sample of the note
+   - sink: the wait for the block boundary, the blocks already queued in the
+     sink and the position of the first sample in its block, plus any time
+     the render overran its block
+
+   Two modes are compared. Wavetable runs generateNote() for the whole note
+   on the note on and reads it back with process(), streaming plucks a voice
+   of a SynthEngine and renders it block by block. The other voices keep
+   sounding in both so the cost of a full mix is included.
+ */
+//==============================================================================
+class LatencyHarness
+{
+public:
+    /** how a note is produced */
+    enum class Mode
+    {
+        /** generateNote() then process() per sample */
+        wavetable,
+        /** SynthEngine delay line voices */
+        streaming
+    };
+
+    /** what to measure */
+    struct Config
+    {
+        /// rendering sample rate
+        float sampleRate = 48000.0f;
+        /// block sizes to measure
+        std::vector<int> blockSizes {64, 128, 256, 512};
+        /// voices sounding, including the measured note
+        std::vector<int> voiceCounts {1, 8, 32};
+        /// note ons per block size and voice count
+        int notesPerRun = 50;
+        /// seconds each note lasts, the wavetable mode computes all of it on note on
+        float noteLength = 2.0f;
+        /// blocks queued in the sink ahead of the block being rendered
+        int sinkBlocks = 2;
+        /// seed for pitches and arrival times
+        uint32_t seed = 1;
+    };
+
+    /** a latency distribution in milliseconds */
+    struct Distribution
+    {
+        double median = 0.0, p99 = 0.0, max = 0.0;
+    };
+
+    /** latencies of one mode, block size and voice count */
+    struct Result
+    {
+        Mode mode = Mode::streaming;
+        int blockSize = 0;
+        int voices = 0;
+        /// note on to the first sample leaving the render stage
+        Distribution render;
+        /// note on to the first sample leaving the sink
+        Distribution sink;
+    };
+    //==============================================================================
+    /** measures both modes for every block size and voice count
+       @returns one result per mode, block size and voice count
+     */
+    static std::vector<Result> run(const Config &config);
+
+    /** prints results as a table */
+    static void print(const std::vector<Result> &results, FILE *file);
+
+private:
+    /** measures one mode, block size and voice count */
+    static Result measure(Mode mode, int blockSize, int voices, const Config &config);
+
+    /** @returns median, 99th percentile and maximum of values, which are sorted */
+    static Distribution summarise(std::vector<double> &values);
+};
+#endif /* LatencyHarness_hpp */
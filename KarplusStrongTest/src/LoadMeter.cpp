@@ -0,0 +1,143 @@
+//
+//  LoadMeter.cpp
+//  KarplusStrongTest
+//
+#include "LoadMeter.hpp"
+#include <algorithm>
+#include <vector>
+//==============================================================================
+LoadMeter::LoadMeter()
+{
+}
+
+LoadMeter::~LoadMeter()
+{
+    stopReporting();
+}
+//==============================================================================
+void LoadMeter::prepare(double rate, size_t size)
+{
+    sampleRate = rate;
+    historySize = std::max<size_t>(size, 1);
+    history.reset(new std::atomic<float>[historySize]);
+    reset();
+}
+
+void LoadMeter::reset()
+{
+    for (size_t i = 0; i < historySize; ++i)
+    {
+        history[i].store(0.0f, std::memory_order_relaxed);
+    }
+    totalBlocks.store(0);
+    lateBlocks.store(0);
+    underruns.store(0);
+}
+//==============================================================================
+void LoadMeter::beginBlock()
+{
+    blockStart = std::chrono::steady_clock::now();
+}
+
+void LoadMeter::endBlock(int numFrames)
+{
+    if (!history || numFrames <= 0)
+    {
+        return;
+    }
+    const double renderSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - blockStart).count();
+    const double load = renderSeconds * sampleRate / numFrames;
+
+    if (load > 1.0)
+    {
+        lateBlocks.fetch_add(1, std::memory_order_relaxed);
+    }
+    const uint64_t block = totalBlocks.load(std::memory_order_relaxed);
+    history[block % historySize].store((float)load, std::memory_order_relaxed);
+    totalBlocks.store(block + 1, std::memory_order_release);
+}
+//==============================================================================
+LoadMeter::Stats LoadMeter::getStats() const
+{
+    Stats stats;
+    stats.totalBlocks = totalBlocks.load(std::memory_order_acquire);
+    stats.lateBlocks = lateBlocks.load(std::memory_order_relaxed);
+    stats.underruns = underruns.load(std::memory_order_relaxed);
+    stats.windowBlocks = (size_t)std::min<uint64_t>(stats.totalBlocks, historySize);
+    if (stats.windowBlocks == 0)
+    {
+        return stats;
+    }
+
+    // the ring may be written while it is copied, which only mixes in a
+    // newer load for an older one
+    std::vector<float> loads(stats.windowBlocks);
+    for (size_t i = 0; i < stats.windowBlocks; ++i)
+    {
+        loads[i] = history[i].load(std::memory_order_relaxed);
+    }
+    std::sort(loads.begin(), loads.end());
+
+    double sum = 0.0;
+    for (float load : loads)
+    {
+        sum += load;
+    }
+    stats.minLoad = loads.front();
+    stats.maxLoad = loads.back();
+    stats.avgLoad = sum / loads.size();
+    stats.p99Load = loads[std::min(loads.size() - 1, (size_t)(0.99 * loads.size()))];
+    return stats;
+}
+//==============================================================================
+void LoadMeter::dump(FILE *file, bool json) const
+{
+    const Stats stats = getStats();
+    if (json)
+    {
+        fprintf(file, "{\"blocks\":%llu,\"late\":%llu,\"underruns\":%llu,\"window\":%zu,"
+                      "\"load\":{\"min\":%.4f,\"avg\":%.4f,\"max\":%.4f,\"p99\":%.4f}}\n",
+                (unsigned long long)stats.totalBlocks, (unsigned long long)stats.lateBlocks,
+                (unsigned long long)stats.underruns, stats.windowBlocks,
+                stats.minLoad, stats.avgLoad, stats.maxLoad, stats.p99Load);
+    }
+    else
+    {
+        fprintf(file, "load min %5.1f%%  avg %5.1f%%  max %5.1f%%  p99 %5.1f%%  | blocks %llu  late %llu  underruns %llu\n",
+                100.0 * stats.minLoad, 100.0 * stats.avgLoad, 100.0 * stats.maxLoad, 100.0 * stats.p99Load,
+                (unsigned long long)stats.totalBlocks, (unsigned long long)stats.lateBlocks,
+                (unsigned long long)stats.underruns);
+    }
+    fflush(file);
+}
+//==============================================================================
+void LoadMeter::startReporting(double intervalSeconds, bool json)
+{
+    stopReporting();
+    reporting = true;
+    reporter = std::thread(&LoadMeter::report, this, intervalSeconds, json);
+}
+
+void LoadMeter::stopReporting()
+{
+    {
+        std::lock_guard<std::mutex> lock(reportLock);
+        reporting = false;
+    }
+    reportWake.notify_all();
+    if (reporter.joinable())
+    {
+        reporter.join();
+    }
+}
+
+void LoadMeter::report(double intervalSeconds, bool json)
+{
+    const auto interval = std::chrono::duration<double>(intervalSeconds);
+    std::unique_lock<std::mutex> lock(reportLock);
+    while (!reportWake.wait_for(lock, interval, [this] {return !reporting;}))
+    {
+        dump(stderr, json);
+    }
+}
+//EOF
@@ -0,0 +1,133 @@
+/*
+ *  LoadMeter: per block CPU load and deadline misses of the render path
+ */
+//==============================================================================
+#ifndef LoadMeter_hpp
+#define LoadMeter_hpp
+//==============================================================================
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+//==============================================================================
+/*!
+   @class LoadMeter
+   @brief times every rendered block against its real time duration.
+
+   @discussion The render thread brackets each block with beginBlock() and
+   endBlock(), or a ScopedBlock. Load is render time divided by the time the
+   block lasts at the sample rate, so 1.0 means the block only just met its
+   deadline. A block with load above 1 is counted as late; sinks that run dry
+   or make the render wait report it through reportUnderrun(), see
+   StreamingFilePlayer::setLoadMeter() and AsyncWavWriter::setLoadMeter().
+
+   The last historySize loads are kept in a ring of atomics, so getStats()
+   may be called from any thread while rendering continues. It sorts a copy
+   of the ring for the 99th percentile, so it belongs on a control or
+   reporting thread, never the audio thread. startReporting() runs such a
+   thread that prints the statistics to stderr as text or JSON lines.
+ */
+//==============================================================================
+class LoadMeter
+{
+public:
+    /** rolling and cumulative figures */
+    struct Stats
+    {
+        /// blocks in the rolling window
+        size_t windowBlocks = 0;
+        /// rolling loads, render time over block duration
+        double minLoad = 0.0, avgLoad = 0.0, maxLoad = 0.0, p99Load = 0.0;
+        /// all blocks measured since prepare() or reset()
+        uint64_t totalBlocks = 0;
+        /// blocks that took longer than their duration
+        uint64_t lateBlocks = 0;
+        /// underruns and stalls reported by sinks
+        uint64_t underruns = 0;
+    };
+
+    /** times one block for as long as it is in scope */
+    class ScopedBlock
+    {
+    public:
+        ScopedBlock(LoadMeter &meter, int frames) : meter(meter), numFrames(frames) {meter.beginBlock();}
+        ~ScopedBlock() {meter.endBlock(numFrames);}
+    private:
+        LoadMeter &meter;
+        int numFrames;
+    };
+
+public:
+    LoadMeter();
+    /** Destructor: stops the reporting thread */
+    ~LoadMeter();
+
+    LoadMeter(const LoadMeter&) = delete;
+    LoadMeter& operator=(const LoadMeter&) = delete;
+    //==============================================================================
+    /** allocates the history and clears all counters
+       @param sampleRate rate blocks are rendered at
+       @param historySize blocks in the rolling window
+     */
+    void prepare(double sampleRate, size_t historySize = 1024);
+
+    /** clears the history and counters */
+    void reset();
+    //==============================================================================
+    /** marks the start of a block on the render thread */
+    void beginBlock();
+    /** marks the end of a block on the render thread
+       @param numFrames frames the block rendered
+     */
+    void endBlock(int numFrames);
+    /** counts an underrun, may be called from any thread */
+    void reportUnderrun() {underruns.fetch_add(1, std::memory_order_relaxed);}
+    //==============================================================================
+    /** @returns statistics of the rolling window and the counters */
+    Stats getStats() const;
+
+    /** prints getStats()
+       @param file stream to print to
+       @param json one JSON object per line instead of text
+     */
+    void dump(FILE *file, bool json = false) const;
+
+    /** starts a thread printing to stderr every intervalSeconds
+       @param intervalSeconds time between prints
+       @param json print JSON lines instead of text
+     */
+    void startReporting(double intervalSeconds, bool json = false);
+    /** stops the reporting thread */
+    void stopReporting();
+
+private:
+    /** reporting thread loop */
+    void report(double intervalSeconds, bool json);
+
+private:
+    /// rate blocks are rendered at
+    double sampleRate = 48000.0;
+    /// start of the block being rendered
+    std::chrono::steady_clock::time_point blockStart;
+    /// ring of the latest loads
+    std::unique_ptr<std::atomic<float>[]> history;
+    /// entries in history
+    size_t historySize = 0;
+    /// blocks measured, also the next ring position
+    std::atomic<uint64_t> totalBlocks {0};
+    /// blocks over their deadline
+    std::atomic<uint64_t> lateBlocks {0};
+    /// reported underruns
+    std::atomic<uint64_t> underruns {0};
+    /// reporting thread
+    std::thread reporter;
+    /// wakes the reporting thread early to stop it
+    std::mutex reportLock;
+    std::condition_variable reportWake;
+    bool reporting = false;
+};
+#endif /* LoadMeter_hpp */
@@ -0,0 +1,226 @@
+//
+//  MemoryAccounting.cpp
+//  KarplusStrongTest
+//
+#include "MemoryAccounting.hpp"
+#include <atomic>
+#include <cstdlib>
+//==============================================================================
+namespace
+{
+    /** counters of one category, or of the total */
+    struct Counter
+    {
+        std::atomic<size_t> current {0};
+        std::atomic<size_t> peak {0};
+        std::atomic<size_t> budget {0};
+        /// the over budget warning has been printed
+        std::atomic<bool> warned {false};
+    };
+
+    const int totalIndex = MemoryAccounting::numCategories;
+    Counter counters[MemoryAccounting::numCategories + 1];
+
+    std::atomic<uint64_t> overBudgetCount {0};
+    std::atomic<bool> enforceBudgets {false};
+    std::atomic<bool> dumpOnExit {false};
+    std::atomic<bool> dumpAsJson {false};
+    std::atomic<bool> exitHandlerInstalled {false};
+
+    const char *const categoryNames[MemoryAccounting::numCategories] =
+    {
+        "wavetables", "delayLines", "workBuffers", "caches", "ioBuffers", "queues", "other"
+    };
+
+    void raisePeak(Counter &counter, size_t value)
+    {
+        size_t peak = counter.peak.load(std::memory_order_relaxed);
+        while (value > peak && !counter.peak.compare_exchange_weak(peak, value, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    /** @returns true if value is over the counter's budget */
+    bool overBudget(const Counter &counter, size_t value)
+    {
+        const size_t budget = counter.budget.load(std::memory_order_relaxed);
+        return budget != 0 && value > budget;
+    }
+
+    void warnOnce(Counter &counter, const char *name, size_t value)
+    {
+        if (!counter.warned.exchange(true))
+        {
+            fprintf(stderr, "MemoryAccounting: %s holds %zu bytes, over its budget of %zu\n",
+                    name, value, counter.budget.load());
+        }
+    }
+
+    void dumpAtExit()
+    {
+        if (dumpOnExit.load())
+        {
+            MemoryAccounting::dump(stderr, dumpAsJson.load());
+        }
+    }
+}
+//==============================================================================
+void MemoryAccounting::Tracker::setBytes(size_t newBytes)
+{
+    if (newBytes > bytes)
+    {
+        record(category, newBytes - bytes);
+    }
+    else if (newBytes < bytes)
+    {
+        release(category, bytes - newBytes);
+    }
+    bytes = newBytes;
+}
+//==============================================================================
+bool MemoryAccounting::add(Category category, size_t bytes, bool mayRefuse)
+{
+    Counter &counter = counters[(int)category];
+    Counter &total = counters[totalIndex];
+    const size_t current = counter.current.fetch_add(bytes) + bytes;
+    const size_t totalCurrent = total.current.fetch_add(bytes) + bytes;
+
+    const bool categoryOver = overBudget(counter, current);
+    const bool totalOver = overBudget(total, totalCurrent);
+    if (categoryOver || totalOver)
+    {
+        ++overBudgetCount;
+        if (mayRefuse && enforceBudgets.load())
+        {
+            counter.current.fetch_sub(bytes);
+            total.current.fetch_sub(bytes);
+            return false;
+        }
+        if (categoryOver)
+        {
+            warnOnce(counter, categoryNames[(int)category], current);
+        }
+        if (totalOver)
+        {
+            warnOnce(total, "total", totalCurrent);
+        }
+    }
+
+    raisePeak(counter, current);
+    raisePeak(total, totalCurrent);
+    return true;
+}
+
+bool MemoryAccounting::reserve(Category category, size_t bytes)
+{
+    return add(category, bytes, true);
+}
+
+void MemoryAccounting::record(Category category, size_t bytes)
+{
+    add(category, bytes, false);
+}
+
+void MemoryAccounting::release(Category category, size_t bytes)
+{
+    counters[(int)category].current.fetch_sub(bytes);
+    counters[totalIndex].current.fetch_sub(bytes);
+}
+//==============================================================================
+MemoryAccounting::Usage MemoryAccounting::getUsage(Category category)
+{
+    const Counter &counter = counters[(int)category];
+    Usage usage;
+    usage.current = counter.current.load();
+    usage.peak = counter.peak.load();
+    usage.budget = counter.budget.load();
+    return usage;
+}
+
+MemoryAccounting::Usage MemoryAccounting::getTotalUsage()
+{
+    const Counter &counter = counters[totalIndex];
+    Usage usage;
+    usage.current = counter.current.load();
+    usage.peak = counter.peak.load();
+    usage.budget = counter.budget.load();
+    return usage;
+}
+
+const char* MemoryAccounting::getCategoryName(Category category)
+{
+    return categoryNames[(int)category];
+}
+
+uint64_t MemoryAccounting::getOverBudgetCount()
+{
+    return overBudgetCount.load();
+}
+//==============================================================================
+void MemoryAccounting::setBudget(Category category, size_t bytes)
+{
+    counters[(int)category].budget.store(bytes);
+    counters[(int)category].warned.store(false);
+}
+
+void MemoryAccounting::setTotalBudget(size_t bytes)
+{
+    counters[totalIndex].budget.store(bytes);
+    counters[totalIndex].warned.store(false);
+}
+
+void MemoryAccounting::setEnforceBudgets(bool shouldEnforce)
+{
+    enforceBudgets.store(shouldEnforce);
+}
+//==============================================================================
+void MemoryAccounting::dump(FILE *file, bool json)
+{
+    const Usage total = getTotalUsage();
+    if (json)
+    {
+        fprintf(file, "{\"overBudget\":%llu,\"total\":{\"current\":%zu,\"peak\":%zu,\"budget\":%zu}",
+                (unsigned long long)getOverBudgetCount(), total.current, total.peak, total.budget);
+        for (int i = 0; i < numCategories; ++i)
+        {
+            const Usage usage = getUsage((Category)i);
+            fprintf(file, ",\"%s\":{\"current\":%zu,\"peak\":%zu,\"budget\":%zu}",
+                    categoryNames[i], usage.current, usage.peak, usage.budget);
+        }
+        fprintf(file, "}\n");
+    }
+    else
+    {
+        fprintf(file, "%-12s %12s %12s %12s\n", "memory", "current KB", "peak KB", "budget KB");
+        for (int i = 0; i <= numCategories; ++i)
+        {
+            const Usage usage = (i < numCategories) ? getUsage((Category)i) : total;
+            fprintf(file, "%-12s %12.1f %12.1f ", (i < numCategories) ? categoryNames[i] : "total",
+                    usage.current / 1024.0, usage.peak / 1024.0);
+            if (usage.budget)
+            {
+                fprintf(file, "%12.1f\n", usage.budget / 1024.0);
+            }
+            else
+            {
+                fprintf(file, "%12s\n", "-");
+            }
+        }
+        if (getOverBudgetCount())
+        {
+            fprintf(file, "over budget %llu times\n", (unsigned long long)getOverBudgetCount());
+        }
+    }
+    fflush(file);
+}
+
+void MemoryAccounting::setDumpOnExit(bool shouldDump, bool json)
+{
+    dumpAsJson.store(json);
+    dumpOnExit.store(shouldDump);
+    if (shouldDump && !exitHandlerInstalled.exchange(true))
+    {
+        atexit(dumpAtExit);
+    }
+}
+//EOF
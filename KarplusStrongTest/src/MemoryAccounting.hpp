@@ -0,0 +1,128 @@
+/*
+ *  MemoryAccounting: bytes held per category, with optional budgets
+ */
+//==============================================================================
+#ifndef MemoryAccounting_hpp
+#define MemoryAccounting_hpp
+//==============================================================================
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+//==============================================================================
+/*!
+   @class MemoryAccounting
+   @brief process wide count of the bytes held by the synth's long lived
+   buffers, split by what they are for.
+
+   @discussion AudioBuffer reports its allocation under the category set with
+   AudioBuffer::setCategory(). Owners of other storage, such as vectors and
+   queues, hold a Tracker and set it to their size after allocating. Usage
+   and peaks can be read at any time, printed with dump(), and dumped
+   automatically on exit with setDumpOnExit().
+
+   Budgets cap a category or the total. Going over one is reported once per
+   category on stderr and counted. With setEnforceBudgets() reserve() refuses
+   instead, so an AudioBuffer that would break a budget throws
+   std::bad_alloc just as when the allocation itself fails. Tracker storage
+   is allocated before it is reported, so it is only ever counted.
+
+   Counters are atomics; concurrent reservations can overshoot a budget by
+   the size of the reservations racing.
+ */
+//==============================================================================
+class MemoryAccounting
+{
+public:
+    /** what the bytes are held for */
+    enum class Category
+    {
+        wavetables,     ///< generated notes and their excitation
+        delayLines,     ///< delay line engine history
+        workBuffers,    ///< per block scratch: voice rows, mix stack, convolution, resampler history
+        caches,         ///< shared lookups: convolution IRs, resampler filter banks, WAV chunk indexes
+        ioBuffers,      ///< decoded files, file and sink buffers
+        queues,         ///< lock-free queue storage
+        other           ///< untagged AudioBuffers
+    };
+    /// number of categories
+    static constexpr int numCategories = 7;
+
+    /** bytes of one category or the total */
+    struct Usage
+    {
+        /// held now
+        size_t current = 0;
+        /// most held at once
+        size_t peak = 0;
+        /// cap, 0 for none
+        size_t budget = 0;
+    };
+
+    /** reports the size of storage not allocated through AudioBuffer,
+       releasing it on destruction
+     */
+    class Tracker
+    {
+    public:
+        explicit Tracker(Category trackedCategory) : category(trackedCategory) {}
+        ~Tracker() {setBytes(0);}
+
+        Tracker(const Tracker&) = delete;
+        Tracker& operator=(const Tracker&) = delete;
+
+        /** @param newBytes bytes the owner now holds */
+        void setBytes(size_t newBytes);
+        /** @returns bytes reported */
+        size_t getBytes() const {return bytes;}
+    private:
+        Category category;
+        size_t bytes = 0;
+    };
+    //==============================================================================
+    /** counts an allocation about to be made
+       @returns false if it would break a budget while budgets are enforced,
+       in which case nothing is counted
+     */
+    static bool reserve(Category category, size_t bytes);
+    /** counts storage already allocated, never refused */
+    static void record(Category category, size_t bytes);
+    /** uncounts a freed allocation */
+    static void release(Category category, size_t bytes);
+    //==============================================================================
+    /** @returns usage of one category */
+    static Usage getUsage(Category category);
+    /** @returns usage over every category */
+    static Usage getTotalUsage();
+    /** @returns printable name of a category */
+    static const char* getCategoryName(Category category);
+    /** @returns times a budget was exceeded or a reservation refused */
+    static uint64_t getOverBudgetCount();
+    //==============================================================================
+    /** caps a category
+       @param bytes budget, 0 for none
+     */
+    static void setBudget(Category category, size_t bytes);
+    /** caps the total
+       @param bytes budget, 0 for none
+     */
+    static void setTotalBudget(size_t bytes);
+    /** refuse reservations over budget instead of only reporting them */
+    static void setEnforceBudgets(bool shouldEnforce);
+    //==============================================================================
+    /** prints every category
+       @param file destination, e.g. stdout
+       @param json one JSON object instead of a table
+     */
+    static void dump(FILE *file, bool json = false);
+    /** prints a dump to stderr when the program exits
+       @param json dump as JSON
+     */
+    static void setDumpOnExit(bool shouldDump, bool json = false);
+
+private:
+    /** adds bytes, checking budgets
+       @param mayRefuse refuse when over an enforced budget
+     */
+    static bool add(Category category, size_t bytes, bool mayRefuse);
+};
+#endif /* MemoryAccounting_hpp */
@@ -0,0 +1,158 @@
+//
+//  MixBus.cpp
+//  KarplusStrongTest
+//
+#define _USE_MATH_DEFINES
+#include "MixBus.hpp"
+#include "RealtimeSetup.hpp"
+#include "SimdKernels.hpp"
+#include "Trace.hpp"
+#include <cmath>
+#include <cstring>
+//==============================================================================
+MixBus::MixBus()
+{
+}
+
+MixBus::~MixBus()
+{
+}
+//==============================================================================
+void MixBus::prepare(int maxVoices, int maxBlockFrames)
+{
+    levels.assign(maxVoices, Levels());
+
+    // a binary counter of pairs never holds more than log2(pairs) + 1 entries
+    int depth = 1;
+    while ((1 << (depth - 1)) < (maxVoices + 1) / 2)
+    {
+        ++depth;
+    }
+    stack.setCategory(MemoryAccounting::Category::workBuffers);
+    stack.setSize(2 * (depth + 1), maxBlockFrames);
+    stackLevel.assign(depth + 1, 0);
+}
+//==============================================================================
+void MixBus::setVoice(int voice, float gain, float pan)
+{
+    levels[voice].gain = gain;
+    levels[voice].pan = pan;
+    updateLevels(voice);
+}
+
+void MixBus::setVoiceGain(int voice, float gain)
+{
+    levels[voice].gain = gain;
+    updateLevels(voice);
+}
+
+void MixBus::setVoicePan(int voice, float pan)
+{
+    levels[voice].pan = pan;
+    updateLevels(voice);
+}
+
+void MixBus::updateLevels(int voice)
+{
+    Levels &level = levels[voice];
+    const float pan = std::fmax(-1.0f, std::fmin(1.0f, level.pan));
+    const float angle = (pan + 1.0f) * (float)M_PI_4;
+    level.left = level.gain * std::cos(angle);
+    level.right = level.gain * std::sin(angle);
+}
+//==============================================================================
+void MixBus::setBodyResonance(std::shared_ptr<const ConvolutionIR> ir)
+{
+    hasBody = ir && bodyLeft.prepare(ir, 0) && bodyRight.prepare(ir, ir->getNumChannels() > 1 ? 1 : 0);
+}
+
+size_t MixBus::getAllocatedBytes() const
+{
+    return levels.capacity() * sizeof(Levels) + stack.getAllocatedBytes() + stackLevel.capacity() * sizeof(int) +
+           bodyLeft.getAllocatedBytes() + bodyRight.getAllocatedBytes();
+}
+
+bool MixBus::lockMemory(bool hugePages) const
+{
+    bool locked = RealtimeSetup::lockMemory(levels.data(), levels.size() * sizeof(Levels));
+    locked &= stack.lockMemory(hugePages);
+    locked &= RealtimeSetup::lockMemory(stackLevel.data(), stackLevel.size() * sizeof(int));
+    locked &= bodyLeft.lockMemory(hugePages);
+    locked &= bodyRight.lockMemory(hugePages);
+    return locked;
+}
+//==============================================================================
+void MixBus::process(const float *const *voices, int numVoices, float *left, float *right, int numFrames)
+{
+    KS_TRACE_SCOPE("mix");
+    int depth = 0;
+    int pending = -1;
+
+    for (int voice = 0; voice <= numVoices; ++voice)
+    {
+        const bool flush = (voice == numVoices);
+        if (!flush && !voices[voice])
+        {
+            continue;
+        }
+        if (!flush && pending < 0)
+        {
+            pending = voice;
+            continue;
+        }
+        if (pending < 0)
+        {
+            break;
+        }
+
+        // pan a pair of voices (or the last odd one) into a new stack entry
+        const Levels &a = levels[pending];
+        const float *b = flush ? nullptr : voices[voice];
+        const float bLeft = flush ? 0.0f : levels[voice].left;
+        const float bRight = flush ? 0.0f : levels[voice].right;
+        SimdKernels::panPair(voices[pending], a.left, a.right, b, bLeft, bRight,
+                             stack.getChannel(2 * depth), stack.getChannel(2 * depth + 1), numFrames);
+        stackLevel[depth] = 0;
+        ++depth;
+        pending = -1;
+
+        // merge equal sized partial sums, like carrying in a binary counter
+        while (depth >= 2 && stackLevel[depth - 1] == stackLevel[depth - 2])
+        {
+            SimdKernels::add(stack.getChannel(2 * (depth - 1)), stack.getChannel(2 * (depth - 2)), numFrames);
+            SimdKernels::add(stack.getChannel(2 * (depth - 1) + 1), stack.getChannel(2 * (depth - 2) + 1), numFrames);
+            ++stackLevel[depth - 2];
+            --depth;
+        }
+    }
+
+    if (depth == 0)
+    {
+        memset(left, 0, numFrames * sizeof(float));
+        memset(right, 0, numFrames * sizeof(float));
+    }
+    else
+    {
+        // fold what is left, smallest sums first
+        for (int entry = depth - 1; entry > 0; --entry)
+        {
+            SimdKernels::add(stack.getChannel(2 * entry), stack.getChannel(2 * (entry - 1)), numFrames);
+            SimdKernels::add(stack.getChannel(2 * entry + 1), stack.getChannel(2 * (entry - 1) + 1), numFrames);
+        }
+        memcpy(left, stack.getChannel(0), numFrames * sizeof(float));
+        memcpy(right, stack.getChannel(1), numFrames * sizeof(float));
+    }
+
+    if (masterGain != 1.0f)
+    {
+        SimdKernels::scale(left, numFrames, masterGain);
+        SimdKernels::scale(right, numFrames, masterGain);
+    }
+
+    if (hasBody)
+    {
+        bodyLeft.process(left, left, numFrames);
+        bodyRight.process(right, right, numFrames);
+    }
+}
+//EOF
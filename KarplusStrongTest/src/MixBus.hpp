@@ -0,0 +1,116 @@
+/*
+ *  MixBus: sums mono voices into a stereo pair
+ */
+//==============================================================================
+#ifndef MixBus_hpp
+#define MixBus_hpp
+//==============================================================================
+#include <memory>
+#include <vector>
+#include "AudioBuffer.hpp"
+#include "Convolver.hpp"
+//==============================================================================
+/*!
+   @class MixBus
+   @brief mixes many mono voices to stereo with gain, constant-power pan and
+   an optional shared body resonance.
+
+   @discussion Voices are panned two at a time by SimdKernels::panPair()
+   and the pairs are summed pairwise, as a binary tree, through a stack of
+   partial sums. Rounding error then grows with log2 of the voice count
+   rather than linearly, and the scratch needed is log2(maxVoices) stereo
+   blocks.
+
+   Pan uses the sine/cosine law so a voice keeps the same power anywhere in
+   the field. Gains are turned into left/right levels when they are set, not
+   per block.
+
+   A body impulse response set with setBodyResonance() is convolved with the
+   stereo sum, once for all voices, which is equivalent to convolving every
+   voice because convolution is linear. The response should include the
+   direct sound, the output is fully wet.
+
+   prepare() and setBodyResonance() allocate, process() does not.
+ */
+//==============================================================================
+class MixBus
+{
+public:
+    MixBus();
+    ~MixBus();
+    //==============================================================================
+    /** allocates the voice settings and the summing stack
+       @param maxVoices most voices passed to process()
+       @param maxBlockFrames most frames passed to process()
+     */
+    void prepare(int maxVoices, int maxBlockFrames);
+
+    /** mixes one block
+       @param voices numVoices mono signals, nullptr entries are skipped
+       @param numVoices number of entries in voices, at most maxVoices
+       @param left output of numFrames samples
+       @param right output of numFrames samples
+       @param numFrames frames to mix, at most maxBlockFrames
+     */
+    void process(const float *const *voices, int numVoices, float *left, float *right, int numFrames);
+    //==============================================================================
+    /** @param voice voice index
+       @param gain linear gain
+       @param pan -1 for left, 0 for centre, 1 for right */
+    void setVoice(int voice, float gain, float pan);
+    /** @param voice voice index
+       @param gain linear gain */
+    void setVoiceGain(int voice, float gain);
+    /** @param voice voice index
+       @param pan -1 for left, 0 for centre, 1 for right */
+    void setVoicePan(int voice, float pan);
+    /** @param gain linear gain applied to the sum */
+    void setMasterGain(float gain) {masterGain = gain;}
+    /** @returns linear gain applied to the sum */
+    float getMasterGain() const {return masterGain;}
+
+    /** convolves the sum with a body response, channel 0 for the left and
+       channel 1 (or 0 for a mono response) for the right
+       @param ir partitioned response, nullptr removes the body
+     */
+    void setBodyResonance(std::shared_ptr<const ConvolutionIR> ir);
+    //==============================================================================
+    /** @returns voices the bus was prepared for */
+    int getMaxVoices() const {return (int)levels.size();}
+    /** @returns delay added by the body resonance in samples */
+    int getLatency() const {return hasBody ? bodyLeft.getLatency() : 0;}
+    /** @returns bytes of the voice settings, summing stack and body convolvers */
+    size_t getAllocatedBytes() const;
+    /** keeps the voice settings, summing stack and body convolvers resident
+       @returns true if all were locked
+     */
+    bool lockMemory(bool hugePages = false) const;
+
+private:
+    /** recomputes the channel levels of a voice */
+    void updateLevels(int voice);
+
+    /** a voice's gain and pan turned into channel levels */
+    struct Levels
+    {
+        float gain = 1.0f;
+        float pan = 0.0f;
+        float left = 0.7071068f;
+        float right = 0.7071068f;
+    };
+
+private:
+    /// settings of each voice
+    std::vector<Levels> levels;
+    /// partial sums, left and right channel for each stack entry
+    AudioBuffer stack;
+    /// tree level of each stack entry
+    std::vector<int> stackLevel;
+    /// gain applied to the sum
+    float masterGain = 1.0f;
+    /// body resonance convolvers
+    Convolver bodyLeft, bodyRight;
+    /// true when a body response is set
+    bool hasBody = false;
+};
+#endif /* MixBus_hpp */
@@ -0,0 +1,178 @@
+//
+//  RealtimeGuard.cpp
+//  KarplusStrongTest
+//
+#include "RealtimeGuard.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#if defined _WIN32 || defined _WIN64
+#define NOMINMAX
+#include <windows.h>
+#include <malloc.h>
+#elif defined __APPLE__ || defined __GLIBC__
+#include <execinfo.h>
+#include <unistd.h>
+#endif
+#if defined KS_REALTIME_GUARD && defined KS_REALTIME_GUARD_LOCKS && defined __linux__
+#include <dlfcn.h>
+#include <pthread.h>
+#endif
+//==============================================================================
+std::atomic<uint64_t> RealtimeGuard::violationCount {0};
+std::atomic<bool> RealtimeGuard::abortOnViolation {false};
+#ifdef KS_REALTIME_GUARD
+thread_local int RealtimeGuard::realtimeDepth = 0;
+thread_local int RealtimeGuard::allowDepth = 0;
+//==============================================================================
+namespace
+{
+    /** prints the caller's stack to stderr without allocating where the platform allows */
+    void printStackTrace()
+    {
+        const int maxFrames = 32;
+        void *frames[maxFrames];
+#if defined _WIN32 || defined _WIN64
+        const int numFrames = (int)CaptureStackBackTrace(2, maxFrames, frames, nullptr);
+        for (int i = 0; i < numFrames; ++i)
+        {
+            fprintf(stderr, "    #%d %p\n", i, frames[i]);
+        }
+#elif defined __APPLE__ || defined __GLIBC__
+        const int numFrames = backtrace(frames, maxFrames);
+        backtrace_symbols_fd(frames, numFrames, STDERR_FILENO);
+#else
+        (void)frames;
+        fprintf(stderr, "    (no stack trace on this platform)\n");
+#endif
+    }
+}
+#endif
+//==============================================================================
+void RealtimeGuard::reportViolation(const char *what, size_t bytes)
+{
+#ifdef KS_REALTIME_GUARD
+    // the report itself may allocate, which must not be reported again
+    ++allowDepth;
+    const uint64_t count = ++violationCount;
+    if (bytes)
+    {
+        fprintf(stderr, "realtime violation %llu: %s of %zu bytes on a real time thread\n",
+                (unsigned long long)count, what, bytes);
+    }
+    else
+    {
+        fprintf(stderr, "realtime violation %llu: %s on a real time thread\n", (unsigned long long)count, what);
+    }
+    printStackTrace();
+    fflush(stderr);
+    --allowDepth;
+
+    if (abortOnViolation.load())
+    {
+        abort();
+    }
+#else
+    (void)what;
+    (void)bytes;
+#endif
+}
+//==============================================================================
+#ifdef KS_REALTIME_GUARD
+// Replacements for the global allocation functions. Every form is replaced so
+// none falls back to a library version that would skip the check.
+namespace
+{
+    void* allocate(size_t size, const char *what)
+    {
+        RealtimeGuard::check(what, size);
+        return malloc(size ? size : 1);
+    }
+
+    void* allocateAligned(size_t size, std::align_val_t alignment, const char *what)
+    {
+        RealtimeGuard::check(what, size);
+        size = size ? size : 1;
+#if defined _WIN32 || defined _WIN64
+        return _aligned_malloc(size, (size_t)alignment);
+#else
+        void *p = nullptr;
+        const size_t align = std::max((size_t)alignment, sizeof(void*));
+        return (posix_memalign(&p, align, size) == 0) ? p : nullptr;
+#endif
+    }
+
+    void release(void *p)
+    {
+        if (p)
+        {
+            RealtimeGuard::check("operator delete", 0);
+            free(p);
+        }
+    }
+
+    void releaseAligned(void *p)
+    {
+        if (p)
+        {
+            RealtimeGuard::check("operator delete", 0);
+#if defined _WIN32 || defined _WIN64
+            _aligned_free(p);
+#else
+            free(p);
+#endif
+        }
+    }
+
+    void* orThrow(void *p)
+    {
+        if (!p)
+        {
+            throw std::bad_alloc();
+        }
+        return p;
+    }
+}
+
+void* operator new(size_t size) {return orThrow(allocate(size, "operator new"));}
+void* operator new[](size_t size) {return orThrow(allocate(size, "operator new[]"));}
+void* operator new(size_t size, const std::nothrow_t&) noexcept {return allocate(size, "operator new");}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {return allocate(size, "operator new[]");}
+void* operator new(size_t size, std::align_val_t alignment) {return orThrow(allocateAligned(size, alignment, "operator new"));}
+void* operator new[](size_t size, std::align_val_t alignment) {return orThrow(allocateAligned(size, alignment, "operator new[]"));}
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {return allocateAligned(size, alignment, "operator new");}
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {return allocateAligned(size, alignment, "operator new[]");}
+
+void operator delete(void *p) noexcept {release(p);}
+void operator delete[](void *p) noexcept {release(p);}
+void operator delete(void *p, size_t) noexcept {release(p);}
+void operator delete[](void *p, size_t) noexcept {release(p);}
+void operator delete(void *p, const std::nothrow_t&) noexcept {release(p);}
+void operator delete[](void *p, const std::nothrow_t&) noexcept {release(p);}
+void operator delete(void *p, std::align_val_t) noexcept {releaseAligned(p);}
+void operator delete[](void *p, std::align_val_t) noexcept {releaseAligned(p);}
+void operator delete(void *p, size_t, std::align_val_t) noexcept {releaseAligned(p);}
+void operator delete[](void *p, size_t, std::align_val_t) noexcept {releaseAligned(p);}
+void operator delete(void *p, std::align_val_t, const std::nothrow_t&) noexcept {releaseAligned(p);}
+void operator delete[](void *p, std::align_val_t, const std::nothrow_t&) noexcept {releaseAligned(p);}
+//==============================================================================
+#if defined KS_REALTIME_GUARD_LOCKS && defined __linux__
+// Interposes the C library's lock so std::mutex and friends are checked too.
+extern "C" int pthread_mutex_lock(pthread_mutex_t *mutex) noexcept
+{
+    typedef int (*LockFunction)(pthread_mutex_t*);
+    static std::atomic<LockFunction> realLock {nullptr};
+
+    LockFunction lock = realLock.load(std::memory_order_acquire);
+    if (!lock)
+    {
+        lock = (LockFunction)dlsym(RTLD_NEXT, "pthread_mutex_lock");
+        realLock.store(lock, std::memory_order_release);
+    }
+    RealtimeGuard::check("mutex lock", 0);
+    return lock(mutex);
+}
+#endif
+#endif
+//EOF
@@ -0,0 +1,98 @@
+/*
+ *  RealtimeGuard: catches allocations and locks on real time threads
+ */
+//==============================================================================
+#ifndef RealtimeGuard_hpp
+#define RealtimeGuard_hpp
+//==============================================================================
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+//==============================================================================
+/*!
+   @class RealtimeGuard
+   @brief debug instrumentation that flags heap use and mutex locks on
+   threads that must never block.
+
+   @discussion Build with KS_REALTIME_GUARD defined and the global operator
+   new and delete are replaced with versions that check whether the calling
+   thread is inside a ScopedRealtime. Allocators that bypass operator new,
+   such as AudioBuffer's aligned allocation, call check() themselves. With
+   KS_REALTIME_GUARD_LOCKS defined as well, pthread_mutex_lock is interposed
+   on Linux so locks are caught too; note that ThreadPool::parallelFor()
+   locks unless the pool is spin waiting, which is reported when the engine
+   renders on a sleeping pool.
+
+   A violation prints what happened and a stack trace to stderr and is
+   counted. With setAbortOnViolation() it aborts instead, so a CI run fails
+   at the first real time safety regression.
+
+   Without KS_REALTIME_GUARD the scopes are empty and check() does nothing,
+   so the markers can stay in release code.
+ */
+//==============================================================================
+class RealtimeGuard
+{
+public:
+#ifdef KS_REALTIME_GUARD
+    /** marks the calling thread real time while in scope, scopes nest */
+    class ScopedRealtime
+    {
+    public:
+        ScopedRealtime() {++realtimeDepth;}
+        ~ScopedRealtime() {--realtimeDepth;}
+    };
+
+    /** allows allocation and locks on a real time thread while in scope, for
+       known safe cases such as start up code run from the audio callback
+     */
+    class ScopedAllow
+    {
+    public:
+        ScopedAllow() {++allowDepth;}
+        ~ScopedAllow() {--allowDepth;}
+    };
+
+    /** reports a violation if the calling thread is real time
+       @param what description of the operation, e.g. "operator new"
+       @param bytes size involved, 0 if none
+     */
+    static void check(const char *what, size_t bytes)
+    {
+        if (realtimeDepth > 0 && allowDepth == 0)
+        {
+            reportViolation(what, bytes);
+        }
+    }
+
+    /** @returns true inside a ScopedRealtime and outside a ScopedAllow */
+    static bool isRealtimeThread() {return realtimeDepth > 0 && allowDepth == 0;}
+#else
+    class ScopedRealtime {public: ScopedRealtime() {}};
+    class ScopedAllow {public: ScopedAllow() {}};
+    static void check(const char*, size_t) {}
+    static bool isRealtimeThread() {return false;}
+#endif
+    //==============================================================================
+    /** abort on the first violation instead of counting it */
+    static void setAbortOnViolation(bool shouldAbort) {abortOnViolation.store(shouldAbort);}
+    /** @returns violations reported so far */
+    static uint64_t getViolationCount() {return violationCount.load();}
+
+private:
+    /** prints the violation and a stack trace, then counts it or aborts */
+    static void reportViolation(const char *what, size_t bytes);
+
+private:
+#ifdef KS_REALTIME_GUARD
+    /// ScopedRealtime nesting of this thread
+    static thread_local int realtimeDepth;
+    /// ScopedAllow nesting of this thread, also set while reporting
+    static thread_local int allowDepth;
+#endif
+    /// violations so far
+    static std::atomic<uint64_t> violationCount;
+    /// abort on violation
+    static std::atomic<bool> abortOnViolation;
+};
+#endif /* RealtimeGuard_hpp */
@@ -0,0 +1,283 @@
+//
+//  RealtimeSetup.cpp
+//  KarplusStrongTest
+//
+#include "RealtimeSetup.hpp"
+#include "ThreadPool.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#if defined _WIN32 || defined _WIN64
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <cerrno>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+//==============================================================================
+namespace
+{
+    typedef std::thread::native_handle_type NativeHandle;
+
+    /// cores an affinity mask can name, parseCores() rejects any beyond
+#if defined _WIN32 || defined _WIN64
+    const long maxCores = (long)(8 * sizeof(DWORD_PTR));
+#elif defined __linux__
+    const long maxCores = CPU_SETSIZE;
+#else
+    const long maxCores = 1024;
+#endif
+
+    NativeHandle currentThread()
+    {
+#if defined _WIN32 || defined _WIN64
+        return GetCurrentThread();
+#else
+        return pthread_self();
+#endif
+    }
+
+    bool setPriority(NativeHandle thread, RealtimeSetup::Policy policy, int priority)
+    {
+#if defined _WIN32 || defined _WIN64
+        int level = THREAD_PRIORITY_NORMAL;
+        if (policy != RealtimeSetup::Policy::normal)
+        {
+            level = (priority >= 80) ? THREAD_PRIORITY_TIME_CRITICAL : THREAD_PRIORITY_HIGHEST;
+        }
+        if (!SetThreadPriority(thread, level))
+        {
+            fprintf(stderr, "RealtimeSetup: could not set thread priority, error %lu\n", GetLastError());
+            return false;
+        }
+        return true;
+#else
+        int schedPolicy = SCHED_OTHER;
+        if (policy == RealtimeSetup::Policy::fifo)
+        {
+            schedPolicy = SCHED_FIFO;
+        }
+        else if (policy == RealtimeSetup::Policy::roundRobin)
+        {
+            schedPolicy = SCHED_RR;
+        }
+
+        sched_param param;
+        memset(&param, 0, sizeof(param));
+        if (schedPolicy != SCHED_OTHER)
+        {
+            const int lowest = sched_get_priority_min(schedPolicy);
+            const int highest = sched_get_priority_max(schedPolicy);
+            param.sched_priority = (priority < lowest) ? lowest : (priority > highest) ? highest : priority;
+        }
+
+        const int error = pthread_setschedparam(thread, schedPolicy, &param);
+        if (error != 0)
+        {
+            fprintf(stderr, "RealtimeSetup: could not set real time priority %d: %s%s\n", param.sched_priority,
+                    strerror(error), (error == EPERM) ? " (needs CAP_SYS_NICE or an rtprio limit)" : "");
+            return false;
+        }
+        return true;
+#endif
+    }
+
+    bool setAffinity(NativeHandle thread, const std::vector<int> &cores)
+    {
+        if (cores.empty())
+        {
+            return true;
+        }
+#if defined _WIN32 || defined _WIN64
+        DWORD_PTR mask = 0;
+        for (int core : cores)
+        {
+            if (core >= 0 && core < (int)(8 * sizeof(DWORD_PTR)))
+            {
+                mask |= (DWORD_PTR)1 << core;
+            }
+        }
+        if (!mask || !SetThreadAffinityMask(thread, mask))
+        {
+            fprintf(stderr, "RealtimeSetup: could not pin thread, error %lu\n", GetLastError());
+            return false;
+        }
+        return true;
+#elif defined __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int core : cores)
+        {
+            if (core >= 0 && core < CPU_SETSIZE)
+            {
+                CPU_SET(core, &set);
+            }
+        }
+        const int error = pthread_setaffinity_np(thread, sizeof(set), &set);
+        if (error != 0)
+        {
+            fprintf(stderr, "RealtimeSetup: could not pin thread: %s\n", strerror(error));
+            return false;
+        }
+        return true;
+#else
+        (void)thread;
+        fprintf(stderr, "RealtimeSetup: core pinning is not supported on this platform\n");
+        return false;
+#endif
+    }
+}
+//==============================================================================
+bool RealtimeSetup::apply(const Config &config, ThreadPool *pool)
+{
+    bool success = true;
+    if (config.policy != Policy::normal)
+    {
+        success &= setCurrentThreadPriority(config.policy, config.renderPriority);
+    }
+    success &= setCurrentThreadAffinity(config.renderCores);
+
+    if (pool)
+    {
+        std::vector<std::thread> &workers = pool->getWorkers();
+        for (size_t i = 0; i < workers.size(); ++i)
+        {
+            if (config.policy != Policy::normal)
+            {
+                success &= setThreadPriority(workers[i], config.policy, config.workerPriority);
+            }
+            if (!config.workerCores.empty())
+            {
+                const std::vector<int> core(1, config.workerCores[i % config.workerCores.size()]);
+                success &= setThreadAffinity(workers[i], core);
+            }
+        }
+    }
+
+    if (config.lockAllMemory)
+    {
+        success &= lockAllMemory();
+    }
+    return success;
+}
+//==============================================================================
+bool RealtimeSetup::setCurrentThreadPriority(Policy policy, int priority)
+{
+    return setPriority(currentThread(), policy, priority);
+}
+
+bool RealtimeSetup::setThreadPriority(std::thread &thread, Policy policy, int priority)
+{
+    return setPriority(thread.native_handle(), policy, priority);
+}
+
+bool RealtimeSetup::setCurrentThreadAffinity(const std::vector<int> &cores)
+{
+    return setAffinity(currentThread(), cores);
+}
+
+bool RealtimeSetup::setThreadAffinity(std::thread &thread, const std::vector<int> &cores)
+{
+    return setAffinity(thread.native_handle(), cores);
+}
+//==============================================================================
+bool RealtimeSetup::lockMemory(const void *address, size_t bytes, bool hugePages)
+{
+    if (!address || bytes == 0)
+    {
+        return true;
+    }
+#if defined _WIN32 || defined _WIN64
+    (void)hugePages;
+    if (!VirtualLock(const_cast<void*>(address), bytes))
+    {
+        fprintf(stderr, "RealtimeSetup: could not lock %zu bytes, error %lu (the working set may be too small)\n",
+                bytes, GetLastError());
+        return false;
+    }
+    return true;
+#else
+#if defined __linux__ && defined MADV_HUGEPAGE
+    if (hugePages)
+    {
+        // madvise needs page boundaries, only the interior of the range is advised
+        const uintptr_t pageSize = (uintptr_t)sysconf(_SC_PAGESIZE);
+        const uintptr_t begin = ((uintptr_t)address + pageSize - 1) & ~(pageSize - 1);
+        const uintptr_t end = ((uintptr_t)address + bytes) & ~(pageSize - 1);
+        if (end > begin)
+        {
+            madvise((void*)begin, end - begin, MADV_HUGEPAGE);
+        }
+    }
+#else
+    (void)hugePages;
+#endif
+    if (mlock(address, bytes) != 0)
+    {
+        fprintf(stderr, "RealtimeSetup: could not lock %zu bytes: %s%s\n", bytes, strerror(errno),
+                (errno == ENOMEM || errno == EPERM) ? " (raise the memlock limit)" : "");
+        return false;
+    }
+    return true;
+#endif
+}
+
+bool RealtimeSetup::lockAllMemory()
+{
+#if defined _WIN32 || defined _WIN64
+    fprintf(stderr, "RealtimeSetup: locking all memory is not supported on Windows, lock buffers instead\n");
+    return false;
+#else
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+    {
+        fprintf(stderr, "RealtimeSetup: could not lock all memory: %s%s\n", strerror(errno),
+                (errno == ENOMEM || errno == EPERM) ? " (raise the memlock limit)" : "");
+        return false;
+    }
+    return true;
+#endif
+}
+//==============================================================================
+bool RealtimeSetup::parseCores(const char *list, std::vector<int> &cores)
+{
+    cores.clear();
+    const char *p = list;
+    while (*p)
+    {
+        char *end;
+        const long first = strtol(p, &end, 10);
+        if (end == p || first < 0 || first >= maxCores)
+        {
+            return false;
+        }
+        long last = first;
+        p = end;
+        if (*p == '-')
+        {
+            last = strtol(p + 1, &end, 10);
+            if (end == p + 1 || last < first || last >= maxCores)
+            {
+                return false;
+            }
+            p = end;
+        }
+        for (long core = first; core <= last; ++core)
+        {
+            cores.push_back((int)core);
+        }
+        if (*p == ',')
+        {
+            ++p;
+        }
+        else if (*p)
+        {
+            return false;
+        }
+    }
+    return !cores.empty();
+}
+//EOF
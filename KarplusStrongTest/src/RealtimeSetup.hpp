@@ -0,0 +1,105 @@
+/*
+ *  RealtimeSetup: scheduling priority, CPU affinity and memory locking
+ */
+//==============================================================================
+#ifndef RealtimeSetup_hpp
+#define RealtimeSetup_hpp
+//==============================================================================
+#include <cstddef>
+#include <thread>
+#include <vector>
+//==============================================================================
+class ThreadPool;
+//==============================================================================
+/*!
+   @class RealtimeSetup
+   @brief moves render threads onto a real time scheduling policy, pins them
+   to cores and keeps the memory they touch resident.
+
+   @discussion apply() is called once from the render thread after the engine
+   and its ThreadPool are set up. It gives the calling thread the render
+   priority and cores, gives each pool worker the worker priority and one of
+   the worker cores in turn, and optionally locks all current and future
+   memory with mlockall.
+
+   Locking everything can be too much for a large process, so buffers can
+   also be locked one at a time with lockMemory(), which the engine, its
+   voices, MixBus, SpscQueue and AsyncWavWriter expose. With huge pages the
+   page aligned interior of a buffer is first advised to use transparent
+   huge pages, which only helps buffers of several megabytes. Locked pages
+   stay locked after a buffer is freed, so lock after prepare(), not per
+   block.
+
+   SCHED_FIFO and SCHED_RR need CAP_SYS_NICE or an rtprio limit on Linux and
+   locking needs a large enough memlock limit; when refused the call prints
+   why, returns false and leaves the thread as it was, so a render still
+   runs, only without the guarantee. On Windows the policies map to the
+   highest thread priorities and huge pages are ignored; macOS has no core
+   pinning.
+ */
+//==============================================================================
+class RealtimeSetup
+{
+public:
+    /** scheduling policy of render threads */
+    enum class Policy
+    {
+        normal,         ///< leave the default time sharing policy
+        fifo,           ///< SCHED_FIFO, runs until it blocks or yields
+        roundRobin      ///< SCHED_RR, shares time with threads of equal priority
+    };
+
+    /** everything apply() sets */
+    struct Config
+    {
+        Policy policy = Policy::normal;
+        /// priority of the calling render thread, clamped to the policy's range
+        int renderPriority = 80;
+        /// priority of the pool workers
+        int workerPriority = 79;
+        /// cores the render thread may run on, empty for any
+        std::vector<int> renderCores;
+        /// cores handed to the workers one each in turn, empty for any
+        std::vector<int> workerCores;
+        /// mlockall current and future memory
+        bool lockAllMemory = false;
+    };
+    //==============================================================================
+    /** applies config to the calling thread and the pool's workers
+       @param pool pool rendering with the calling thread, nullptr for none
+       @returns true if every setting took effect
+     */
+    static bool apply(const Config &config, ThreadPool *pool);
+
+    /** @returns true if the calling thread's policy and priority were set */
+    static bool setCurrentThreadPriority(Policy policy, int priority);
+    /** @returns true if the thread's policy and priority were set */
+    static bool setThreadPriority(std::thread &thread, Policy policy, int priority);
+
+    /** @param cores cores to run on, empty does nothing
+       @returns true if the calling thread was pinned
+     */
+    static bool setCurrentThreadAffinity(const std::vector<int> &cores);
+    /** @param cores cores to run on, empty does nothing
+       @returns true if the thread was pinned
+     */
+    static bool setThreadAffinity(std::thread &thread, const std::vector<int> &cores);
+    //==============================================================================
+    /** locks a range into memory, faulting it in
+       @param hugePages advise transparent huge pages first, Linux only
+       @returns true if locked
+     */
+    static bool lockMemory(const void *address, size_t bytes, bool hugePages = false);
+    /** locks every current and future page of the process
+       @returns true if locked
+     */
+    static bool lockAllMemory();
+    //==============================================================================
+    /** parses a core list such as "0,2-3"
+       @param cores receives the cores
+       @returns false if the list is malformed or names a core beyond what
+       an affinity mask of this platform can hold
+     */
+    static bool parseCores(const char *list, std::vector<int> &cores);
+};
+#endif /* RealtimeSetup_hpp */
@@ -0,0 +1,698 @@
+//
+//  RegressionHarness.cpp
+//  KarplusStrongTest
+//
+#include "RegressionHarness.hpp"
+#include "AsyncWavWriter.hpp"
+#include "SimdKernels.hpp"
+#include "SynthEngine.hpp"
+#include "ThreadPool.hpp"
+#include "WavCodec.hpp"
+#include "WavWriter.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <random>
+//==============================================================================
+namespace
+{
+    typedef RegressionHarness::Check Check;
+    typedef RegressionHarness::Config Config;
+
+    /** @returns count uniform random samples between -1 and 1 */
+    std::vector<float> randomSignal(size_t count, std::mt19937 &random)
+    {
+        std::uniform_real_distribution<float> range(-1.0f, 1.0f);
+        std::vector<float> signal(count);
+        for (float &sample : signal)
+        {
+            sample = range(random);
+        }
+        return signal;
+    }
+
+    /** compares two signals that may differ in length */
+    Check compareSignals(const std::string &name, const std::vector<float> &test,
+                         const std::vector<float> &reference, const Config &config)
+    {
+        if (test.size() != reference.size())
+        {
+            Check check;
+            check.name = name;
+            check.note = "length " + std::to_string(test.size()) + " instead of " + std::to_string(reference.size());
+            return check;
+        }
+        return RegressionHarness::compare(name, test.data(), reference.data(), test.size(), config);
+    }
+
+    /** @returns the worse of two checks of the same thing */
+    Check worst(const Check &a, const Check &b)
+    {
+        if (a.passed != b.passed)
+        {
+            return a.passed ? b : a;
+        }
+        return (b.maxUlps > a.maxUlps) ? b : a;
+    }
+
+    /** @returns contents of a file, empty if it cannot be read */
+    std::vector<uint8_t> readBytes(const std::string &path)
+    {
+        std::vector<uint8_t> bytes;
+        FILE *f = fopen(path.c_str(), "rb");
+        if (!f)
+        {
+            return bytes;
+        }
+        uint8_t chunk[65536];
+        size_t count;
+        while ((count = fread(chunk, 1, sizeof(chunk), f)) > 0)
+        {
+            bytes.insert(bytes.end(), chunk, chunk + count);
+        }
+        fclose(f);
+        return bytes;
+    }
+
+    /** checks two files hold the same bytes */
+    Check compareFiles(const std::string &name, const std::string &test, const std::string &reference)
+    {
+        Check check;
+        check.name = name;
+        const std::vector<uint8_t> a = readBytes(test);
+        const std::vector<uint8_t> b = readBytes(reference);
+        if (a.empty() || b.empty())
+        {
+            check.note = "could not read " + (a.empty() ? test : reference);
+        }
+        else if (a.size() != b.size())
+        {
+            check.note = std::to_string(a.size()) + " bytes instead of " + std::to_string(b.size());
+        }
+        else
+        {
+            const auto mismatch = std::mismatch(a.begin(), a.end(), b.begin());
+            check.passed = (mismatch.first == a.end());
+            if (!check.passed)
+            {
+                check.note = "first difference at byte " + std::to_string(mismatch.first - a.begin());
+            }
+        }
+        check.errorDb = check.passed ? -std::numeric_limits<double>::infinity() : 0.0;
+        return check;
+    }
+
+    /** writes planar audio with WavWriter */
+    bool writeFile(const std::string &path, const AudioBuffer &audio, float sampleRate, WavCodec::SampleFormat format)
+    {
+        WavWriter writer;
+        if (!writer.open(path.c_str(), audio.getNumChannels(), sampleRate, format))
+        {
+            return false;
+        }
+        writer.writePlanar(audio.getChannelPointers(), audio.getNumFrames());
+        return writer.close();
+    }
+
+    /** @returns numFrames of generateNote(), the reference for the delay line engine */
+    std::vector<float> renderReference(const Config &config, float frequency, uint32_t seed, size_t numFrames)
+    {
+        PluckedNote reference(false);
+        reference.setSampleRate(config.sampleRate);
+        reference.setNoteLength(config.noteLength);
+        reference.setFrequency(frequency);
+        reference.setSeed(seed);
+        reference.generateNote();
+        std::vector<float> wavetable(numFrames);
+        for (float &sample : wavetable)
+        {
+            sample = reference.process();
+        }
+        return wavetable;
+    }
+
+    /** @returns numFrames of the delay line engine, plucked at frequency and
+       gliding to glideFrequency from glideFrame on
+       @param blockSize frames per processBlock(), blocks are split at glideFrame
+     */
+    std::vector<float> renderStreaming(const Config &config, float frequency, uint32_t seed, size_t numFrames,
+                                       int blockSize, float glideFrequency = 0.0f, size_t glideFrame = 0)
+    {
+        PluckedNote streaming(false);
+        streaming.setSampleRate(config.sampleRate);
+        streaming.prepareToPlay(config.sampleRate);
+        streaming.setGlideTime(config.glideTime);
+        streaming.setNoteLength(config.noteLength);
+        streaming.setFrequency(frequency);
+        streaming.setSeed(seed);
+        streaming.pluck();
+        std::vector<float> streamed(numFrames);
+        size_t frame = 0;
+        while (frame < numFrames)
+        {
+            if (glideFrequency > 0.0f && frame == glideFrame)
+            {
+                streaming.setFrequency(glideFrequency);
+            }
+            size_t end = std::min(frame + blockSize, numFrames);
+            if (glideFrequency > 0.0f && frame < glideFrame)
+            {
+                end = std::min(end, glideFrame);
+            }
+            streaming.processBlock(&streamed[frame], (int)(end - frame));
+            frame = end;
+        }
+        return streamed;
+    }
+
+    /** @returns true if both paths split the delay of frequency into the
+       same integer delay and allpass fraction, so they must agree exactly
+     */
+    bool splitsAlike(const Config &config, float frequency)
+    {
+        const float delay = (config.sampleRate / frequency) - 0.5f;
+        return std::floor(delay) == std::floor(delay - PluckedNote::minFraction);
+    }
+
+    /** @returns the period in samples of the strongest autocorrelation peak
+       within a quarter of expectedPeriod, interpolated between lags
+     */
+    double estimatePeriod(const std::vector<float> &signal, size_t start, size_t window, double expectedPeriod)
+    {
+        const int lowest = std::max(2, (int)std::floor(expectedPeriod * 0.8));
+        const int highest = (int)std::ceil(expectedPeriod * 1.25);
+        if (start + window + highest + 1 > signal.size())
+        {
+            return 0.0;
+        }
+        std::vector<double> correlation(highest + 2, -1.0);
+        for (int lag = lowest - 1; lag <= highest + 1; ++lag)
+        {
+            double product = 0.0, energy = 0.0, lagEnergy = 0.0;
+            for (size_t n = start; n < start + window; ++n)
+            {
+                product += (double)signal[n] * signal[n + lag];
+                energy += (double)signal[n] * signal[n];
+                lagEnergy += (double)signal[n + lag] * signal[n + lag];
+            }
+            correlation[lag] = product / std::sqrt(std::max(energy * lagEnergy, 1e-300));
+        }
+        int best = lowest;
+        for (int lag = lowest; lag <= highest; ++lag)
+        {
+            best = (correlation[lag] > correlation[best]) ? lag : best;
+        }
+        // parabola through the peak and its neighbours
+        const double before = correlation[best - 1], peak = correlation[best], after = correlation[best + 1];
+        const double curvature = before - 2.0 * peak + after;
+        return best + ((curvature != 0.0) ? 0.5 * (before - after) / curvature : 0.0);
+    }
+
+    /** compares the pitch of test and reference after start, for paths that
+       take different routes to the same tuning
+     */
+    Check compareTuning(const std::string &name, const std::vector<float> &test, const std::vector<float> &reference,
+                        size_t start, float frequency, const Config &config)
+    {
+        Check check;
+        check.name = name;
+        const size_t window = std::min<size_t>(8192, reference.size() / 2);
+        const double expected = config.sampleRate / frequency;
+        const double testPeriod = estimatePeriod(test, start, window, expected);
+        const double referencePeriod = estimatePeriod(reference, start, window, expected);
+        if (testPeriod <= 0.0 || referencePeriod <= 0.0)
+        {
+            check.note = "note too short to measure";
+            return check;
+        }
+        const double cents = 1200.0 * std::log2(testPeriod / referencePeriod);
+        char text[32];
+        snprintf(text, sizeof(text), "%.3f cents", cents);
+        check.note = text;
+        // the frequency error relative to the reference
+        check.errorDb = 20.0 * std::log10(std::max(std::fabs(referencePeriod / testPeriod - 1.0), 1e-30));
+        check.maxUlps = (uint64_t)RegressionHarness::ulpDistance((float)testPeriod, (float)referencePeriod);
+        check.passed = std::fabs(cents) <= config.centsTolerance;
+        return check;
+    }
+
+    /** compares the RMS envelopes of two signals in blocks of envelopeFrames */
+    Check compareEnvelopes(const std::string &name, const std::vector<float> &test, const std::vector<float> &reference,
+                           const Config &config)
+    {
+        const size_t envelopeFrames = 2048;
+        std::vector<float> testEnvelope, referenceEnvelope;
+        for (size_t start = 0; start + envelopeFrames <= reference.size() && start + envelopeFrames <= test.size();
+             start += envelopeFrames)
+        {
+            double testEnergy = 0.0, referenceEnergy = 0.0;
+            for (size_t n = start; n < start + envelopeFrames; ++n)
+            {
+                testEnergy += (double)test[n] * test[n];
+                referenceEnergy += (double)reference[n] * reference[n];
+            }
+            testEnvelope.push_back((float)std::sqrt(testEnergy / envelopeFrames));
+            referenceEnvelope.push_back((float)std::sqrt(referenceEnergy / envelopeFrames));
+        }
+        Check check = RegressionHarness::compare(name, testEnvelope.data(), referenceEnvelope.data(),
+                                                 testEnvelope.size(), config);
+        check.passed = !testEnvelope.empty() && check.errorDb <= config.envelopeDbTolerance;
+        return check;
+    }
+
+    /** @returns one channel of a buffer as a vector */
+    std::vector<float> channelOf(const AudioBuffer &audio, int channel)
+    {
+        if (channel >= audio.getNumChannels())
+        {
+            return std::vector<float>();
+        }
+        const float *data = audio.getChannel(channel);
+        return std::vector<float>(data, data + audio.getNumFrames());
+    }
+}
+//==============================================================================
+std::vector<RegressionHarness::Check> RegressionHarness::run(const Config &config)
+{
+    std::vector<Check> checks;
+    checkNotes(config, checks);
+    checkEngine(config, checks);
+    checkKernels(config, checks);
+    checkWavCodec(config, checks);
+    return checks;
+}
+//==============================================================================
+uint64_t RegressionHarness::ulpDistance(float a, float b)
+{
+    if (std::isnan(a) || std::isnan(b))
+    {
+        return (std::isnan(a) && std::isnan(b)) ? 0 : std::numeric_limits<uint64_t>::max();
+    }
+    // maps the bit patterns onto a line where adjacent floats are adjacent integers
+    int32_t ia, ib;
+    memcpy(&ia, &a, sizeof(float));
+    memcpy(&ib, &b, sizeof(float));
+    const int64_t la = (ia < 0) ? (int64_t)INT32_MIN - ia : ia;
+    const int64_t lb = (ib < 0) ? (int64_t)INT32_MIN - ib : ib;
+    return (uint64_t)((la > lb) ? la - lb : lb - la);
+}
+
+RegressionHarness::Check RegressionHarness::compare(const std::string &name, const float *test, const float *reference,
+                                                    size_t numSamples, const Config &config)
+{
+    Check check;
+    check.name = name;
+
+    double errorEnergy = 0.0;
+    double referenceEnergy = 0.0;
+    for (size_t n = 0; n < numSamples; ++n)
+    {
+        check.maxUlps = std::max(check.maxUlps, ulpDistance(test[n], reference[n]));
+        const double difference = (double)test[n] - reference[n];
+        errorEnergy += difference * difference;
+        referenceEnergy += (double)reference[n] * reference[n];
+    }
+
+    if (errorEnergy == 0.0)
+    {
+        check.errorDb = -std::numeric_limits<double>::infinity();
+    }
+    else
+    {
+        check.errorDb = 10.0 * std::log10(errorEnergy / std::max(referenceEnergy, 1e-30));
+    }
+    check.passed = check.maxUlps <= config.ulpTolerance || check.errorDb <= config.dbTolerance;
+    return check;
+}
+//==============================================================================
+void RegressionHarness::checkNotes(const Config &config, std::vector<Check> &checks)
+{
+    // delays with a fraction of at least 0.2 split into the same integer delay
+    // and allpass in both paths, so their outputs must agree sample for sample
+    const float delays[][2] = {{40, 0.3f}, {108, 0.7f}, {250, 0.3f}, {580, 0.7f}};
+    const size_t numFrames = (size_t)std::floor(config.sampleRate * config.noteLength);
+    char label[128];
+
+    for (int i = 0; i < 4; ++i)
+    {
+        const float frequency = config.sampleRate / (delays[i][0] + 0.5f + delays[i][1]);
+        const uint32_t seed = config.seed + i;
+        const std::vector<float> wavetable = renderReference(config, frequency, seed, numFrames);
+        const std::vector<float> streamed = renderStreaming(config, frequency, seed, numFrames, config.blockSize);
+
+        snprintf(label, sizeof(label), "streaming note %.2f Hz", frequency);
+        checks.push_back(compareSignals(label, streamed, wavetable, config));
+
+        if (config.goldenDirectory.empty())
+        {
+            continue;
+        }
+        snprintf(label, sizeof(label), "/golden_note_%d_%.0f_%u.wav", i, config.sampleRate, seed);
+        const std::string path = config.goldenDirectory + label;
+        snprintf(label, sizeof(label), "golden note %.2f Hz", frequency);
+
+        FILE *existing = fopen(path.c_str(), "rb");
+        if (existing)
+        {
+            fclose(existing);
+            WavCodec codec;
+            int fileRate = 0;
+            const AudioBuffer golden = codec.readWav(path.c_str(), &fileRate);
+            checks.push_back(compareSignals(label, wavetable, channelOf(golden, 0), config));
+        }
+        else
+        {
+            AudioBuffer golden(1, numFrames);
+            std::copy(wavetable.begin(), wavetable.end(), golden.getChannel(0));
+            Check check;
+            check.name = label;
+            check.passed = writeFile(path, golden, config.sampleRate, WavCodec::SampleFormat::float32);
+            check.errorDb = -std::numeric_limits<double>::infinity();
+            check.note = check.passed ? "recorded " + path : "could not write " + path;
+            checks.push_back(check);
+        }
+    }
+
+    // arbitrary pitches spread over the octaves from 40 Hz to 1 kHz, every
+    // other one with a fraction below minFraction where the engine takes one
+    // sample less of integer delay and a longer allpass, so only its tuning
+    // and decay can match the reference
+    std::mt19937 random(config.seed);
+    std::uniform_real_distribution<float> logFrequency(std::log(40.0f), std::log(1000.0f));
+    auto integerDelay = [&](std::mt19937 &generator)
+    {
+        return std::floor(config.sampleRate / std::exp(logFrequency(generator)) - 0.5f);
+    };
+    std::uniform_real_distribution<float> lowFraction(0.0f, PluckedNote::minFraction);
+    std::uniform_real_distribution<float> highFraction(PluckedNote::minFraction, 1.0f);
+    for (int i = 0; i < config.randomNotes; ++i)
+    {
+        const float fraction = (i % 2 == 0) ? lowFraction(random) : highFraction(random);
+        const float frequency = config.sampleRate / (integerDelay(random) + 0.5f + fraction);
+        const uint32_t seed = config.seed + 100 + i;
+        const std::vector<float> wavetable = renderReference(config, frequency, seed, numFrames);
+        const std::vector<float> streamed = renderStreaming(config, frequency, seed, numFrames, config.blockSize);
+
+        if (splitsAlike(config, frequency))
+        {
+            snprintf(label, sizeof(label), "streaming note %.2f Hz", frequency);
+            checks.push_back(compareSignals(label, streamed, wavetable, config));
+            continue;
+        }
+        snprintf(label, sizeof(label), "streaming note %.2f Hz tuning", frequency);
+        checks.push_back(compareTuning(label, streamed, wavetable, numFrames / 10, frequency, config));
+        snprintf(label, sizeof(label), "streaming note %.2f Hz envelope", frequency);
+        checks.push_back(compareEnvelopes(label, streamed, wavetable, config));
+    }
+
+    // a glide down a fifth to a pitch below minFraction, which moves through
+    // many integer delays, must settle on the reference tuning of its target
+    const float target = config.sampleRate / (integerDelay(random) + 0.5f + lowFraction(random));
+    const size_t glideFrame = numFrames / 20;
+    const std::vector<float> glided = renderStreaming(config, target * 1.5f, config.seed + 200, numFrames,
+                                                      config.blockSize, target, glideFrame);
+    const std::vector<float> wavetable = renderReference(config, target, config.seed + 200, numFrames);
+    snprintf(label, sizeof(label), "glide %.2f to %.2f Hz tuning", target * 1.5f, target);
+    checks.push_back(compareTuning(label, glided, wavetable, numFrames / 4, target, config));
+
+    // control updates run per sample, so the glide cannot depend on the block size
+    const std::vector<float> glidedOddBlocks = renderStreaming(config, target * 1.5f, config.seed + 200, numFrames,
+                                                               37, target, glideFrame);
+    snprintf(label, sizeof(label), "glide blocks of %d and 37", config.blockSize);
+    checks.push_back(compareSignals(label, glidedOddBlocks, glided, config));
+}
+//==============================================================================
+void RegressionHarness::checkEngine(const Config &config, std::vector<Check> &checks)
+{
+    const int numVoices = 24;
+    const size_t numFrames = (size_t)(config.sampleRate * config.noteLength);
+    std::vector<float> output[2][2];
+    ThreadPool pool(4);
+    // dispatched as in a real time render, so guard builds see no locks
+    pool.setSpinWaiting(true);
+
+    for (int threaded = 0; threaded < 2; ++threaded)
+    {
+        SynthEngine engine;
+        engine.prepare(config.sampleRate, config.blockSize, numVoices);
+        engine.setThreadPool(threaded ? &pool : nullptr);
+
+        std::mt19937 random(config.seed);
+        std::uniform_real_distribution<float> pitch(82.41f, 659.26f);
+        std::uniform_real_distribution<float> pan(-1.0f, 1.0f);
+        for (int voice = 0; voice < numVoices; ++voice)
+        {
+            engine.getVoice(voice)->setSeed(config.seed + voice);
+            engine.noteOn(pitch(random), 1.0f / numVoices, pan(random), config.noteLength);
+        }
+
+        output[threaded][0].resize(numFrames);
+        output[threaded][1].resize(numFrames);
+        for (size_t frame = 0; frame < numFrames; frame += config.blockSize)
+        {
+            const int frames = (int)std::min((size_t)config.blockSize, numFrames - frame);
+            engine.renderBlock(&output[threaded][0][frame], &output[threaded][1][frame], frames);
+        }
+    }
+
+    checks.push_back(worst(compareSignals("engine on 4 threads", output[1][0], output[0][0], config),
+                           compareSignals("engine on 4 threads", output[1][1], output[0][1], config)));
+}
+//==============================================================================
+void RegressionHarness::checkKernels(const Config &config, std::vector<Check> &checks)
+{
+    // odd lengths and an offset from the aligned start exercise the scalar tails
+    const size_t n = 1003;
+    std::mt19937 random(config.seed);
+    const std::vector<float> a = randomSignal(n + 1, random);
+    const std::vector<float> b = randomSignal(n + 1, random);
+    const std::vector<float> c = randomSignal(n + 1, random);
+    const std::vector<float> d = randomSignal(n + 1, random);
+    const float *x = a.data() + 1;
+    const float *y = b.data() + 1;
+
+    {
+        float reference = 0.0f;
+        for (size_t i = 0; i < n; ++i)
+        {
+            reference = std::max(reference, std::fabs(x[i]));
+        }
+        const float test = SimdKernels::maxAbs(x, n);
+        checks.push_back(compare("SimdKernels::maxAbs", &test, &reference, 1, config));
+    }
+    {
+        float reference[2] = {0.0f, 0.0f};
+        double sumSquares = 0.0;
+        for (size_t i = 0; i < n; ++i)
+        {
+            reference[0] = std::max(reference[0], std::fabs(x[i]));
+            sumSquares += (double)x[i] * x[i];
+        }
+        reference[1] = (float)sumSquares;
+        float test[2] = {0.0f, 0.0f};
+        double testSum = 0.0;
+        SimdKernels::peakAndSumSquares(x, n, test[0], testSum);
+        test[1] = (float)testSum;
+        checks.push_back(compare("SimdKernels::peakAndSumSquares", test, reference, 2, config));
+    }
+    {
+        std::vector<float> reference(x, x + n);
+        std::vector<float> test(reference);
+        for (float &sample : reference)
+        {
+            sample *= 0.3f;
+        }
+        SimdKernels::scale(test.data(), n, 0.3f);
+        checks.push_back(compareSignals("SimdKernels::scale", test, reference, config));
+    }
+    {
+        double sum = 0.0;
+        for (size_t i = 0; i < n; ++i)
+        {
+            sum += (double)x[i] * y[i];
+        }
+        const float reference = (float)sum;
+        const float test = SimdKernels::dotProduct(x, y, n);
+        checks.push_back(compare("SimdKernels::dotProduct", &test, &reference, 1, config));
+    }
+    for (int pair = 0; pair < 2; ++pair)
+    {
+        const float *second = pair ? y : nullptr;
+        std::vector<float> reference(2 * n), test(2 * n);
+        for (size_t i = 0; i < n; ++i)
+        {
+            reference[i] = 0.8f * x[i] + (second ? 0.3f * second[i] : 0.0f);
+            reference[n + i] = 0.6f * x[i] + (second ? 0.95f * second[i] : 0.0f);
+        }
+        SimdKernels::panPair(x, 0.8f, 0.6f, second, 0.3f, 0.95f, test.data(), test.data() + n, n);
+        checks.push_back(compareSignals(pair ? "SimdKernels::panPair" : "SimdKernels::panPair single", test, reference, config));
+    }
+    {
+        std::vector<float> reference(y, y + n);
+        std::vector<float> test(reference);
+        for (size_t i = 0; i < n; ++i)
+        {
+            reference[i] += x[i];
+        }
+        SimdKernels::add(x, test.data(), n);
+        checks.push_back(compareSignals("SimdKernels::add", test, reference, config));
+    }
+    {
+        std::vector<float> reference(2 * n, 0.25f), test(2 * n, 0.25f);
+        const float *xi = c.data() + 1;
+        const float *yi = d.data() + 1;
+        for (size_t i = 0; i < n; ++i)
+        {
+            reference[i] += x[i] * y[i] - xi[i] * yi[i];
+            reference[n + i] += x[i] * yi[i] + xi[i] * y[i];
+        }
+        SimdKernels::complexMultiplyAccumulate(x, xi, y, yi, test.data(), test.data() + n, n);
+        checks.push_back(compareSignals("SimdKernels::complexMultiplyAccumulate", test, reference, config));
+    }
+
+    // interleave and deinterleave are copies, any difference is a bug
+    Check interleaveCheck, deinterleaveCheck;
+    interleaveCheck.name = "SimdKernels::interleave";
+    deinterleaveCheck.name = "SimdKernels::deinterleave";
+    interleaveCheck.passed = deinterleaveCheck.passed = true;
+    interleaveCheck.errorDb = deinterleaveCheck.errorDb = -std::numeric_limits<double>::infinity();
+    for (int channels = 1; channels <= 8; ++channels)
+    {
+        const size_t frames = n / channels;
+        std::vector<const float*> planar(channels);
+        std::vector<float> reference(channels * frames), test(channels * frames);
+        for (int channel = 0; channel < channels; ++channel)
+        {
+            planar[channel] = x + channel * frames;
+            for (size_t frame = 0; frame < frames; ++frame)
+            {
+                reference[frame * channels + channel] = planar[channel][frame];
+            }
+        }
+        SimdKernels::interleave(planar.data(), channels, frames, test.data());
+        interleaveCheck = worst(interleaveCheck, compareSignals("SimdKernels::interleave", test, reference, config));
+
+        std::vector<float> split(channels * frames);
+        std::vector<float*> outputs(channels);
+        for (int channel = 0; channel < channels; ++channel)
+        {
+            outputs[channel] = split.data() + channel * frames;
+        }
+        SimdKernels::deinterleave(reference.data(), channels, frames, outputs.data());
+        deinterleaveCheck = worst(deinterleaveCheck, compareSignals("SimdKernels::deinterleave",
+                                                                    split, std::vector<float>(x, x + channels * frames), config));
+    }
+    checks.push_back(interleaveCheck);
+    checks.push_back(deinterleaveCheck);
+}
+//==============================================================================
+void RegressionHarness::checkWavCodec(const Config &config, std::vector<Check> &checks)
+{
+    // long enough for the parallel decoder, with a tail that is not a
+    // multiple of the vector width
+    const int numChannels = 3;
+    const size_t numFrames = WavCodec::parallelDecodeMinFrames + 1001;
+    std::mt19937 random(config.seed);
+
+    AudioBuffer source(numChannels, numFrames);
+    for (int channel = 0; channel < numChannels; ++channel)
+    {
+        const std::vector<float> signal = randomSignal(numFrames, random);
+        std::copy(signal.begin(), signal.end(), source.getChannel(channel));
+        source.getChannel(channel)[0] = 1.0f;
+        source.getChannel(channel)[1] = -1.0f;
+    }
+    std::vector<float> interleaved(numChannels * numFrames);
+    ThreadPool pool(4);
+
+    const struct {WavCodec::SampleFormat format; const char *name;} formats[] =
+    {
+        {WavCodec::SampleFormat::pcm16, "pcm16"},
+        {WavCodec::SampleFormat::pcm24, "pcm24"},
+        {WavCodec::SampleFormat::float32, "float32"}
+    };
+
+    for (const auto &format : formats)
+    {
+        const std::string base = config.workDirectory + "/regression_" + format.name;
+        const std::string written = base + "_a.wav";
+        const std::string rewritten = base + "_b.wav";
+        const std::string async = base + "_async.wav";
+        const std::string name = std::string("wav ") + format.name;
+
+        if (!writeFile(written, source, config.sampleRate, format.format))
+        {
+            Check check;
+            check.name = name;
+            check.note = "could not write " + written;
+            checks.push_back(check);
+            continue;
+        }
+
+        int fileRate = 0;
+        WavCodec serialCodec, parallelCodec, monoCodec;
+        const AudioBuffer serial = serialCodec.readMultiChannelWav(written.c_str(), &fileRate);
+        const AudioBuffer parallel = parallelCodec.readMultiChannelWav(written.c_str(), &fileRate, &pool);
+        const AudioBuffer mono = monoCodec.readWav(written.c_str(), &fileRate);
+
+        checks.push_back(compareSignals(name + " batched decode", channelOf(serial, 0), channelOf(mono, 0), config));
+        Check parallelCheck = compareSignals(name + " parallel decode", channelOf(parallel, 0), channelOf(serial, 0), config);
+        for (int channel = 1; channel < numChannels; ++channel)
+        {
+            parallelCheck = worst(parallelCheck, compareSignals(parallelCheck.name, channelOf(parallel, channel),
+                                                                channelOf(serial, channel), config));
+        }
+        checks.push_back(parallelCheck);
+
+        // decoded samples must encode back to the bytes they came from
+        if (serial.getNumChannels() == numChannels && writeFile(rewritten, serial, config.sampleRate, format.format))
+        {
+            checks.push_back(compareFiles(name + " round trip bytes", rewritten, written));
+        }
+        else
+        {
+            Check check;
+            check.name = name + " round trip bytes";
+            check.note = "could not decode or rewrite";
+            checks.push_back(check);
+        }
+
+        AsyncWavWriter asyncWriter;
+        if (asyncWriter.open(async.c_str(), numChannels, config.sampleRate, format.format))
+        {
+            SimdKernels::interleave(source.getChannelPointers(), numChannels, numFrames, interleaved.data());
+            asyncWriter.write(interleaved.data(), numFrames);
+            asyncWriter.close();
+        }
+        checks.push_back(compareFiles(name + " AsyncWavWriter bytes", async, written));
+
+        remove(written.c_str());
+        remove(rewritten.c_str());
+        remove(async.c_str());
+    }
+}
+//==============================================================================
+bool RegressionHarness::print(const std::vector<Check> &checks, FILE *file)
+{
+    int failures = 0;
+    for (const Check &check : checks)
+    {
+        char ulps[32];
+        if (check.maxUlps == std::numeric_limits<uint64_t>::max())
+        {
+            snprintf(ulps, sizeof(ulps), "nan");
+        }
+        else
+        {
+            snprintf(ulps, sizeof(ulps), "%llu", (unsigned long long)check.maxUlps);
+        }
+        fprintf(file, "%s  %-44s %10s ulp %9.1f dB  %s\n", check.passed ? "PASS" : "FAIL",
+                check.name.c_str(), ulps, check.errorDb, check.note.c_str());
+        failures += !check.passed;
+    }
+    fprintf(file, "%d of %d checks passed\n", (int)checks.size() - failures, (int)checks.size());
+    fflush(file);
+    return failures == 0;
+}
+//EOF
@@ -0,0 +1,115 @@
+/*
+ *  RegressionHarness: optimised paths checked against their scalar references
+ */
+//==============================================================================
+#ifndef RegressionHarness_hpp
+#define RegressionHarness_hpp
+//==============================================================================
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+//==============================================================================
+/*!
+   @class RegressionHarness
+   @brief proves the streaming, threaded and SIMD paths produce what the
+   scalar code they replace produces.
+
+   @discussion Every check renders or decodes the same deterministic input
+   twice, once through the reference and once through the optimised path,
+   and compares the two sample by sample. A check passes when the largest
+   difference is within ulpTolerance units in the last place, or when the
+   energy of the difference relative to the reference is below dbTolerance.
+
+   - generateNote() against the delay line engine, sample by sample at
+     pitches whose fractional delay both split alike, and against stored
+     golden notes when a golden directory is given (missing ones are recorded)
+   - generateNote() against the delay line engine at random pitches; those
+     with a fraction below PluckedNote::minFraction take a different integer
+     delay and allpass, so their tuning must agree within centsTolerance and
+     their RMS envelopes within envelopeDbTolerance
+   - a glide, which must settle on the tuning of generateNote() at its target
+     and render the same in any block size
+   - SynthEngine rendered on a ThreadPool against one thread
+   - every SimdKernels function against a plain loop
+   - the batched, deinterleaving and parallel WAV decoders against the
+     sample by sample readWav() path
+   - WAV files decoded and encoded again, which must give identical bytes
+     for 16 and 24 bit PCM and 32 bit float, through WavWriter and through
+     AsyncWavWriter
+ */
+//==============================================================================
+class RegressionHarness
+{
+public:
+    /** what to check and how closely */
+    struct Config
+    {
+        /// rendering sample rate
+        float sampleRate = 48000.0f;
+        /// length of rendered notes in seconds
+        float noteLength = 1.0f;
+        /// frames per block for the streaming paths
+        int blockSize = 256;
+        /// noise seed of every note and test signal
+        uint32_t seed = 12345;
+        /// largest difference in units in the last place that passes
+        uint64_t ulpTolerance = 4;
+        /// difference energy relative to the reference, in dB, that passes
+        double dbTolerance = -120.0;
+        /// notes at random pitches checked against generateNote()
+        int randomNotes = 8;
+        /// largest pitch difference in cents where the paths differ in delay split
+        double centsTolerance = 0.5;
+        /// envelope difference energy relative to the reference, in dB, that passes
+        double envelopeDbTolerance = -20.0;
+        /// glide time constant of the glide check in seconds
+        float glideTime = 0.02f;
+        /// directory of golden notes, empty skips them
+        std::string goldenDirectory;
+        /// directory for temporary WAV files
+        std::string workDirectory = ".";
+    };
+
+    /** outcome of one comparison */
+    struct Check
+    {
+        std::string name;
+        bool passed = false;
+        /// largest difference in units in the last place
+        uint64_t maxUlps = 0;
+        /// difference energy relative to the reference in dB, -inf when identical
+        double errorDb = 0.0;
+        /// what went wrong, or that a golden file was recorded
+        std::string note;
+    };
+    //==============================================================================
+    /** runs every check
+       @returns one entry per check
+     */
+    static std::vector<Check> run(const Config &config);
+
+    /** prints checks as a table
+       @returns true if every check passed
+     */
+    static bool print(const std::vector<Check> &checks, FILE *file);
+
+    /** compares a test signal against its reference
+       @param name label of the check
+       @param test output of the optimised path
+       @param reference output of the reference path
+       @param numSamples samples in both
+     */
+    static Check compare(const std::string &name, const float *test, const float *reference,
+                         size_t numSamples, const Config &config);
+
+    /** @returns distance between two floats in units in the last place */
+    static uint64_t ulpDistance(float a, float b);
+
+private:
+    static void checkNotes(const Config &config, std::vector<Check> &checks);
+    static void checkEngine(const Config &config, std::vector<Check> &checks);
+    static void checkKernels(const Config &config, std::vector<Check> &checks);
+    static void checkWavCodec(const Config &config, std::vector<Check> &checks);
+};
+#endif /* RegressionHarness_hpp */
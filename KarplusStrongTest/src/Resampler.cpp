@@ -0,0 +1,337 @@
+//
+//  Resampler.cpp
+//  KarplusStrongTest
+//
+#define _USE_MATH_DEFINES
+#include "Resampler.hpp"
+#include "SimdKernels.hpp"
+#include "Trace.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <new>
+#include <tuple>
+#include <vector>
+//==============================================================================
+namespace
+{
+    std::mutex bankLock;
+    std::map<std::tuple<int, int, int>, std::shared_ptr<const Resampler::FilterBank>> banks;
+
+    /** zeroth order modified Bessel function of the first kind, for the Kaiser window */
+    double besselI0(double x)
+    {
+        double sum = 1.0;
+        double term = 1.0;
+        for (int k = 1; k < 50; ++k)
+        {
+            const double t = x / (2.0 * k);
+            term *= t * t;
+            sum += term;
+            if (term < sum * 1e-12) {break;}
+        }
+        return sum;
+    }
+
+    long greatestCommonDivisor(long a, long b)
+    {
+        while (b != 0)
+        {
+            const long t = a % b;
+            a = b;
+            b = t;
+        }
+        return a;
+    }
+}
+//==============================================================================
+Resampler::Resampler()
+{
+}
+
+Resampler::~Resampler()
+{
+}
+//==============================================================================
+bool Resampler::prepare(double inputRate, double outputRate, int channels,
+                        size_t maxInputFrames, int tapsPerPhase)
+{
+    if (inputRate <= 0.0 || outputRate <= 0.0 || channels < 1 || tapsPerPhase < 1)
+    {
+        printf("Resampler: invalid rates or channel count\n");
+        return false;
+    }
+
+    int up, down;
+    reduceRatio(inputRate, outputRate, up, down);
+
+    // decimating narrows the pass band relative to the upsampled rate, so the
+    // filter is lengthened to keep the same transition width
+    const double lengthScale = std::max(1.0, (double)down / up);
+    const int taps = ((int)std::ceil(tapsPerPhase * lengthScale) + 3) & ~3;
+
+    try
+    {
+        bank = getFilterBank(up, down, taps);
+        numChannels = channels;
+        history.setCategory(MemoryAccounting::Category::workBuffers);
+        history.setSize(numChannels, taps - 1 + maxInputFrames);
+    }
+    catch (const std::bad_alloc&)
+    {
+        printf("Resampler: the filter does not fit in memory or its budget\n");
+        bank.reset();
+        history.release();
+        return false;
+    }
+    reset();
+    return true;
+}
+//==============================================================================
+void Resampler::reset()
+{
+    history.clear();
+    historyFrames = bank ? (size_t)bank->taps - 1 : 0;
+    inputIndex = historyFrames;
+    phase = 0;
+}
+//==============================================================================
+size_t Resampler::process(const float *const *input, size_t numInputFrames, float *const *output)
+{
+    KS_TRACE_SCOPE("resample");
+    // nothing to filter with until prepare() has succeeded
+    if (!bank)
+    {
+        return 0;
+    }
+    const int taps = bank->taps;
+    const int up = bank->up;
+    const int down = bank->down;
+    const float *coefficients = bank->coefficients.getChannel(0);
+
+    numInputFrames = std::min(numInputFrames, history.getNumFrames() - historyFrames);
+    for (int channel = 0; channel < numChannels; ++channel)
+    {
+        memcpy(history.getChannel(channel) + historyFrames, input[channel], numInputFrames * sizeof(float));
+    }
+    historyFrames += numInputFrames;
+
+    // every channel walks the same phases, so the walk is replayed per channel
+    size_t index = inputIndex;
+    int p = phase;
+    size_t numOutputFrames = 0;
+    for (int channel = 0; channel < numChannels; ++channel)
+    {
+        const float *x = history.getChannel(channel);
+        float *y = output[channel];
+        index = inputIndex;
+        p = phase;
+        numOutputFrames = 0;
+        while (index < historyFrames)
+        {
+            y[numOutputFrames++] = SimdKernels::dotProduct(coefficients + (size_t)p * taps, x + index - (taps - 1), taps);
+            p += down;
+            index += p / up;
+            p %= up;
+        }
+    }
+    inputIndex = index;
+    phase = p;
+
+    // keep only the taps - 1 frames the next output still needs
+    const size_t consumed = std::min(inputIndex - (taps - 1), historyFrames);
+    if (consumed > 0)
+    {
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            float *x = history.getChannel(channel);
+            memmove(x, x + consumed, (historyFrames - consumed) * sizeof(float));
+        }
+        historyFrames -= consumed;
+        inputIndex -= consumed;
+    }
+    return numOutputFrames;
+}
+//==============================================================================
+size_t Resampler::getMaxOutputFrames(size_t numInputFrames) const
+{
+    return bank ? (size_t)((uint64_t)numInputFrames * bank->up / bank->down) + 2 : 0;
+}
+
+size_t Resampler::getLatency() const
+{
+    if (!bank)
+    {
+        return 0;
+    }
+    const double centre = (double)bank->taps * bank->up / 2;
+    return (size_t)std::lround(centre / bank->down);
+}
+
+int Resampler::getUpFactor() const
+{
+    return bank ? bank->up : 1;
+}
+
+int Resampler::getDownFactor() const
+{
+    return bank ? bank->down : 1;
+}
+//==============================================================================
+AudioBuffer Resampler::resampleBuffer(const AudioBuffer &input, double inputRate, double outputRate,
+                                      int tapsPerPhase)
+{
+    AudioBuffer result;
+    const size_t blockFrames = 4096;
+    Resampler resampler;
+    if (input.empty() || !resampler.prepare(inputRate, outputRate, input.getNumChannels(), blockFrames, tapsPerPhase))
+    {
+        return result;
+    }
+
+    const int channels = input.getNumChannels();
+    const size_t totalFrames = (size_t)((uint64_t)input.getNumFrames() * resampler.getUpFactor() / resampler.getDownFactor());
+    result.setSize(channels, totalFrames);
+
+    // start the first output at the filter centre, so the delay is removed
+    // exactly rather than to the nearest output frame
+    const size_t centre = (size_t)resampler.bank->taps * resampler.bank->up / 2;
+    const size_t start = (size_t)(resampler.bank->taps - 1) * resampler.bank->up + centre;
+    resampler.inputIndex = start / resampler.bank->up;
+    resampler.phase = (int)(start % resampler.bank->up);
+
+    AudioBuffer silence(channels, blockFrames);
+    AudioBuffer block(channels, resampler.getMaxOutputFrames(blockFrames));
+    std::vector<const float*> in(channels);
+    size_t inputFrame = 0;
+    size_t outputFrame = 0;
+
+    // the input is followed by silence until the delayed tail has come out
+    while (outputFrame < totalFrames)
+    {
+        const size_t framesNow = std::min(blockFrames, input.getNumFrames() - std::min(inputFrame, input.getNumFrames()));
+        for (int channel = 0; channel < channels; ++channel)
+        {
+            in[channel] = framesNow > 0 ? input.getChannel(channel) + inputFrame : silence.getChannel(channel);
+        }
+        const size_t produced = resampler.process(in.data(), framesNow > 0 ? framesNow : blockFrames, block.getChannelPointers());
+        inputFrame += framesNow;
+
+        const size_t copy = std::min(produced, totalFrames - outputFrame);
+        for (int channel = 0; channel < channels; ++channel)
+        {
+            memcpy(result.getChannel(channel) + outputFrame, block.getChannel(channel), copy * sizeof(float));
+        }
+        outputFrame += copy;
+    }
+    return result;
+}
+//==============================================================================
+void Resampler::precomputeCommonRatios(int tapsPerPhase)
+{
+    const double rates[] = {44100.0, 48000.0, 88200.0, 96000.0};
+    for (double from : rates)
+    {
+        for (double to : rates)
+        {
+            if (from != to)
+            {
+                Resampler resampler;
+                resampler.prepare(from, to, 1, 0, tapsPerPhase);
+            }
+        }
+    }
+}
+//==============================================================================
+void Resampler::reduceRatio(double inputRate, double outputRate, int &up, int &down)
+{
+    const long in = std::lround(inputRate);
+    const long out = std::lround(outputRate);
+    const long divisor = greatestCommonDivisor(in, out);
+    if (divisor > 0 && out / divisor <= maxPhases)
+    {
+        up = (int)(out / divisor);
+        down = (int)(in / divisor);
+        return;
+    }
+
+    // closest fraction with a small enough numerator, from the continued fraction
+    const double ratio = outputRate / inputRate;
+    long numerator0 = 0, numerator1 = 1;
+    long denominator0 = 1, denominator1 = 0;
+    double x = ratio;
+    while (true)
+    {
+        const long a = (long)std::floor(x);
+        const long numerator2 = a * numerator1 + numerator0;
+        const long denominator2 = a * denominator1 + denominator0;
+        if (numerator2 > maxPhases)
+        {
+            break;
+        }
+        numerator0 = numerator1; numerator1 = numerator2;
+        denominator0 = denominator1; denominator1 = denominator2;
+        if (x - a < 1e-9)
+        {
+            break;
+        }
+        x = 1.0 / (x - a);
+    }
+    up = (int)std::max(1L, numerator1);
+    down = (int)std::max(1L, denominator1);
+    printf("Resampler: %g to %g Hz approximated as %d/%d\n", inputRate, outputRate, up, down);
+}
+//==============================================================================
+std::shared_ptr<const Resampler::FilterBank> Resampler::getFilterBank(int up, int down, int taps)
+{
+    const auto key = std::make_tuple(up, down, taps);
+    {
+        std::lock_guard<std::mutex> lock(bankLock);
+        auto found = banks.find(key);
+        if (found != banks.end())
+        {
+            return found->second;
+        }
+    }
+
+    auto bank = std::make_shared<FilterBank>();
+    bank->up = up;
+    bank->down = down;
+    bank->taps = taps;
+    bank->coefficients.setCategory(MemoryAccounting::Category::caches);
+    bank->coefficients.setSize(1, (size_t)up * taps);
+
+    // Kaiser window design: the stop band starts at the lower Nyquist
+    // frequency and the transition width follows from the filter length.
+    // The centre is a whole upsampled sample, the window reaching zero one
+    // past the last tap, so the delay is exactly taps * up / 2
+    const int length = taps * up;
+    const double centre = length / 2;
+    const double nyquist = 0.5 / std::max(up, down);
+    const double transition = (stopBandAttenuation - 7.95) / (14.36 * length);
+    const double cutoff = std::max(0.5 * nyquist, nyquist - 0.5 * transition);
+    const double beta = 0.1102 * (stopBandAttenuation - 8.7);
+    const double windowScale = 1.0 / besselI0(beta);
+
+    float *coefficients = bank->coefficients.getChannel(0);
+    for (int n = 0; n < length; ++n)
+    {
+        const double t = n - centre;
+        const double sinc = (t == 0.0) ? 2.0 * cutoff : std::sin(2.0 * M_PI * cutoff * t) / (M_PI * t);
+        const double position = t / centre;
+        const double window = besselI0(beta * std::sqrt(std::max(0.0, 1.0 - position * position))) * windowScale;
+
+        // coefficient n belongs to phase n % up, reversed within the phase
+        const int p = n % up;
+        const int tap = taps - 1 - n / up;
+        coefficients[(size_t)p * taps + tap] = (float)(up * sinc * window);
+    }
+
+    std::lock_guard<std::mutex> lock(bankLock);
+    auto inserted = banks.emplace(key, bank);
+    return inserted.first->second;
+}
+//EOF
@@ -0,0 +1,125 @@
+/*
+ *  Resampler: polyphase FIR sample rate conversion
+ */
+//==============================================================================
+#ifndef Resampler_hpp
+#define Resampler_hpp
+//==============================================================================
+#include <cstddef>
+#include <memory>
+#include "AudioBuffer.hpp"
+//==============================================================================
+/*!
+   @class Resampler
+   @brief converts planar audio between two sample rates by a rational ratio.
+
+   @discussion The rate change is reduced to up / down, e.g. 44.1 kHz to
+   48 kHz is 160 / 147. A Kaiser windowed sinc low pass at the upsampled rate
+   is split into up phases of tapsPerPhase coefficients each, so every output
+   sample costs one vectorised dot product of tapsPerPhase taps whatever the
+   ratio.
+
+   Filter banks are shared between resamplers and cached by ratio and length.
+   precomputeCommonRatios() builds the banks for the usual audio rates ahead of
+   time so that prepare() on the audio path only looks them up.
+
+   The resampler sits between a source rendering at its own rate and a sink:
+
+   - prepare() once with the rates and the largest block to be converted
+   - process() each block, no allocation happens after prepare()
+   - reset() between unrelated streams
+ */
+//==============================================================================
+class Resampler
+{
+public:
+    Resampler();
+    ~Resampler();
+    //==============================================================================
+    /** sets the rates and allocates the history for a stream
+       @param inputRate sampling rate of the audio passed to process()
+       @param outputRate sampling rate of the audio process() produces
+       @param numChannels number of planar channels
+       @param maxInputFrames largest numInputFrames that will be passed to process()
+       @param tapsPerPhase filter length per phase, longer is sharper and slower,
+       rounded up to a multiple of 4 and lengthened by down / up when decimating
+       @returns false if the rates or channel count are invalid, or the filter
+       does not fit in memory or its budget
+     */
+    bool prepare(double inputRate, double outputRate, int numChannels,
+                 size_t maxInputFrames, int tapsPerPhase = defaultTapsPerPhase);
+
+    /** converts a block of planar audio
+       @param input numChannels pointers to numInputFrames samples each
+       @param numInputFrames frames of input, at most the maxInputFrames given to prepare()
+       @param output numChannels pointers with room for getMaxOutputFrames(numInputFrames) samples
+       @returns number of frames written to output, 0 if prepare() has not succeeded
+     */
+    size_t process(const float *const *input, size_t numInputFrames, float *const *output);
+
+    /** clears the filter history, the next output starts from silence */
+    void reset();
+    //==============================================================================
+    /** @returns the most frames process() can produce from numInputFrames */
+    size_t getMaxOutputFrames(size_t numInputFrames) const;
+    /** @returns delay of the filter in output frames */
+    size_t getLatency() const;
+    /** @returns interpolation factor of the reduced ratio */
+    int getUpFactor() const;
+    /** @returns decimation factor of the reduced ratio */
+    int getDownFactor() const;
+    //==============================================================================
+    /** converts a whole buffer, compensating for the filter delay so the
+       output lines up with the input
+       @param input planar audio at inputRate
+       @returns planar audio at outputRate, empty on error
+     */
+    static AudioBuffer resampleBuffer(const AudioBuffer &input, double inputRate, double outputRate,
+                                      int tapsPerPhase = defaultTapsPerPhase);
+
+    /** builds and caches the filter banks between 44.1, 48, 88.2 and 96 kHz
+       @param tapsPerPhase filter length the banks are built for
+     */
+    static void precomputeCommonRatios(int tapsPerPhase = defaultTapsPerPhase);
+    //==============================================================================
+    /** default filter length per phase, passes about 80% of the lower Nyquist */
+    static constexpr int defaultTapsPerPhase = 64;
+    /** stop band rejection of every bank in dB */
+    static constexpr double stopBandAttenuation = 90.0;
+    /** ratios that do not reduce to this many phases or fewer are approximated */
+    static constexpr int maxPhases = 1024;
+
+    /** coefficients of one ratio, shared between resamplers */
+    struct FilterBank
+    {
+        /// interpolation factor
+        int up;
+        /// decimation factor
+        int down;
+        /// taps in each phase
+        int taps;
+        /// up rows of taps coefficients, time reversed so they run forward over the input
+        AudioBuffer coefficients;
+    };
+
+private:
+    /** looks up or builds the bank for a ratio */
+    static std::shared_ptr<const FilterBank> getFilterBank(int up, int down, int taps);
+    /** reduces a pair of rates to up / down with up no larger than maxPhases */
+    static void reduceRatio(double inputRate, double outputRate, int &up, int &down);
+
+private:
+    /// coefficients for the current ratio
+    std::shared_ptr<const FilterBank> bank;
+    /// taps - 1 frames of past input followed by the current block, per channel
+    AudioBuffer history;
+    /// valid frames in history
+    size_t historyFrames = 0;
+    /// history index of the newest input frame under the filter for the next output
+    size_t inputIndex = 0;
+    /// phase of the next output, 0 to up - 1
+    int phase = 0;
+    /// planar channels
+    int numChannels = 0;
+};
+#endif /* Resampler_hpp */
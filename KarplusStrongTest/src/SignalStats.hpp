@@ -0,0 +1,55 @@
+/*
+ *  SignalStats: running peak and RMS of a signal
+ */
+//==============================================================================
+#ifndef SignalStats_hpp
+#define SignalStats_hpp
+//==============================================================================
+#include <cmath>
+#include <cstdint>
+#include "SimdKernels.hpp"
+//==============================================================================
+/*!
+   @class SignalStats
+   @brief peak and RMS updated block by block as audio is rendered or written.
+
+   @discussion Feed every block through update() and the peak is known by the
+   time the signal ends, so normalising does not need a second pass over the
+   whole buffer.
+ */
+//==============================================================================
+class SignalStats
+{
+public:
+    /** adds a block of samples to the running statistics
+       @param data audio data, interleaved channels are fine
+       @param numSamples number of samples in data
+     */
+    void update(const float *data, size_t numSamples)
+    {
+        SimdKernels::peakAndSumSquares(data, numSamples, peak, sumSquares);
+        count += numSamples;
+    }
+    /** clears all statistics */
+    void reset()
+    {
+        peak = 0.0f;
+        sumSquares = 0.0;
+        count = 0;
+    }
+    /** @returns largest absolute sample seen */
+    float getPeak() const {return peak;}
+    /** @returns root mean square of all samples seen */
+    float getRMS() const {return count ? (float)std::sqrt(sumSquares / count) : 0.0f;}
+    /** @returns number of samples seen */
+    uint64_t getNumSamples() const {return count;}
+
+private:
+    /// largest absolute value
+    float peak = 0.0f;
+    /// sum of squares in double for long signals
+    double sumSquares = 0.0;
+    /// number of samples
+    uint64_t count = 0;
+};
+#endif /* SignalStats_hpp */
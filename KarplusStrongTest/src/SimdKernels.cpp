@@ -0,0 +1,491 @@
+//
+//  SimdKernels.cpp
+//  KarplusStrongTest
+//
+#include "SimdKernels.hpp"
+#include <cmath>
+#if KS_SIMD_SSE
+#include <emmintrin.h>
+#include <xmmintrin.h>
+#elif KS_SIMD_NEON
+#include <arm_neon.h>
+#endif
+//==============================================================================
+float SimdKernels::maxAbs(const float *data, size_t numSamples)
+{
+    size_t n = 0;
+    float peak = 0.0f;
+#if KS_SIMD_SSE
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    __m128 peak0 = _mm_setzero_ps();
+    __m128 peak1 = _mm_setzero_ps();
+    for (; n + 8 <= numSamples; n += 8)
+    {
+        peak0 = _mm_max_ps(peak0, _mm_and_ps(_mm_loadu_ps(data + n), absMask));
+        peak1 = _mm_max_ps(peak1, _mm_and_ps(_mm_loadu_ps(data + n + 4), absMask));
+    }
+    peak0 = _mm_max_ps(peak0, peak1);
+    peak0 = _mm_max_ps(peak0, _mm_movehl_ps(peak0, peak0));
+    peak0 = _mm_max_ss(peak0, _mm_shuffle_ps(peak0, peak0, 1));
+    peak = _mm_cvtss_f32(peak0);
+#elif KS_SIMD_NEON
+    float32x4_t peak0 = vdupq_n_f32(0.0f);
+    float32x4_t peak1 = vdupq_n_f32(0.0f);
+    for (; n + 8 <= numSamples; n += 8)
+    {
+        peak0 = vmaxq_f32(peak0, vabsq_f32(vld1q_f32(data + n)));
+        peak1 = vmaxq_f32(peak1, vabsq_f32(vld1q_f32(data + n + 4)));
+    }
+    peak0 = vmaxq_f32(peak0, peak1);
+    float32x2_t half = vpmax_f32(vget_low_f32(peak0), vget_high_f32(peak0));
+    half = vpmax_f32(half, half);
+    peak = vget_lane_f32(half, 0);
+#endif
+    for (; n < numSamples; ++n)
+    {
+        const float a = std::fabs(data[n]);
+        if (a > peak) peak = a;
+    }
+    return peak;
+}
+//==============================================================================
+void SimdKernels::peakAndSumSquares(const float *data, size_t numSamples, float &peak, double &sumSquares)
+{
+    size_t n = 0;
+    float blockPeak = peak;
+    double blockSum = 0.0;
+#if KS_SIMD_SSE
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    __m128 peakV = _mm_set1_ps(peak);
+    __m128d sumLo = _mm_setzero_pd();
+    __m128d sumHi = _mm_setzero_pd();
+    for (; n + 4 <= numSamples; n += 4)
+    {
+        const __m128 x = _mm_loadu_ps(data + n);
+        peakV = _mm_max_ps(peakV, _mm_and_ps(x, absMask));
+        // accumulate in double so long renders do not lose precision
+        const __m128d lo = _mm_cvtps_pd(x);
+        const __m128d hi = _mm_cvtps_pd(_mm_movehl_ps(x, x));
+        sumLo = _mm_add_pd(sumLo, _mm_mul_pd(lo, lo));
+        sumHi = _mm_add_pd(sumHi, _mm_mul_pd(hi, hi));
+    }
+    peakV = _mm_max_ps(peakV, _mm_movehl_ps(peakV, peakV));
+    peakV = _mm_max_ss(peakV, _mm_shuffle_ps(peakV, peakV, 1));
+    blockPeak = _mm_cvtss_f32(peakV);
+    sumLo = _mm_add_pd(sumLo, sumHi);
+    blockSum = _mm_cvtsd_f64(_mm_add_sd(sumLo, _mm_unpackhi_pd(sumLo, sumLo)));
+#elif KS_SIMD_NEON
+    float32x4_t peakV = vdupq_n_f32(peak);
+#if defined __aarch64__ || defined _M_ARM64
+    // accumulate in double as the SSE path does
+    float64x2_t sumLo = vdupq_n_f64(0.0);
+    float64x2_t sumHi = vdupq_n_f64(0.0);
+#endif
+    for (; n + 4 <= numSamples; n += 4)
+    {
+        const float32x4_t x = vld1q_f32(data + n);
+        peakV = vmaxq_f32(peakV, vabsq_f32(x));
+#if defined __aarch64__ || defined _M_ARM64
+        const float64x2_t lo = vcvt_f64_f32(vget_low_f32(x));
+        const float64x2_t hi = vcvt_high_f64_f32(x);
+        sumLo = vaddq_f64(sumLo, vmulq_f64(lo, lo));
+        sumHi = vaddq_f64(sumHi, vmulq_f64(hi, hi));
+#else
+        // 32 bit NEON has no double lanes
+        for (size_t i = n; i < n + 4; ++i)
+        {
+            blockSum += (double)data[i] * data[i];
+        }
+#endif
+    }
+    float32x2_t half = vpmax_f32(vget_low_f32(peakV), vget_high_f32(peakV));
+    half = vpmax_f32(half, half);
+    blockPeak = vget_lane_f32(half, 0);
+#if defined __aarch64__ || defined _M_ARM64
+    blockSum = vaddvq_f64(vaddq_f64(sumLo, sumHi));
+#endif
+#endif
+    for (; n < numSamples; ++n)
+    {
+        const float a = std::fabs(data[n]);
+        if (a > blockPeak) blockPeak = a;
+        blockSum += (double)data[n] * data[n];
+    }
+    peak = blockPeak;
+    sumSquares += blockSum;
+}
+//==============================================================================
+void SimdKernels::scale(float *data, size_t numSamples, float gain)
+{
+    size_t n = 0;
+#if KS_SIMD_SSE
+    const __m128 g = _mm_set1_ps(gain);
+    for (; n + 8 <= numSamples; n += 8)
+    {
+        _mm_storeu_ps(data + n, _mm_mul_ps(_mm_loadu_ps(data + n), g));
+        _mm_storeu_ps(data + n + 4, _mm_mul_ps(_mm_loadu_ps(data + n + 4), g));
+    }
+#elif KS_SIMD_NEON
+    for (; n + 8 <= numSamples; n += 8)
+    {
+        vst1q_f32(data + n, vmulq_n_f32(vld1q_f32(data + n), gain));
+        vst1q_f32(data + n + 4, vmulq_n_f32(vld1q_f32(data + n + 4), gain));
+    }
+#endif
+    for (; n < numSamples; ++n)
+    {
+        data[n] *= gain;
+    }
+}
+//==============================================================================
+float SimdKernels::dotProduct(const float *a, const float *b, size_t numSamples)
+{
+    size_t n = 0;
+    float sum = 0.0f;
+#if KS_SIMD_SSE
+    // two accumulators hide the latency of the adds
+    __m128 sum0 = _mm_setzero_ps();
+    __m128 sum1 = _mm_setzero_ps();
+    for (; n + 8 <= numSamples; n += 8)
+    {
+        sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(a + n), _mm_loadu_ps(b + n)));
+        sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(a + n + 4), _mm_loadu_ps(b + n + 4)));
+    }
+    sum0 = _mm_add_ps(sum0, sum1);
+    sum0 = _mm_add_ps(sum0, _mm_movehl_ps(sum0, sum0));
+    sum0 = _mm_add_ss(sum0, _mm_shuffle_ps(sum0, sum0, 1));
+    sum = _mm_cvtss_f32(sum0);
+#elif KS_SIMD_NEON
+    float32x4_t sum0 = vdupq_n_f32(0.0f);
+    float32x4_t sum1 = vdupq_n_f32(0.0f);
+    for (; n + 8 <= numSamples; n += 8)
+    {
+        sum0 = vmlaq_f32(sum0, vld1q_f32(a + n), vld1q_f32(b + n));
+        sum1 = vmlaq_f32(sum1, vld1q_f32(a + n + 4), vld1q_f32(b + n + 4));
+    }
+    sum0 = vaddq_f32(sum0, sum1);
+    float32x2_t half = vadd_f32(vget_low_f32(sum0), vget_high_f32(sum0));
+    half = vpadd_f32(half, half);
+    sum = vget_lane_f32(half, 0);
+#endif
+    for (; n < numSamples; ++n)
+    {
+        sum += a[n] * b[n];
+    }
+    return sum;
+}
+//==============================================================================
+void SimdKernels::panPair(const float *a, float aLeft, float aRight,
+                          const float *b, float bLeft, float bRight,
+                          float *left, float *right, size_t numSamples)
+{
+    size_t n = 0;
+    if (!b)
+    {
+        // a silent partner keeps one loop for both cases
+        b = a;
+        bLeft = 0.0f;
+        bRight = 0.0f;
+    }
+#if KS_SIMD_SSE
+    const __m128 al = _mm_set1_ps(aLeft), ar = _mm_set1_ps(aRight);
+    const __m128 bl = _mm_set1_ps(bLeft), br = _mm_set1_ps(bRight);
+    for (; n + 4 <= numSamples; n += 4)
+    {
+        const __m128 x = _mm_loadu_ps(a + n);
+        const __m128 y = _mm_loadu_ps(b + n);
+        _mm_storeu_ps(left + n, _mm_add_ps(_mm_mul_ps(x, al), _mm_mul_ps(y, bl)));
+        _mm_storeu_ps(right + n, _mm_add_ps(_mm_mul_ps(x, ar), _mm_mul_ps(y, br)));
+    }
+#elif KS_SIMD_NEON
+    for (; n + 4 <= numSamples; n += 4)
+    {
+        const float32x4_t x = vld1q_f32(a + n);
+        const float32x4_t y = vld1q_f32(b + n);
+        vst1q_f32(left + n, vmlaq_n_f32(vmulq_n_f32(x, aLeft), y, bLeft));
+        vst1q_f32(right + n, vmlaq_n_f32(vmulq_n_f32(x, aRight), y, bRight));
+    }
+#endif
+    for (; n < numSamples; ++n)
+    {
+        left[n] = a[n] * aLeft + b[n] * bLeft;
+        right[n] = a[n] * aRight + b[n] * bRight;
+    }
+}
+//==============================================================================
+void SimdKernels::add(const float *source, float *destination, size_t numSamples)
+{
+    size_t n = 0;
+#if KS_SIMD_SSE
+    for (; n + 8 <= numSamples; n += 8)
+    {
+        _mm_storeu_ps(destination + n, _mm_add_ps(_mm_loadu_ps(destination + n), _mm_loadu_ps(source + n)));
+        _mm_storeu_ps(destination + n + 4, _mm_add_ps(_mm_loadu_ps(destination + n + 4), _mm_loadu_ps(source + n + 4)));
+    }
+#elif KS_SIMD_NEON
+    for (; n + 8 <= numSamples; n += 8)
+    {
+        vst1q_f32(destination + n, vaddq_f32(vld1q_f32(destination + n), vld1q_f32(source + n)));
+        vst1q_f32(destination + n + 4, vaddq_f32(vld1q_f32(destination + n + 4), vld1q_f32(source + n + 4)));
+    }
+#endif
+    for (; n < numSamples; ++n)
+    {
+        destination[n] += source[n];
+    }
+}
+//==============================================================================
+void SimdKernels::complexMultiplyAccumulate(const float *aReal, const float *aImag,
+                                            const float *bReal, const float *bImag,
+                                            float *accReal, float *accImag, size_t numBins)
+{
+    size_t n = 0;
+#if KS_SIMD_SSE
+    for (; n + 4 <= numBins; n += 4)
+    {
+        const __m128 ar = _mm_loadu_ps(aReal + n);
+        const __m128 ai = _mm_loadu_ps(aImag + n);
+        const __m128 br = _mm_loadu_ps(bReal + n);
+        const __m128 bi = _mm_loadu_ps(bImag + n);
+        const __m128 re = _mm_sub_ps(_mm_mul_ps(ar, br), _mm_mul_ps(ai, bi));
+        const __m128 im = _mm_add_ps(_mm_mul_ps(ar, bi), _mm_mul_ps(ai, br));
+        _mm_storeu_ps(accReal + n, _mm_add_ps(_mm_loadu_ps(accReal + n), re));
+        _mm_storeu_ps(accImag + n, _mm_add_ps(_mm_loadu_ps(accImag + n), im));
+    }
+#elif KS_SIMD_NEON
+    for (; n + 4 <= numBins; n += 4)
+    {
+        const float32x4_t ar = vld1q_f32(aReal + n);
+        const float32x4_t ai = vld1q_f32(aImag + n);
+        const float32x4_t br = vld1q_f32(bReal + n);
+        const float32x4_t bi = vld1q_f32(bImag + n);
+        float32x4_t re = vld1q_f32(accReal + n);
+        float32x4_t im = vld1q_f32(accImag + n);
+        re = vmlsq_f32(vmlaq_f32(re, ar, br), ai, bi);
+        im = vmlaq_f32(vmlaq_f32(im, ar, bi), ai, br);
+        vst1q_f32(accReal + n, re);
+        vst1q_f32(accImag + n, im);
+    }
+#endif
+    for (; n < numBins; ++n)
+    {
+        accReal[n] += aReal[n] * bReal[n] - aImag[n] * bImag[n];
+        accImag[n] += aReal[n] * bImag[n] + aImag[n] * bReal[n];
+    }
+}
+//==============================================================================
+void SimdKernels::interleave(const float *const *planar, int numChannels, size_t numFrames, float *interleaved)
+{
+    size_t n = 0;
+    float *out = interleaved;
+#if KS_SIMD_SSE
+    switch (numChannels)
+    {
+        case 2:
+            for (; n + 4 <= numFrames; n += 4, out += 8)
+            {
+                const __m128 l = _mm_loadu_ps(planar[0] + n);
+                const __m128 r = _mm_loadu_ps(planar[1] + n);
+                _mm_storeu_ps(out,     _mm_unpacklo_ps(l, r));
+                _mm_storeu_ps(out + 4, _mm_unpackhi_ps(l, r));
+            }
+            break;
+        case 4:
+            for (; n + 4 <= numFrames; n += 4, out += 16)
+            {
+                __m128 c0 = _mm_loadu_ps(planar[0] + n);
+                __m128 c1 = _mm_loadu_ps(planar[1] + n);
+                __m128 c2 = _mm_loadu_ps(planar[2] + n);
+                __m128 c3 = _mm_loadu_ps(planar[3] + n);
+                _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+                _mm_storeu_ps(out,      c0);
+                _mm_storeu_ps(out + 4,  c1);
+                _mm_storeu_ps(out + 8,  c2);
+                _mm_storeu_ps(out + 12, c3);
+            }
+            break;
+        case 6:
+            for (; n + 4 <= numFrames; n += 4, out += 24)
+            {
+                __m128 c0 = _mm_loadu_ps(planar[0] + n);
+                __m128 c1 = _mm_loadu_ps(planar[1] + n);
+                __m128 c2 = _mm_loadu_ps(planar[2] + n);
+                __m128 c3 = _mm_loadu_ps(planar[3] + n);
+                _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+                const __m128 c4 = _mm_loadu_ps(planar[4] + n);
+                const __m128 c5 = _mm_loadu_ps(planar[5] + n);
+                const __m128 lo = _mm_unpacklo_ps(c4, c5); // frames 0 and 1
+                const __m128 hi = _mm_unpackhi_ps(c4, c5); // frames 2 and 3
+                _mm_storeu_ps(out, c0);
+                _mm_storel_pi(reinterpret_cast<__m64*>(out + 4), lo);
+                _mm_storeu_ps(out + 6, c1);
+                _mm_storeh_pi(reinterpret_cast<__m64*>(out + 10), lo);
+                _mm_storeu_ps(out + 12, c2);
+                _mm_storel_pi(reinterpret_cast<__m64*>(out + 16), hi);
+                _mm_storeu_ps(out + 18, c3);
+                _mm_storeh_pi(reinterpret_cast<__m64*>(out + 22), hi);
+            }
+            break;
+        case 8:
+            for (; n + 4 <= numFrames; n += 4, out += 32)
+            {
+                __m128 a0 = _mm_loadu_ps(planar[0] + n);
+                __m128 a1 = _mm_loadu_ps(planar[1] + n);
+                __m128 a2 = _mm_loadu_ps(planar[2] + n);
+                __m128 a3 = _mm_loadu_ps(planar[3] + n);
+                __m128 b0 = _mm_loadu_ps(planar[4] + n);
+                __m128 b1 = _mm_loadu_ps(planar[5] + n);
+                __m128 b2 = _mm_loadu_ps(planar[6] + n);
+                __m128 b3 = _mm_loadu_ps(planar[7] + n);
+                _MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+                _MM_TRANSPOSE4_PS(b0, b1, b2, b3);
+                _mm_storeu_ps(out,      a0);
+                _mm_storeu_ps(out + 4,  b0);
+                _mm_storeu_ps(out + 8,  a1);
+                _mm_storeu_ps(out + 12, b1);
+                _mm_storeu_ps(out + 16, a2);
+                _mm_storeu_ps(out + 20, b2);
+                _mm_storeu_ps(out + 24, a3);
+                _mm_storeu_ps(out + 28, b3);
+            }
+            break;
+        default:
+            break;
+    }
+#elif KS_SIMD_NEON
+    if (numChannels == 2)
+    {
+        for (; n + 4 <= numFrames; n += 4, out += 8)
+        {
+            float32x4x2_t v = {{vld1q_f32(planar[0] + n), vld1q_f32(planar[1] + n)}};
+            vst2q_f32(out, v);
+        }
+    }
+    else if (numChannels == 4)
+    {
+        for (; n + 4 <= numFrames; n += 4, out += 16)
+        {
+            float32x4x4_t v = {{vld1q_f32(planar[0] + n), vld1q_f32(planar[1] + n),
+                                vld1q_f32(planar[2] + n), vld1q_f32(planar[3] + n)}};
+            vst4q_f32(out, v);
+        }
+    }
+#endif
+    for (; n < numFrames; ++n)
+    {
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            *out++ = planar[channel][n];
+        }
+    }
+}
+//==============================================================================
+void SimdKernels::deinterleave(const float *interleaved, int numChannels, size_t numFrames, float *const *planar)
+{
+    size_t n = 0;
+    const float *in = interleaved;
+#if KS_SIMD_SSE
+    switch (numChannels)
+    {
+        case 2:
+            for (; n + 4 <= numFrames; n += 4, in += 8)
+            {
+                const __m128 a = _mm_loadu_ps(in);
+                const __m128 b = _mm_loadu_ps(in + 4);
+                _mm_storeu_ps(planar[0] + n, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+                _mm_storeu_ps(planar[1] + n, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+            }
+            break;
+        case 4:
+            for (; n + 4 <= numFrames; n += 4, in += 16)
+            {
+                __m128 f0 = _mm_loadu_ps(in);
+                __m128 f1 = _mm_loadu_ps(in + 4);
+                __m128 f2 = _mm_loadu_ps(in + 8);
+                __m128 f3 = _mm_loadu_ps(in + 12);
+                _MM_TRANSPOSE4_PS(f0, f1, f2, f3);
+                _mm_storeu_ps(planar[0] + n, f0);
+                _mm_storeu_ps(planar[1] + n, f1);
+                _mm_storeu_ps(planar[2] + n, f2);
+                _mm_storeu_ps(planar[3] + n, f3);
+            }
+            break;
+        case 6:
+            for (; n + 4 <= numFrames; n += 4, in += 24)
+            {
+                __m128 f0 = _mm_loadu_ps(in);
+                __m128 f1 = _mm_loadu_ps(in + 6);
+                __m128 f2 = _mm_loadu_ps(in + 12);
+                __m128 f3 = _mm_loadu_ps(in + 18);
+                _MM_TRANSPOSE4_PS(f0, f1, f2, f3);
+                __m128 lo = _mm_setzero_ps();
+                __m128 hi = _mm_setzero_ps();
+                lo = _mm_loadl_pi(lo, reinterpret_cast<const __m64*>(in + 4));
+                lo = _mm_loadh_pi(lo, reinterpret_cast<const __m64*>(in + 10));
+                hi = _mm_loadl_pi(hi, reinterpret_cast<const __m64*>(in + 16));
+                hi = _mm_loadh_pi(hi, reinterpret_cast<const __m64*>(in + 22));
+                _mm_storeu_ps(planar[0] + n, f0);
+                _mm_storeu_ps(planar[1] + n, f1);
+                _mm_storeu_ps(planar[2] + n, f2);
+                _mm_storeu_ps(planar[3] + n, f3);
+                _mm_storeu_ps(planar[4] + n, _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0)));
+                _mm_storeu_ps(planar[5] + n, _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1)));
+            }
+            break;
+        case 8:
+            for (; n + 4 <= numFrames; n += 4, in += 32)
+            {
+                __m128 a0 = _mm_loadu_ps(in);
+                __m128 b0 = _mm_loadu_ps(in + 4);
+                __m128 a1 = _mm_loadu_ps(in + 8);
+                __m128 b1 = _mm_loadu_ps(in + 12);
+                __m128 a2 = _mm_loadu_ps(in + 16);
+                __m128 b2 = _mm_loadu_ps(in + 20);
+                __m128 a3 = _mm_loadu_ps(in + 24);
+                __m128 b3 = _mm_loadu_ps(in + 28);
+                _MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+                _MM_TRANSPOSE4_PS(b0, b1, b2, b3);
+                _mm_storeu_ps(planar[0] + n, a0);
+                _mm_storeu_ps(planar[1] + n, a1);
+                _mm_storeu_ps(planar[2] + n, a2);
+                _mm_storeu_ps(planar[3] + n, a3);
+                _mm_storeu_ps(planar[4] + n, b0);
+                _mm_storeu_ps(planar[5] + n, b1);
+                _mm_storeu_ps(planar[6] + n, b2);
+                _mm_storeu_ps(planar[7] + n, b3);
+            }
+            break;
+        default:
+            break;
+    }
+#elif KS_SIMD_NEON
+    if (numChannels == 2)
+    {
+        for (; n + 4 <= numFrames; n += 4, in += 8)
+        {
+            const float32x4x2_t v = vld2q_f32(in);
+            vst1q_f32(planar[0] + n, v.val[0]);
+            vst1q_f32(planar[1] + n, v.val[1]);
+        }
+    }
+    else if (numChannels == 4)
+    {
+        for (; n + 4 <= numFrames; n += 4, in += 16)
+        {
+            const float32x4x4_t v = vld4q_f32(in);
+            vst1q_f32(planar[0] + n, v.val[0]);
+            vst1q_f32(planar[1] + n, v.val[1]);
+            vst1q_f32(planar[2] + n, v.val[2]);
+            vst1q_f32(planar[3] + n, v.val[3]);
+        }
+    }
+#endif
+    for (; n < numFrames; ++n)
+    {
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            planar[channel][n] = *in++;
+        }
+    }
+}
+//EOF
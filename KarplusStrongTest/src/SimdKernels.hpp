@@ -0,0 +1,108 @@
+/*
+ *  SimdKernels: vectorised inner loops shared by the codec, mixer and synth
+ */
+//==============================================================================
+#ifndef SimdKernels_hpp
+#define SimdKernels_hpp
+//==============================================================================
+#include <cstddef>
+//==============================================================================
+#if defined __SSE2__ || defined _M_X64 || (defined _M_IX86_FP && _M_IX86_FP >= 2)
+#define KS_SIMD_SSE 1
+#elif defined __ARM_NEON || defined __ARM_NEON__
+#define KS_SIMD_NEON 1
+#endif
+//==============================================================================
+/*!
+   @class SimdKernels
+   @brief static float kernels with SSE, NEON and scalar implementations.
+
+   @discussion The instruction set is chosen at compile time. None of the
+   kernels require aligned pointers, but aligned data will load faster.
+ */
+//==============================================================================
+class SimdKernels
+{
+public:
+    /** largest absolute sample value
+       @param data audio data
+       @param numSamples number of samples in data
+       @returns max |data[n]|
+     */
+    static float maxAbs(const float *data, size_t numSamples);
+
+    /** largest absolute sample value and sum of squares in one pass
+       @param data audio data
+       @param numSamples number of samples in data
+       @param peak updated with the largest absolute value found
+       @param sumSquares sum of squares of data is added to this
+     */
+    static void peakAndSumSquares(const float *data, size_t numSamples, float &peak, double &sumSquares);
+
+    /** multiplies data by a gain in place
+       @param data audio data
+       @param numSamples number of samples in data
+       @param gain gain to apply
+     */
+    static void scale(float *data, size_t numSamples, float gain);
+
+    /** inner product of two arrays, the FIR kernel of the resampler
+       @param a first array
+       @param b second array
+       @param numSamples length of both arrays
+       @returns sum of a[n] * b[n]
+     */
+    static float dotProduct(const float *a, const float *b, size_t numSamples);
+
+    /** pans and sums two mono signals into a stereo pair, overwriting it
+       @param a first signal
+       @param aLeft gain of a in the left channel
+       @param aRight gain of a in the right channel
+       @param b second signal, may be nullptr to pan a alone
+       @param bLeft gain of b in the left channel
+       @param bRight gain of b in the right channel
+       @param left output, aLeft * a + bLeft * b
+       @param right output, aRight * a + bRight * b
+       @param numSamples samples in each signal
+     */
+    static void panPair(const float *a, float aLeft, float aRight,
+                        const float *b, float bLeft, float bRight,
+                        float *left, float *right, size_t numSamples);
+
+    /** adds one array to another
+       @param source values to add
+       @param destination destination[n] += source[n]
+       @param numSamples number of samples
+     */
+    static void add(const float *source, float *destination, size_t numSamples);
+
+    /** complex multiply accumulate on split spectra, acc += a * b
+       @param aReal real parts of a
+       @param aImag imaginary parts of a
+       @param bReal real parts of b
+       @param bImag imaginary parts of b
+       @param accReal real parts of the accumulator
+       @param accImag imaginary parts of the accumulator
+       @param numBins number of complex values
+     */
+    static void complexMultiplyAccumulate(const float *aReal, const float *aImag,
+                                          const float *bReal, const float *bImag,
+                                          float *accReal, float *accImag, size_t numBins);
+
+    /** planar to interleaved copy, vectorised for 2, 4, 6 and 8 channels
+       @param planar numChannels pointers to numFrames samples each
+       @param numChannels channel count
+       @param numFrames frames to copy
+       @param interleaved output of numChannels * numFrames samples
+     */
+    static void interleave(const float *const *planar, int numChannels, size_t numFrames, float *interleaved);
+
+    /** interleaved to planar copy, vectorised for 2, 4, 6 and 8 channels
+       @param interleaved input of numChannels * numFrames samples
+       @param numChannels channel count
+       @param numFrames frames to copy
+       @param planar numChannels pointers with room for numFrames samples each
+     */
+    static void deinterleave(const float *interleaved, int numChannels, size_t numFrames, float *const *planar);
+};
+#endif /* SimdKernels_hpp */
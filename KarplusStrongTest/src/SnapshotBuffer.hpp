@@ -0,0 +1,77 @@
+/*
+ *  SnapshotBuffer: lock-free triple buffer publishing a value between two threads
+ */
+//==============================================================================
+#ifndef SnapshotBuffer_hpp
+#define SnapshotBuffer_hpp
+//==============================================================================
+#include <atomic>
+//==============================================================================
+/*!
+   @class SnapshotBuffer
+   @brief hands the latest copy of a value from one writing thread to one
+   reading thread without locks or tearing.
+
+   @discussion Three copies rotate between the writer, the reader and a
+   middle slot. The writer fills its copy in place and publish() swaps it
+   with the middle; read() swaps the middle in only when something newer was
+   published. Neither side ever waits or sees the other's copy half written,
+   and intermediate publications the reader missed are simply skipped.
+
+   Neither side allocates unless T's assignment does, so storage such as a
+   vector should be sized for all three copies with forEach() up front,
+   while neither thread is running.
+ */
+//==============================================================================
+template <typename T>
+class SnapshotBuffer
+{
+public:
+    /** @returns the copy to fill, writer thread only */
+    T& getWriteBuffer() {return buffers[writeIndex];}
+
+    /** makes the write buffer the latest snapshot, writer thread only */
+    void publish()
+    {
+        const int previous = middle.exchange(writeIndex | freshBit, std::memory_order_acq_rel);
+        writeIndex = previous & indexMask;
+    }
+
+    /** @returns the latest published snapshot, valid until the next read(),
+       reader thread only
+     */
+    const T& read()
+    {
+        if (middle.load(std::memory_order_relaxed) & freshBit)
+        {
+            const int previous = middle.exchange(readIndex, std::memory_order_acq_rel);
+            readIndex = previous & indexMask;
+        }
+        return buffers[readIndex];
+    }
+
+    /** applies a function to all three copies, only while neither thread uses the buffer */
+    template <typename Function>
+    void forEach(Function function)
+    {
+        for (T &buffer : buffers)
+        {
+            function(buffer);
+        }
+    }
+
+private:
+    /// set in middle when it holds a snapshot the reader has not taken
+    static constexpr int freshBit = 4;
+    static constexpr int indexMask = 3;
+
+    /// the three copies
+    T buffers[3];
+    /// copy owned by the writer
+    int writeIndex = 0;
+    /// copy in the middle, with freshBit, on its own cache line
+    alignas(64) std::atomic<int> middle {1};
+    /// copy owned by the reader, on its own cache line
+    alignas(64) int readIndex = 2;
+};
+#endif /* SnapshotBuffer_hpp */
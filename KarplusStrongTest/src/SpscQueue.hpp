@@ -0,0 +1,100 @@
+/*
+ *  SpscQueue: bounded lock-free single producer / single consumer queue
+ */
+//==============================================================================
+#ifndef SpscQueue_hpp
+#define SpscQueue_hpp
+//==============================================================================
+#include "MemoryAccounting.hpp"
+#include "RealtimeSetup.hpp"
+#include <atomic>
+#include <cstddef>
+#include <vector>
+//==============================================================================
+/*!
+   @class SpscQueue
+   @brief fixed capacity ring buffer safe for one pushing and one popping thread.
+
+   @discussion Storage is allocated once in the constructor, push() and pop()
+   never allocate or lock, so either end can be used from a real-time thread.
+   Capacity is rounded up to a power of two.
+ */
+//==============================================================================
+template <typename T>
+class SpscQueue
+{
+public:
+    /**
+       Constructor
+       @param minCapacity number of elements the queue must be able to hold
+     */
+    explicit SpscQueue(size_t minCapacity)
+    {
+        size_t capacity = 2;
+        while (capacity < minCapacity + 1) {capacity <<= 1;}
+        slots.resize(capacity);
+        mask = capacity - 1;
+        slotMemory.setBytes(slots.capacity() * sizeof(T));
+    }
+    //==============================================================================
+    /** adds an element, producer thread only
+       @returns false if the queue is full
+     */
+    bool push(const T &value)
+    {
+        const size_t w = writeIndex.load(std::memory_order_relaxed);
+        const size_t next = (w + 1) & mask;
+        if (next == readIndex.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        slots[w] = value;
+        writeIndex.store(next, std::memory_order_release);
+        return true;
+    }
+
+    /** removes an element, consumer thread only
+       @returns false if the queue is empty
+     */
+    bool pop(T &value)
+    {
+        const size_t r = readIndex.load(std::memory_order_relaxed);
+        if (r == writeIndex.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        value = slots[r];
+        readIndex.store((r + 1) & mask, std::memory_order_release);
+        return true;
+    }
+    //==============================================================================
+    /** @returns approximate number of queued elements */
+    size_t size() const
+    {
+        return (writeIndex.load(std::memory_order_acquire) - readIndex.load(std::memory_order_acquire)) & mask;
+    }
+    /** @returns true if nothing is queued */
+    bool empty() const {return size() == 0;}
+    /** @returns maximum number of queued elements */
+    size_t capacity() const {return mask;}
+    /** keeps the slots resident, see RealtimeSetup::lockMemory()
+       @returns true if locked
+     */
+    bool lockMemory(bool hugePages = false) const
+    {
+        return RealtimeSetup::lockMemory(slots.data(), slots.size() * sizeof(T), hugePages);
+    }
+
+private:
+    /// element storage, one slot is always left empty
+    std::vector<T> slots;
+    /// slots.size() - 1
+    size_t mask;
+    /// accounts slots
+    MemoryAccounting::Tracker slotMemory {MemoryAccounting::Category::queues};
+    /// next slot to write, on its own cache line
+    alignas(64) std::atomic<size_t> writeIndex {0};
+    /// next slot to read, on its own cache line
+    alignas(64) std::atomic<size_t> readIndex {0};
+};
+#endif /* SpscQueue_hpp */
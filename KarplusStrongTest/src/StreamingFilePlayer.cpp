@@ -0,0 +1,227 @@
+//
+//  StreamingFilePlayer.cpp
+//  KarplusStrongTest
+//
+#include "StreamingFilePlayer.hpp"
+#include "Trace.hpp"
+#include <algorithm>
+#include <chrono>
+//==============================================================================
+StreamingFilePlayer::StreamingFilePlayer(size_t readAhead, size_t framesPerChunk)
+: readAheadFrames(readAhead),
+  chunkFrames(framesPerChunk > 0 ? framesPerChunk : defaultChunkFrames)
+{
+}
+
+StreamingFilePlayer::~StreamingFilePlayer()
+{
+    stop();
+    if (decoder.joinable())
+    {
+        decoder.join();
+    }
+}
+//==============================================================================
+void StreamingFilePlayer::stop()
+{
+    stopping.store(true, std::memory_order_release);
+}
+//==============================================================================
+bool StreamingFilePlayer::play(const char *filename)
+{
+    uint64_t dataSize;
+    file = wavReadWrite.openRawData(filename, &dataSize);
+    if (!file)
+    {
+        fprintf(stderr, "StreamingFilePlayer: could not open %s, check the file name is correct\n", filename);
+        return false;
+    }
+
+    numChannels = wavReadWrite.getFileChannelNumber();
+    const ALenum format = AudioPlayerOpenAL::getAlFormat((uint8_t)numChannels, 16);
+    if (numChannels > 2)
+    {
+        fprintf(stderr, "StreamingFilePlayer: %d channel files are not supported\n", numChannels);
+        fclose(file);
+        file = nullptr;
+        return false;
+    }
+
+    // the pool holds the read-ahead plus the blocks being uploaded
+    const size_t numBlocks = std::max<size_t>(AudioPlayerOpenAL::numStreamBuffers + 1,
+                                              (readAheadFrames + chunkFrames - 1) / chunkFrames);
+    storage.assign(numBlocks * chunkFrames * numChannels, 0);
+    storageMemory.setBytes(storage.capacity() * sizeof(int16_t));
+    freeBlocks.reset(new SpscQueue<size_t>(numBlocks));
+    fullBlocks.reset(new SpscQueue<Block>(numBlocks));
+    for (size_t i = 0; i < numBlocks; ++i)
+    {
+        freeBlocks->push(i);
+    }
+
+    framesRemaining = dataSize / ((uint64_t)numChannels * wavReadWrite.getFileBitDepth() / 8);
+    underrunCount = 0;
+    framesQueued = 0;
+    stopping.store(false);
+    decodeFinished.store(false);
+    decoder = std::thread(&StreamingFilePlayer::decode, this);
+
+    ALCcontext *context = AudioPlayerOpenAL::openContext();
+    if (!context)
+    {
+        stop();
+    }
+
+    ALuint source = 0;
+    ALuint buffers[AudioPlayerOpenAL::numStreamBuffers];
+    std::vector<ALuint> idleBuffers;
+    int buffersQueued = 0;
+    const ALsizei samplingRate = (ALsizei)wavReadWrite.getFileSampleRate();
+    const size_t blockSamples = chunkFrames * numChannels;
+
+    if (context)
+    {
+        alGenSources((ALuint)1, &source);
+        AudioPlayerOpenAL::testError("source generation");
+        alGenBuffers(AudioPlayerOpenAL::numStreamBuffers, buffers);
+        AudioPlayerOpenAL::testError("buffer generation");
+        idleBuffers.assign(buffers, buffers + AudioPlayerOpenAL::numStreamBuffers);
+
+        // wait for the decoder to fill the OpenAL queue before starting
+        while (!stopping.load(std::memory_order_acquire) &&
+               !decodeFinished.load(std::memory_order_acquire) &&
+               fullBlocks->size() < (size_t)AudioPlayerOpenAL::numStreamBuffers)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    bool started = false;
+    while (context && !stopping.load(std::memory_order_acquire))
+    {
+        // hand back every buffer the source has finished with
+        ALint processed = 0;
+        alGetSourcei(source, AL_BUFFERS_PROCESSED, &processed);
+        for (; processed > 0; --processed)
+        {
+            ALuint buffer;
+            alSourceUnqueueBuffers(source, 1, &buffer);
+            idleBuffers.push_back(buffer);
+            --buffersQueued;
+        }
+
+        // the decoder must have finished before fullBlocks is known to be drained
+        const bool finished = decodeFinished.load(std::memory_order_acquire);
+
+        Block block;
+        while (!idleBuffers.empty() && fullBlocks->pop(block))
+        {
+            if (block.frames == 0)
+            {
+                freeBlocks->push(block.index);
+                continue;
+            }
+            KS_TRACE_SCOPE("sinkQueue");
+            const ALuint buffer = idleBuffers.back();
+            idleBuffers.pop_back();
+            alBufferData(buffer, format, &storage[block.index * blockSamples],
+                         (ALsizei)(block.frames * numChannels * sizeof(int16_t)), samplingRate);
+            AudioPlayerOpenAL::testError("Fail at alBufferData\n");
+            alSourceQueueBuffers(source, 1, &buffer);
+            ++buffersQueued;
+            framesQueued += block.frames;
+            freeBlocks->push(block.index);
+        }
+
+        if (buffersQueued == 0 && finished && fullBlocks->empty())
+        {
+            break;
+        }
+
+        ALint sourceState;
+        alGetSourcei(source, AL_SOURCE_STATE, &sourceState);
+        AudioPlayerOpenAL::testError("source state get");
+        if (sourceState != AL_PLAYING && buffersQueued > 0)
+        {
+            alGetSourcei(source, AL_BUFFERS_PROCESSED, &processed);
+            if (processed == 0)
+            {
+                if (started)
+                {
+                    ++underrunCount;
+                    if (loadMeter)
+                    {
+                        loadMeter->reportUnderrun();
+                    }
+                    fprintf(stderr, "StreamingFilePlayer: underrun after %llu frames\n",
+                            (unsigned long long)framesQueued);
+                }
+                alSourcePlay(source);
+                AudioPlayerOpenAL::testError("source playing");
+                started = true;
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+
+    stop();
+    decoder.join();
+    fclose(file);
+    file = nullptr;
+
+    if (context)
+    {
+        alSourceStop(source);
+        alDeleteSources(1, &source);
+        alDeleteBuffers(AudioPlayerOpenAL::numStreamBuffers, buffers);
+        AudioPlayerOpenAL::closeContext(context);
+    }
+
+    freeBlocks.reset();
+    fullBlocks.reset();
+    return context != nullptr;
+}
+//==============================================================================
+void StreamingFilePlayer::decode()
+{
+    KS_TRACE_THREAD("StreamingFilePlayer decoder");
+    const size_t bytesPerFrame = (size_t)numChannels * wavReadWrite.getFileBitDepth() / 8;
+    std::vector<uint8_t> raw(chunkFrames * bytesPerFrame);
+    std::vector<float> decoded(chunkFrames * numChannels);
+
+    size_t index;
+    while (framesRemaining > 0 && !stopping.load(std::memory_order_acquire))
+    {
+        if (!freeBlocks->pop(index))
+        {
+            // read-ahead is full, wait for the player to catch up
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+
+        KS_TRACE_SCOPE("decodeChunk");
+        const size_t framesWanted = (size_t)std::min<uint64_t>(chunkFrames, framesRemaining);
+        const size_t framesRead = wavReadWrite.readInterleaved(file, raw.data(), decoded.data(), framesWanted);
+        int16_t *block = &storage[index * chunkFrames * numChannels];
+        // same scale as WavCodec's 16 bit decoding so 16 bit files pass through unchanged
+        for (size_t i = 0; i < framesRead * numChannels; ++i)
+        {
+            const float sample = decoded[i] * 32768.0f;
+            block[i] = (int16_t)std::min(32767.0f, std::max(-32768.0f, sample));
+        }
+
+        // an empty block still goes through fullBlocks, freeBlocks has only
+        // the player as producer, which hands it back to the pool
+        const Block full = {index, framesRead};
+        fullBlocks->push(full);
+        framesRemaining -= framesRead;
+        if (framesRead < framesWanted)
+        {
+            fprintf(stderr, "StreamingFilePlayer: file read failed with %llu frames left\n",
+                    (unsigned long long)framesRemaining);
+            break;
+        }
+    }
+    decodeFinished.store(true, std::memory_order_release);
+}
+//EOF
@@ -0,0 +1,129 @@
+/*
+ *  StreamingFilePlayer: plays wav files of any length with constant memory
+ */
+//==============================================================================
+#ifndef StreamingFilePlayer_hpp
+#define StreamingFilePlayer_hpp
+//==============================================================================
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "AudioPlayerOpenAL.hpp"
+#include "LoadMeter.hpp"
+#include "SpscQueue.hpp"
+//==============================================================================
+/*!
+   @class StreamingFilePlayer
+   @brief decodes a wav file ahead of playback on a background thread.
+
+   @discussion A decode thread reads the file in chunks, converts each chunk
+   to 16 bit and places it in a pool of blocks. The playing thread moves
+   decoded blocks into a small queue of OpenAL buffers as the source finishes
+   with them. Blocks travel between the two threads through lock-free queues,
+   the same way as in AsyncWavWriter.
+
+   Playback starts as soon as enough blocks to fill the OpenAL queue are
+   decoded, and the memory used is set by the read-ahead, not the file
+   length. If the source runs dry before the end of the file, because the
+   disk or decoder fell behind, an underrun is counted and reported on stderr,
+   and on the LoadMeter set with setLoadMeter() so it shows up next to the
+   render load.
+
+   Any format WavCodec reads can be played, with one or two channels.
+ */
+//==============================================================================
+class StreamingFilePlayer
+{
+public:
+    /**
+       Constructor
+       @param readAheadFrames frames decoded ahead of the playing position
+       @param chunkFrames frames per block and per OpenAL buffer
+     */
+    StreamingFilePlayer(size_t readAheadFrames = defaultReadAheadFrames,
+                        size_t chunkFrames = defaultChunkFrames);
+    /** Destructor: stops the decode thread if it is still running */
+    ~StreamingFilePlayer();
+
+    StreamingFilePlayer(const StreamingFilePlayer&) = delete;
+    StreamingFilePlayer& operator=(const StreamingFilePlayer&) = delete;
+    //==============================================================================
+    /** plays a file, returning when it has finished or stop() was called
+       @param filename path to wav file
+       @returns false if the file could not be opened or played
+     */
+    bool play(const char *filename);
+
+    /** ends playback early, may be called from any thread */
+    void stop();
+    //==============================================================================
+    /** sets the read-ahead used by the next play()
+       @param frames frames decoded ahead of the playing position
+     */
+    void setReadAhead(size_t frames) {readAheadFrames = frames;}
+    /** @returns frames decoded ahead of the playing position */
+    size_t getReadAhead() const {return readAheadFrames;}
+    /** @returns number of times the source ran dry during the last play() */
+    uint64_t getUnderrunCount() const {return underrunCount;}
+    /** reports underruns to meter as well, nullptr for none
+       @param meter meter owned by the caller, such as SynthEngine::getLoadMeter()
+     */
+    void setLoadMeter(LoadMeter *meter) {loadMeter = meter;}
+    /** @returns frames handed to OpenAL during the last play() */
+    uint64_t getFramesQueued() const {return framesQueued;}
+    //==============================================================================
+    /** default read-ahead, about one and a half seconds at 44.1kHz */
+    static constexpr size_t defaultReadAheadFrames = 1 << 16;
+    /** default frames per block */
+    static constexpr size_t defaultChunkFrames = 4096;
+
+private:
+    /** decode thread loop */
+    void decode();
+
+    /** a decoded block waiting to be played */
+    struct Block
+    {
+        /// index into storage
+        size_t index;
+        /// frames decoded, 0 when a failed read hands the block straight back
+        size_t frames;
+    };
+
+private:
+    /// reader for the playing file, used only by the decode thread while playing
+    WavCodec wavReadWrite;
+    /// playing file
+    FILE *file = nullptr;
+    /// frames of the data chunk not yet decoded
+    uint64_t framesRemaining = 0;
+    /// channels per frame
+    int numChannels = 0;
+    /// decode thread
+    std::thread decoder;
+    /// contiguous 16 bit storage for all blocks
+    std::vector<int16_t> storage;
+    /// accounts storage
+    MemoryAccounting::Tracker storageMemory {MemoryAccounting::Category::ioBuffers};
+    /// blocks ready to be decoded into
+    std::unique_ptr<SpscQueue<size_t>> freeBlocks;
+    /// blocks ready to be played
+    std::unique_ptr<SpscQueue<Block>> fullBlocks;
+    /// frames decoded ahead
+    size_t readAheadFrames;
+    /// frames in one block
+    size_t chunkFrames;
+    /// source ran dry before the end of the file
+    uint64_t underrunCount = 0;
+    /// also told about underruns, nullptr for none
+    LoadMeter *loadMeter = nullptr;
+    /// frames uploaded to OpenAL
+    uint64_t framesQueued = 0;
+    /// tells both threads to finish
+    std::atomic<bool> stopping {false};
+    /// set by the decode thread after its last block
+    std::atomic<bool> decodeFinished {false};
+};
+#endif /* StreamingFilePlayer_hpp */
@@ -0,0 +1,264 @@
+//
+//  StressHarness.cpp
+//  KarplusStrongTest
+//
+#include "StressHarness.hpp"
+#include "SynthEngine.hpp"
+#include "ThreadPool.hpp"
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <random>
+#include <thread>
+#if defined _WIN32 || defined _WIN64
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#elif defined __APPLE__
+#include <mach/mach.h>
+#elif defined __linux__
+#include <unistd.h>
+#endif
+//==============================================================================
+namespace
+{
+    typedef std::uniform_real_distribution<float> PitchRange;
+
+    /** @returns a random pitch between E2 and E5 */
+    float randomPitch(std::mt19937 &random)
+    {
+        return PitchRange(82.41f, 659.26f)(random);
+    }
+
+    /** sizes the engine for voices and plucks every one of them
+       @returns false if the voices do not fit in the memory budget
+     */
+    bool fillEngine(SynthEngine &engine, const StressHarness::Config &config, int voices, std::mt19937 &random)
+    {
+        if (!engine.prepare(config.sampleRate, config.blockSize, voices))
+        {
+            return false;
+        }
+        for (int voice = 0; voice < voices; ++voice)
+        {
+            engine.noteOn(randomPitch(random), 1.0f / voices, 0.0f, 60.0f);
+        }
+        return true;
+    }
+
+    /** @returns config thread count with 0 resolved to the hardware */
+    int resolveThreads(int threads)
+    {
+        return threads > 0 ? threads : std::max(1, (int)std::thread::hardware_concurrency());
+    }
+}
+//==============================================================================
+std::vector<StressHarness::Result> StressHarness::findMaxPolyphony(const Config &config, FILE *log)
+{
+    std::vector<Result> results;
+    std::vector<float> left(config.blockSize), right(config.blockSize);
+    std::mt19937 random(config.seed);
+    const int step = std::max(1, config.voiceStep);
+
+    for (int threadCount : config.threadCounts)
+    {
+        const int threads = resolveThreads(threadCount);
+        std::unique_ptr<ThreadPool> pool(threads > 1 ? new ThreadPool(threads) : nullptr);
+        if (pool)
+        {
+            // measured as a real time render would run, without locks per block
+            pool->setSpinWaiting(true);
+        }
+        SynthEngine engine;
+        engine.setThreadPool(pool.get());
+
+        // 99th percentile load of a number of voices, voices over the memory budget miss the deadline
+        auto measure = [&](int voices)
+        {
+            if (!fillEngine(engine, config, voices, random))
+            {
+                fprintf(log, "threads %3d  voices %5d  over the memory budget\n", threads, voices);
+                return std::numeric_limits<double>::infinity();
+            }
+            for (int block = 0; block < 16; ++block)
+            {
+                engine.renderBlock(left.data(), right.data(), config.blockSize);
+            }
+            engine.getLoadMeter().prepare(config.sampleRate, config.blocksPerStep);
+            for (int block = 0; block < config.blocksPerStep; ++block)
+            {
+                engine.renderBlock(left.data(), right.data(), config.blockSize);
+            }
+            const double load = engine.getLoadMeter().getStats().p99Load;
+            fprintf(log, "threads %3d  voices %5d  p99 load %6.1f%%\n", threads, voices, 100.0 * load);
+            return load;
+        };
+
+        Result result;
+        result.threads = threads;
+
+        // double the voices until the deadline is missed, then bisect down to one step
+        int below = 0;
+        int above = config.maxVoices + step;
+        for (int voices = step; voices <= config.maxVoices; voices *= 2)
+        {
+            const double load = measure(voices);
+            if (load >= config.deadlineLoad)
+            {
+                above = voices;
+                break;
+            }
+            below = voices;
+            result.p99Load = load;
+        }
+        while (above < config.maxVoices + step && above - below > step)
+        {
+            const int voices = below + std::max(step, (above - below) / 2 / step * step);
+            const double load = measure(voices);
+            if (load >= config.deadlineLoad)
+            {
+                above = voices;
+            }
+            else
+            {
+                below = voices;
+                result.p99Load = load;
+            }
+        }
+
+        result.maxVoices = below;
+        result.voicesPerThread = below / (double)threads;
+        results.push_back(result);
+    }
+    return results;
+}
+//==============================================================================
+StressHarness::SoakResult StressHarness::soak(const Config &config, int voices, int threads, FILE *log)
+{
+    typedef std::chrono::steady_clock Clock;
+
+    SoakResult result;
+    result.threads = threads = resolveThreads(threads);
+    result.voices = voices = std::max(1, voices);
+
+    std::unique_ptr<ThreadPool> pool(threads > 1 ? new ThreadPool(threads) : nullptr);
+    if (pool)
+    {
+        pool->setSpinWaiting(true);
+    }
+    std::mt19937 random(config.seed);
+    std::vector<float> left(config.blockSize), right(config.blockSize);
+
+    SynthEngine engine;
+    engine.setThreadPool(pool.get());
+    if (!fillEngine(engine, config, voices, random))
+    {
+        fprintf(log, "soak: %d voices are over the memory budget\n", voices);
+        return result;
+    }
+
+    const double blockSeconds = config.blockSize / (double)config.sampleRate;
+    const uint64_t reportBlocks = std::max<uint64_t>(1, (uint64_t)(config.reportSeconds / blockSeconds));
+    const uint64_t totalBlocks = (uint64_t)(config.soakSeconds / blockSeconds);
+    LoadMeter &meter = engine.getLoadMeter();
+    meter.prepare(config.sampleRate, (size_t)reportBlocks);
+
+    fprintf(log, "soak: %d voices on %d threads for %.0f s\n", voices, threads, config.soakSeconds);
+    result.startBytes = getResidentBytes();
+
+    // blocks are paced at real time, a block that finishes late is not waited for
+    const auto blockDuration = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(blockSeconds));
+    Clock::time_point deadline = Clock::now();
+    bool firstInterval = true;
+
+    for (uint64_t block = 1; block <= totalBlocks; ++block)
+    {
+        engine.noteOn(randomPitch(random), 1.0f / voices, 0.0f, 60.0f);
+        engine.renderBlock(left.data(), right.data(), config.blockSize);
+
+        if (block % reportBlocks == 0 || block == totalBlocks)
+        {
+            const LoadMeter::Stats stats = meter.getStats();
+            const size_t bytes = getResidentBytes();
+            fprintf(log, "%8.1f s  load avg %5.1f%%  p99 %5.1f%%  max %5.1f%%  late %llu  resident %zu KB\n",
+                    block * blockSeconds, 100.0 * stats.avgLoad, 100.0 * stats.p99Load, 100.0 * stats.maxLoad,
+                    (unsigned long long)stats.lateBlocks, bytes / 1024);
+            if (firstInterval)
+            {
+                result.firstAvgLoad = stats.avgLoad;
+                firstInterval = false;
+            }
+            result.lastAvgLoad = stats.avgLoad;
+            result.maxLoad = std::max(result.maxLoad, stats.maxLoad);
+            result.lateBlocks += stats.lateBlocks;
+            result.blocks = block;
+            meter.reset();
+        }
+
+        deadline += blockDuration;
+        std::this_thread::sleep_until(deadline);
+    }
+    result.endBytes = getResidentBytes();
+    return result;
+}
+//==============================================================================
+void StressHarness::run(const Config &config, FILE *log)
+{
+    const std::vector<Result> results = findMaxPolyphony(config, log);
+
+    fprintf(log, "\n%8s %10s %12s %10s\n", "threads", "voices", "per thread", "p99 load");
+    const Result *best = nullptr;
+    for (const Result &result : results)
+    {
+        fprintf(log, "%8d %10d %12.1f %9.1f%%\n", result.threads, result.maxVoices,
+                result.voicesPerThread, 100.0 * result.p99Load);
+        if (!best || result.maxVoices > best->maxVoices)
+        {
+            best = &result;
+        }
+    }
+
+    if (!best || best->maxVoices == 0 || config.soakSeconds <= 0.0)
+    {
+        return;
+    }
+    const SoakResult soaked = soak(config, (int)(config.soakFraction * best->maxVoices), best->threads, log);
+    fprintf(log, "soak: %llu blocks, %llu late, max load %.1f%%, avg load drift %+.1f%%",
+            (unsigned long long)soaked.blocks, (unsigned long long)soaked.lateBlocks,
+            100.0 * soaked.maxLoad, 100.0 * (soaked.lastAvgLoad - soaked.firstAvgLoad));
+    if (soaked.startBytes)
+    {
+        fprintf(log, ", resident %+lld KB", ((long long)soaked.endBytes - (long long)soaked.startBytes) / 1024);
+    }
+    fprintf(log, "\n");
+}
+//==============================================================================
+size_t StressHarness::getResidentBytes()
+{
+#if defined _WIN32 || defined _WIN64
+    PROCESS_MEMORY_COUNTERS counters;
+    return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? counters.WorkingSetSize : 0;
+#elif defined __APPLE__
+    mach_task_basic_info_data_t info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS)
+    {
+        return 0;
+    }
+    return info.resident_size;
+#elif defined __linux__
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if (!statm)
+    {
+        return 0;
+    }
+    unsigned long pages = 0, residentPages = 0;
+    const int found = fscanf(statm, "%lu %lu", &pages, &residentPages);
+    fclose(statm);
+    return (found == 2) ? residentPages * (size_t)sysconf(_SC_PAGESIZE) : 0;
+#else
+    return 0;
+#endif
+}
+//EOF
@@ -0,0 +1,105 @@
+/*
+ *  StressHarness: maximum polyphony search and soak run of the SynthEngine
+ */
+//==============================================================================
+#ifndef StressHarness_hpp
+#define StressHarness_hpp
+//==============================================================================
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+//==============================================================================
+/*!
+   @class StressHarness
+   @brief finds how many voices render in real time and soaks the engine
+   below that limit.
+
+   @discussion For each thread count, voices with random pitches are added in
+   steps until the 99th percentile block load from the engine's LoadMeter
+   reaches the deadline. The last step that stayed under it is the maximum
+   sustainable polyphony, also given per thread.
+
+   The soak then runs the best thread count at a fraction of its maximum
+   for a wall clock duration, pacing blocks at real time and retriggering a
+   voice every block. It prints the load of every interval so drift and
+   tail spikes show up, with the resident memory of the process to show
+   leaks on platforms that report it.
+ */
+//==============================================================================
+class StressHarness
+{
+public:
+    /** what to run */
+    struct Config
+    {
+        /// rendering sample rate
+        float sampleRate = 48000.0f;
+        /// frames per block
+        int blockSize = 256;
+        /// thread counts to search, 0 is the number of hardware threads
+        std::vector<int> threadCounts {1, 2, 4, 0};
+        /// voices added per search step
+        int voiceStep = 16;
+        /// search stops here even if the deadline is still met
+        int maxVoices = 4096;
+        /// blocks measured per search step
+        int blocksPerStep = 400;
+        /// 99th percentile load counted as missing the deadline
+        double deadlineLoad = 1.0;
+        /// fraction of the maximum polyphony used by the soak
+        double soakFraction = 0.8;
+        /// wall clock length of the soak, 0 skips it
+        double soakSeconds = 60.0;
+        /// seconds between soak reports
+        double reportSeconds = 10.0;
+        /// seed for the pitches
+        uint32_t seed = 1;
+    };
+
+    /** search result of one thread count */
+    struct Result
+    {
+        int threads = 0;
+        /// most voices that met the deadline
+        int maxVoices = 0;
+        /// maxVoices / threads
+        double voicesPerThread = 0.0;
+        /// 99th percentile load at maxVoices
+        double p99Load = 0.0;
+    };
+
+    /** figures of a soak */
+    struct SoakResult
+    {
+        int threads = 0;
+        int voices = 0;
+        uint64_t blocks = 0;
+        uint64_t lateBlocks = 0;
+        /// mean load of the first and last report interval
+        double firstAvgLoad = 0.0, lastAvgLoad = 0.0;
+        /// highest load of any block
+        double maxLoad = 0.0;
+        /// resident memory at the start and end, 0 when unknown
+        size_t startBytes = 0, endBytes = 0;
+    };
+    //==============================================================================
+    /** searches every thread count of config
+       @returns one result per thread count
+     */
+    static std::vector<Result> findMaxPolyphony(const Config &config, FILE *log = stderr);
+
+    /** soaks the engine
+       @param voices polyphony to hold
+       @param threads threads to render with
+     */
+    static SoakResult soak(const Config &config, int voices, int threads, FILE *log = stderr);
+
+    /** searches, then soaks the thread count with the most voices at
+       config.soakFraction of them, printing both
+     */
+    static void run(const Config &config, FILE *log = stderr);
+
+    /** @returns resident memory of this process in bytes, 0 when unknown */
+    static size_t getResidentBytes();
+};
+#endif /* StressHarness_hpp */
@@ -0,0 +1,342 @@
+//
+//  SynthEngine.cpp
+//  KarplusStrongTest
+//
+#include "SynthEngine.hpp"
+#include "RealtimeGuard.hpp"
+#include "RealtimeSetup.hpp"
+#include "ThreadPool.hpp"
+#include "Trace.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <new>
+//==============================================================================
+SynthEngine::SynthEngine()
+{
+    renderTask = [this](size_t task)
+    {
+        RealtimeGuard::ScopedRealtime realtime;
+        KS_TRACE_SCOPE("renderVoices");
+        const size_t numTasks = (size_t)threadPool->getNumThreads();
+        const size_t perTask = (voices.size() + numTasks - 1) / numTasks;
+        renderVoices(task * perTask, std::min(voices.size(), (task + 1) * perTask), renderFrames);
+    };
+}
+
+SynthEngine::~SynthEngine()
+{
+}
+//==============================================================================
+bool SynthEngine::prepare(float rate, int blockFrames, int maxVoices, float minFrequency)
+{
+    sampleRate = rate;
+    maxBlockFrames = blockFrames;
+
+    try
+    {
+        voices.resize(maxVoices);
+        for (Voice &voice : voices)
+        {
+            if (!voice.note)
+            {
+                voice.note.reset(new PluckedNote(false));
+            }
+            voice.note->setSampleRate(sampleRate);
+            voice.note->prepareToPlay(sampleRate, minFrequency);
+            voice.samplesRemaining = 0;
+        }
+
+        voiceBuffer.setCategory(MemoryAccounting::Category::workBuffers);
+        voiceBuffer.setSize(maxVoices, maxBlockFrames);
+        voiceOutputs.assign(maxVoices, nullptr);
+        mixBus.prepare(maxVoices, maxBlockFrames);
+        // every copy sized now so publishing never allocates
+        state.forEach([maxVoices](State &copy)
+        {
+            copy = State();
+            copy.voices.assign(maxVoices, VoiceState());
+        });
+    }
+    catch (const std::bad_alloc&)
+    {
+        printf("SynthEngine: %d voices do not fit in memory or its budget\n", maxVoices);
+        // no voices render silence, mixBus is never asked for more than it holds
+        voices.clear();
+        voiceBuffer.release();
+        voiceOutputs.clear();
+        state.forEach([](State &copy) {copy = State();});
+        loadMeter.prepare(sampleRate);
+        return false;
+    }
+    blocksRendered = 0;
+    loadMeter.prepare(sampleRate);
+    return true;
+}
+//==============================================================================
+int SynthEngine::noteOn(float frequency, float gain, float pan, float noteLength)
+{
+    if (voices.empty())
+    {
+        return -1;
+    }
+
+    // a free voice, or the one that has been sounding longest
+    int chosen = 0;
+    for (int i = 0; i < (int)voices.size(); ++i)
+    {
+        if (voices[i].samplesRemaining == 0)
+        {
+            chosen = i;
+            break;
+        }
+        if (voices[i].startOrder < voices[chosen].startOrder)
+        {
+            chosen = i;
+        }
+    }
+
+    Voice &voice = voices[chosen];
+    voice.note->setFrequency(frequency);
+    voice.note->setNoteLength(noteLength);
+    voice.note->pluck();
+    voice.samplesRemaining = (int64_t)(noteLength * sampleRate);
+    voice.startOrder = ++noteCounter;
+    voice.noteId = 0;
+    voice.frequency = frequency;
+    voice.noteLength = noteLength;
+    voice.gain = gain;
+    voice.pan = pan;
+    mixBus.setVoice(chosen, gain, pan);
+    return chosen;
+}
+
+void SynthEngine::allNotesOff()
+{
+    for (Voice &voice : voices)
+    {
+        voice.samplesRemaining = 0;
+    }
+}
+//==============================================================================
+void SynthEngine::renderBlock(float *left, float *right, int numFrames)
+{
+    LoadMeter::ScopedBlock timing(loadMeter, numFrames);
+    RealtimeGuard::ScopedRealtime realtime;
+    KS_TRACE_SCOPE("renderBlock");
+
+    processEvents();
+    if (threadPool && threadPool->getNumThreads() > 1 && voices.size() > 1)
+    {
+        renderFrames = numFrames;
+        threadPool->parallelFor((size_t)threadPool->getNumThreads(), renderTask);
+    }
+    else
+    {
+        renderVoices(0, voices.size(), numFrames);
+    }
+    mixBus.process(voiceOutputs.data(), (int)voices.size(), left, right, numFrames);
+    ++blocksRendered;
+    publishState();
+}
+
+void SynthEngine::renderVoices(size_t begin, size_t end, int numFrames)
+{
+    for (size_t i = begin; i < end; ++i)
+    {
+        Voice &voice = voices[i];
+        if (voice.samplesRemaining == 0)
+        {
+            voiceOutputs[i] = nullptr;
+            continue;
+        }
+        float *output = voiceBuffer.getChannel((int)i);
+        voice.note->processBlock(output, numFrames);
+        voiceOutputs[i] = output;
+        voice.samplesRemaining = (voice.samplesRemaining > numFrames) ? voice.samplesRemaining - numFrames : 0;
+    }
+}
+//==============================================================================
+bool SynthEngine::postNoteOn(float frequency, float gain, float pan, float noteLength, uint32_t noteId)
+{
+    const Event event = {Event::Type::noteOn, Parameter::frequency, -1, noteId, {frequency, gain, pan, noteLength}};
+    if (!events.push(event))
+    {
+        ++droppedEvents;
+        return false;
+    }
+    return true;
+}
+
+bool SynthEngine::postAllNotesOff()
+{
+    const Event event = {Event::Type::allNotesOff, Parameter::frequency, -1, 0, {0.0f, 0.0f, 0.0f, 0.0f}};
+    if (!events.push(event))
+    {
+        ++droppedEvents;
+        return false;
+    }
+    return true;
+}
+
+bool SynthEngine::postParameter(Parameter parameter, float value, int voice)
+{
+    const Event event = {Event::Type::parameter, parameter, voice, 0, {value, 0.0f, 0.0f, 0.0f}};
+    if (!events.push(event))
+    {
+        ++droppedEvents;
+        return false;
+    }
+    return true;
+}
+
+void SynthEngine::processEvents()
+{
+    Event event;
+    while (events.pop(event))
+    {
+        switch (event.type)
+        {
+            case Event::Type::noteOn:
+            {
+                const int voice = noteOn(event.values[0], event.values[1], event.values[2], event.values[3]);
+                if (voice >= 0)
+                {
+                    voices[voice].noteId = event.noteId;
+                }
+                break;
+            }
+            case Event::Type::allNotesOff:
+                allNotesOff();
+                break;
+            case Event::Type::parameter:
+                if (event.parameter == Parameter::masterGain)
+                {
+                    mixBus.setMasterGain(event.values[0]);
+                }
+                else if (event.voice < 0)
+                {
+                    for (int voice = 0; voice < (int)voices.size(); ++voice)
+                    {
+                        applyParameter(voice, event.parameter, event.values[0]);
+                    }
+                }
+                else if (event.voice < (int)voices.size())
+                {
+                    applyParameter(event.voice, event.parameter, event.values[0]);
+                }
+                break;
+        }
+    }
+}
+
+void SynthEngine::applyParameter(int index, Parameter parameter, float value)
+{
+    Voice &voice = voices[index];
+    switch (parameter)
+    {
+        case Parameter::frequency:
+            voice.frequency = value;
+            voice.note->setFrequency(value);
+            break;
+        case Parameter::noteLength:
+            // a sounding note keeps the time it has already rung
+            if (voice.samplesRemaining > 0)
+            {
+                const int64_t elapsed = (int64_t)(voice.noteLength * sampleRate) - voice.samplesRemaining;
+                voice.samplesRemaining = std::max<int64_t>(1, (int64_t)(value * sampleRate) - elapsed);
+            }
+            voice.noteLength = value;
+            voice.note->setNoteLength(value);
+            break;
+        case Parameter::gain:
+            voice.gain = value;
+            mixBus.setVoiceGain(index, value);
+            break;
+        case Parameter::pan:
+            voice.pan = value;
+            mixBus.setVoicePan(index, value);
+            break;
+        case Parameter::glideTime:
+            voice.note->setGlideTime(value);
+            break;
+        case Parameter::masterGain:
+            mixBus.setMasterGain(value);
+            break;
+    }
+}
+
+void SynthEngine::publishState()
+{
+    State &snapshot = state.getWriteBuffer();
+    snapshot.blocks = blocksRendered;
+    snapshot.activeVoices = 0;
+    snapshot.masterGain = mixBus.getMasterGain();
+    snapshot.droppedEvents = droppedEvents.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < voices.size() && i < snapshot.voices.size(); ++i)
+    {
+        const Voice &voice = voices[i];
+        VoiceState &voiceState = snapshot.voices[i];
+        voiceState.noteId = voice.noteId;
+        voiceState.active = (voice.samplesRemaining > 0);
+        voiceState.frequency = voice.frequency;
+        voiceState.noteLength = voice.noteLength;
+        voiceState.gain = voice.gain;
+        voiceState.pan = voice.pan;
+        snapshot.activeVoices += voiceState.active ? 1 : 0;
+    }
+    state.publish();
+}
+//==============================================================================
+PluckedNote* SynthEngine::getVoice(int voice)
+{
+    return (voice >= 0 && voice < (int)voices.size()) ? voices[voice].note.get() : nullptr;
+}
+
+const float* SynthEngine::getVoiceOutput(int voice) const
+{
+    return (voice >= 0 && voice < (int)voiceOutputs.size()) ? voiceOutputs[voice] : nullptr;
+}
+
+size_t SynthEngine::getVoiceAllocatedBytes(int voice) const
+{
+    return (voice >= 0 && voice < (int)voices.size() && voices[voice].note) ? voices[voice].note->getAllocatedBytes() : 0;
+}
+
+size_t SynthEngine::getAllocatedBytes() const
+{
+    size_t bytes = voices.capacity() * sizeof(Voice) + voiceBuffer.getAllocatedBytes() +
+                   voiceOutputs.capacity() * sizeof(const float*) + mixBus.getAllocatedBytes();
+    for (const Voice &voice : voices)
+    {
+        bytes += voice.note ? sizeof(PluckedNote) + voice.note->getAllocatedBytes() : 0;
+    }
+    return bytes;
+}
+
+bool SynthEngine::lockMemory(bool hugePages) const
+{
+    bool locked = RealtimeSetup::lockMemory(voices.data(), voices.size() * sizeof(Voice));
+    for (const Voice &voice : voices)
+    {
+        locked &= RealtimeSetup::lockMemory(voice.note.get(), sizeof(PluckedNote));
+        locked &= voice.note->lockMemory(hugePages);
+    }
+    locked &= voiceBuffer.lockMemory(hugePages);
+    locked &= RealtimeSetup::lockMemory(voiceOutputs.data(), voiceOutputs.size() * sizeof(const float*));
+    locked &= mixBus.lockMemory(hugePages);
+    return locked;
+}
+
+int SynthEngine::getNumActiveVoices() const
+{
+    int active = 0;
+    for (const Voice &voice : voices)
+    {
+        if (voice.samplesRemaining > 0)
+        {
+            ++active;
+        }
+    }
+    return active;
+}
+//EOF
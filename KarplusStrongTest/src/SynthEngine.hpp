@@ -0,0 +1,250 @@
+/*
+ *  SynthEngine: a pool of plucked string voices rendered in blocks
+ */
+//==============================================================================
+#ifndef SynthEngine_hpp
+#define SynthEngine_hpp
+//==============================================================================
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "../PluckedNote.h"
+#include "AudioBuffer.hpp"
+#include "LoadMeter.hpp"
+#include "MixBus.hpp"
+#include "SnapshotBuffer.hpp"
+#include "SpscQueue.hpp"
+//==============================================================================
+class ThreadPool;
+//==============================================================================
+/*!
+   @class SynthEngine
+   @brief renders polyphonic plucked notes block by block into stereo.
+
+   @discussion Every voice is a PluckedNote running its delay line engine.
+   A block is rendered by processing each sounding voice into its own row of
+   a voice buffer and mixing the rows through a MixBus.
+
+   - prepare() allocates the voices, their delay lines and all buffers
+   - noteOn() plucks a free voice, stealing the oldest when all are busy
+   - renderBlock() for every output block, no allocation happens here
+
+   With a ThreadPool set, the voices are split into one contiguous group per
+   thread and rendered in parallel; each voice writes only its own row, so
+   the mix is identical to rendering on one thread. A pool that sleeps
+   between jobs is locked every block, which is fine offline; for real time
+   rendering switch the pool to spin waiting while rendering, see
+   ThreadPool::setSpinWaiting().
+
+   A voice is freed once its note has rung for its note length (T60), at
+   which point it has decayed by 60 dB. Every renderBlock() is timed by the
+   engine's LoadMeter and counts as real time for RealtimeGuard.
+
+   noteOn(), allNotesOff(), getVoice() and the MixBus setters act at once and
+   must only be called from the rendering thread or between blocks. Another
+   thread, such as a UI or network control thread, uses the post functions
+   instead: they push onto a lock-free queue that renderBlock() drains before
+   rendering, and return false rather than block when it is full. After each
+   block the engine publishes a State snapshot that readState() returns
+   without locking or tearing. There is one queue and one snapshot, so one
+   control thread at a time may post and read.
+ */
+//==============================================================================
+class SynthEngine
+{
+public:
+    SynthEngine();
+    ~SynthEngine();
+    //==============================================================================
+    /** allocates voices and buffers
+       @param sampleRate rendering sample rate
+       @param maxBlockFrames most frames passed to renderBlock()
+       @param maxVoices polyphony
+       @param minFrequency lowest note the voices must reach
+       @returns false if the allocation failed or broke an enforced
+       MemoryAccounting budget, the engine then has no voices
+     */
+    bool prepare(float sampleRate, int maxBlockFrames, int maxVoices = 32, float minFrequency = 20.0f);
+
+    /** starts a note
+       @param frequency pitch in Hz
+       @param gain linear gain
+       @param pan -1 for left, 0 for centre, 1 for right
+       @param noteLength seconds for the note to decay by 60 dB
+       @returns the voice used, -1 if prepare() failed and there are no voices
+     */
+    int noteOn(float frequency, float gain = 1.0f, float pan = 0.0f, float noteLength = 2.0f);
+
+    /** silences every voice */
+    void allNotesOff();
+
+    /** renders voices across a pool's threads
+       @param pool pool owned by the caller, nullptr renders on the calling thread.
+       Only a spin waiting pool renders without locking.
+     */
+    void setThreadPool(ThreadPool *pool) {threadPool = pool;}
+
+    /** renders one block of every sounding voice
+       @param left output of numFrames samples
+       @param right output of numFrames samples
+       @param numFrames at most maxBlockFrames
+     */
+    void renderBlock(float *left, float *right, int numFrames);
+    //==============================================================================
+    /** @returns voice for direct control such as retuning, nullptr if out of range */
+    PluckedNote* getVoice(int voice);
+    /** @returns what the voice rendered in the last block, nullptr if it was idle */
+    const float* getVoiceOutput(int voice) const;
+    /** @returns the bus the voices are mixed through */
+    MixBus& getMixBus() {return mixBus;}
+    /** @returns voices currently sounding */
+    int getNumActiveVoices() const;
+    /** @returns polyphony */
+    int getMaxVoices() const {return (int)voices.size();}
+    /** @returns rendering sample rate */
+    float getSampleRate() const {return sampleRate;}
+    /** @returns largest block renderBlock() accepts */
+    int getMaxBlockFrames() const {return maxBlockFrames;}
+    /** @returns the meter timing renderBlock() */
+    LoadMeter& getLoadMeter() {return loadMeter;}
+    /** @returns bytes held by one voice's note, 0 if out of range */
+    size_t getVoiceAllocatedBytes(int voice) const;
+    /** @returns bytes held by every voice and the engine's buffers */
+    size_t getAllocatedBytes() const;
+    /** keeps the voice pool, delay lines and buffers resident, after prepare()
+       @param hugePages advise transparent huge pages first
+       @returns true if all were locked
+     */
+    bool lockMemory(bool hugePages = false) const;
+    //==============================================================================
+    /** what a control thread can change */
+    enum class Parameter
+    {
+        frequency,      ///< pitch in Hz, glides over the glide time
+        noteLength,     ///< T60 in seconds, also how long the voice stays busy
+        gain,           ///< linear voice gain
+        pan,            ///< -1 for left, 0 for centre, 1 for right
+        glideTime,      ///< seconds for frequency and note length changes to settle
+        masterGain      ///< linear gain of the mix, voice is ignored
+    };
+
+    /** a voice as of the last rendered block */
+    struct VoiceState
+    {
+        /// tag passed to postNoteOn(), 0 for notes started with noteOn()
+        uint32_t noteId = 0;
+        bool active = false;
+        float frequency = 0.0f;
+        float noteLength = 0.0f;
+        float gain = 0.0f;
+        float pan = 0.0f;
+    };
+
+    /** the engine as of the last rendered block */
+    struct State
+    {
+        /// blocks rendered since prepare()
+        uint64_t blocks = 0;
+        int activeVoices = 0;
+        float masterGain = 1.0f;
+        /// events dropped because the queue was full
+        uint64_t droppedEvents = 0;
+        /// one entry per voice
+        std::vector<VoiceState> voices;
+    };
+
+    /** queues a noteOn() for the next block, control thread only
+       @param noteId tag reported in VoiceState so the voice can be found later
+       @returns false if the queue is full
+     */
+    bool postNoteOn(float frequency, float gain = 1.0f, float pan = 0.0f, float noteLength = 2.0f, uint32_t noteId = 0);
+    /** queues an allNotesOff() for the next block, control thread only
+       @returns false if the queue is full
+     */
+    bool postAllNotesOff();
+    /** queues a parameter change for the next block, control thread only
+       @param voice voice index, -1 for every voice
+       @returns false if the queue is full
+     */
+    bool postParameter(Parameter parameter, float value, int voice = -1);
+    /** @returns the latest snapshot, valid until the next call, control thread only */
+    const State& readState() {return state.read();}
+
+    /// events the queue holds between blocks
+    static constexpr size_t eventQueueSize = 1024;
+
+private:
+    /** renders voices [begin, end) into their rows of voiceBuffer */
+    void renderVoices(size_t begin, size_t end, int numFrames);
+    /** applies every queued event, at the start of renderBlock() */
+    void processEvents();
+    /** changes a parameter of one voice */
+    void applyParameter(int voice, Parameter parameter, float value);
+    /** fills and publishes the State snapshot, at the end of renderBlock() */
+    void publishState();
+
+private:
+    /** a pool entry */
+    struct Voice
+    {
+        /// the string model
+        std::unique_ptr<PluckedNote> note;
+        /// samples left before the voice is freed, 0 when idle
+        int64_t samplesRemaining = 0;
+        /// noteOn() count when the voice started, for stealing the oldest
+        uint64_t startOrder = 0;
+        /// settings kept for the State snapshot
+        uint32_t noteId = 0;
+        float frequency = 0.0f;
+        float noteLength = 0.0f;
+        float gain = 1.0f;
+        float pan = 0.0f;
+    };
+
+    /** a posted change */
+    struct Event
+    {
+        enum class Type {noteOn, allNotesOff, parameter};
+        Type type;
+        Parameter parameter;
+        int voice;
+        uint32_t noteId;
+        /// noteOn: frequency, gain, pan and note length; parameter: the value first
+        float values[4];
+    };
+
+private:
+    /// voice pool
+    std::vector<Voice> voices;
+    /// one row of output per voice
+    AudioBuffer voiceBuffer;
+    /// rows of sounding voices for the mix bus, nullptr for idle voices
+    std::vector<const float*> voiceOutputs;
+    /// stereo sum
+    MixBus mixBus;
+    /// pool voices are rendered on, nullptr for the calling thread
+    ThreadPool *threadPool = nullptr;
+    /// task of the pool, made once so renderBlock() does not allocate
+    std::function<void(size_t)> renderTask;
+    /// frames of the block the pool is rendering
+    int renderFrames = 0;
+    /// render time of every block
+    LoadMeter loadMeter;
+    /// rendering sample rate
+    float sampleRate = 48000.0f;
+    /// largest block
+    int maxBlockFrames = 0;
+    /// number of notes started
+    uint64_t noteCounter = 0;
+    /// changes posted by the control thread
+    SpscQueue<Event> events {eventQueueSize};
+    /// posts that found the queue full, counted on the control thread
+    std::atomic<uint64_t> droppedEvents {0};
+    /// blocks rendered since prepare()
+    uint64_t blocksRendered = 0;
+    /// snapshot for the control thread
+    SnapshotBuffer<State> state;
+};
+#endif /* SynthEngine_hpp */
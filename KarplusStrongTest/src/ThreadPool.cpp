@@ -0,0 +1,170 @@
+//
+//  ThreadPool.cpp
+//  KarplusStrongTest
+//
+#include "ThreadPool.hpp"
+#include "Trace.hpp"
+#if defined __SSE2__ || defined _M_X64 || (defined _M_IX86_FP && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#endif
+//==============================================================================
+namespace
+{
+    /** one step of a polling loop: a pause at first, then give the core to
+       any other thread that is ready, such as a worker sharing it
+     */
+    void relax(int &spins)
+    {
+        if (++spins < 64)
+        {
+#if defined __SSE2__ || defined _M_X64 || (defined _M_IX86_FP && _M_IX86_FP >= 2)
+            _mm_pause();
+#endif
+            return;
+        }
+        std::this_thread::yield();
+    }
+}
+//==============================================================================
+ThreadPool::ThreadPool(int numThreads)
+{
+    if (numThreads <= 0)
+    {
+        numThreads = (int)std::thread::hardware_concurrency();
+    }
+    for (int i = 1; i < numThreads; ++i)
+    {
+        workers.emplace_back(&ThreadPool::run, this);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping.store(true);
+    }
+    jobReady.notify_all();
+    for (std::thread &worker : workers)
+    {
+        worker.join();
+    }
+}
+//==============================================================================
+void ThreadPool::setSpinWaiting(bool shouldSpin)
+{
+    {
+        // stored under the lock so a worker going to sleep cannot miss it
+        std::lock_guard<std::mutex> guard(lock);
+        spinWaiting.store(shouldSpin);
+    }
+    jobReady.notify_all();
+}
+//==============================================================================
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)> &task)
+{
+    if (count == 0)
+    {
+        return;
+    }
+    if (workers.empty() || count == 1)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            task(i);
+        }
+        return;
+    }
+
+    // the job is published by the release of generation, every worker takes
+    // part in every job, so none can still be inside this one after return
+    currentTask = &task;
+    numTasks = count;
+    jobSpins = spinWaiting.load(std::memory_order_relaxed);
+    nextTask.store(0, std::memory_order_relaxed);
+    workersDone.store(0, std::memory_order_relaxed);
+    if (jobSpins)
+    {
+        generation.fetch_add(1, std::memory_order_release);
+    }
+    else
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            generation.fetch_add(1, std::memory_order_release);
+        }
+        jobReady.notify_all();
+    }
+
+    drainTasks();
+
+    if (jobSpins)
+    {
+        int spins = 0;
+        while (workersDone.load(std::memory_order_acquire) < workers.size())
+        {
+            relax(spins);
+        }
+    }
+    else
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        jobDone.wait(guard, [this] {return workersDone.load(std::memory_order_acquire) == workers.size();});
+    }
+    currentTask = nullptr;
+}
+//==============================================================================
+void ThreadPool::drainTasks()
+{
+    size_t index;
+    while ((index = nextTask.fetch_add(1)) < numTasks)
+    {
+        (*currentTask)(index);
+    }
+}
+//==============================================================================
+void ThreadPool::run()
+{
+    // named here so the trace ring is set up before the first job, not in it
+    KS_TRACE_THREAD("ThreadPool worker");
+    // jobs are counted from construction, a worker that starts late must
+    // still take part in any job published before it got here
+    uint64_t seenGeneration = 0;
+    while (true)
+    {
+        // wait for the next job, polling while spin waiting is on
+        int spins = 0;
+        while (spinWaiting.load(std::memory_order_relaxed) && !stopping.load(std::memory_order_relaxed) &&
+               generation.load(std::memory_order_acquire) == seenGeneration)
+        {
+            relax(spins);
+        }
+        if (generation.load(std::memory_order_acquire) == seenGeneration)
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            jobReady.wait(guard, [&]
+            {
+                return stopping.load() || spinWaiting.load() || generation.load(std::memory_order_acquire) != seenGeneration;
+            });
+        }
+        if (stopping.load())
+        {
+            return;
+        }
+
+        if (generation.load(std::memory_order_acquire) != seenGeneration)
+        {
+            ++seenGeneration;
+            drainTasks();
+
+            const bool callerSleeps = !jobSpins;
+            if (workersDone.fetch_add(1, std::memory_order_acq_rel) + 1 == workers.size() && callerSleeps)
+            {
+                // locked so the notification cannot fall between the caller's check and its wait
+                std::lock_guard<std::mutex> guard(lock);
+                jobDone.notify_all();
+            }
+        }
+    }
+}
+//EOF
@@ -0,0 +1,100 @@
+/*
+ *  ThreadPool: fixed set of worker threads for data parallel jobs
+ */
+//==============================================================================
+#ifndef ThreadPool_hpp
+#define ThreadPool_hpp
+//==============================================================================
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+//==============================================================================
+/*!
+   @class ThreadPool
+   @brief runs the tasks of a parallelFor() across persistent worker threads.
+
+   @discussion Threads are created once in the constructor. parallelFor()
+   hands out task indices through an atomic counter, the calling thread works
+   on tasks too, and the call returns once every worker has checked in for
+   the job. Only one parallelFor() may run at a time.
+
+   By default idle workers sleep on a condition variable, so parallelFor()
+   locks a mutex to wake them and to wait for them. With setSpinWaiting()
+   the workers instead poll for the next job and the caller polls for their
+   check in, so parallelFor() never locks or sleeps and can be called from
+   a real time thread. Every worker then keeps a core busy, so only enable
+   it around real time rendering and give the workers their own cores when
+   they run under SCHED_FIFO, see RealtimeSetup.
+ */
+//==============================================================================
+class ThreadPool
+{
+public:
+    /**
+       Constructor
+       @param numThreads total threads including the caller of parallelFor(),
+       0 uses the number of hardware threads
+     */
+    explicit ThreadPool(int numThreads = 0);
+    /** Destructor: stops and joins the workers */
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    //==============================================================================
+    /** runs task(0) ... task(numTasks - 1) and waits for them all
+       @param numTasks number of tasks
+       @param task function called once per task index
+     */
+    void parallelFor(size_t numTasks, const std::function<void(size_t)> &task);
+
+    /** switches between sleeping and spinning idle workers, see above. Not
+       to be called while a parallelFor() is running.
+     */
+    void setSpinWaiting(bool shouldSpin);
+    /** @returns true if idle workers spin */
+    bool isSpinWaiting() const {return spinWaiting.load(std::memory_order_relaxed);}
+
+    /** @returns threads available to parallelFor(), including the caller */
+    int getNumThreads() const {return (int)workers.size() + 1;}
+    /** @returns worker threads, not including the caller of parallelFor() */
+    std::vector<std::thread>& getWorkers() {return workers;}
+
+private:
+    /** worker thread loop */
+    void run();
+    /** takes task indices until there are none left */
+    void drainTasks();
+
+private:
+    /// worker threads
+    std::vector<std::thread> workers;
+    /// guards sleeping on jobReady and jobDone
+    std::mutex lock;
+    /// wakes sleeping workers for a new job
+    std::condition_variable jobReady;
+    /// wakes a sleeping caller when the job is done
+    std::condition_variable jobDone;
+    /// current job, published by generation
+    const std::function<void(size_t)> *currentTask = nullptr;
+    /// tasks in the current job
+    size_t numTasks = 0;
+    /// true if the caller of the current job polls rather than sleeps
+    bool jobSpins = false;
+    /// next task index to hand out
+    std::atomic<size_t> nextTask {0};
+    /// workers that have finished the current job
+    std::atomic<size_t> workersDone {0};
+    /// incremented for every job
+    std::atomic<uint64_t> generation {0};
+    /// idle workers poll instead of sleeping
+    std::atomic<bool> spinWaiting {false};
+    /// set to stop the workers
+    std::atomic<bool> stopping {false};
+};
+#endif /* ThreadPool_hpp */
@@ -0,0 +1,137 @@
+//
+//  Trace.cpp
+//  KarplusStrongTest
+//
+#include "Trace.hpp"
+#include "RealtimeGuard.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+//==============================================================================
+namespace
+{
+    /** the ring of one thread */
+    struct ThreadRing
+    {
+        std::unique_ptr<Trace::Event[]> events {new Trace::Event[Trace::eventsPerThread]};
+        /// events ever recorded, written only by the owning thread
+        std::atomic<uint64_t> count {0};
+        int threadId = 0;
+        std::string name;
+    };
+
+    /** rings outlive their threads so zones of finished threads are exported */
+    struct Registry
+    {
+        std::mutex lock;
+        std::vector<std::shared_ptr<ThreadRing>> rings;
+    };
+
+    Registry& getRegistry()
+    {
+        static Registry registry;
+        return registry;
+    }
+
+    thread_local ThreadRing *localRing = nullptr;
+
+    ThreadRing& getLocalRing()
+    {
+        if (!localRing)
+        {
+            // once per thread, the only allocation and lock tracing makes
+            RealtimeGuard::ScopedAllow allow;
+            Registry &registry = getRegistry();
+            std::shared_ptr<ThreadRing> ring = std::make_shared<ThreadRing>();
+            std::lock_guard<std::mutex> guard(registry.lock);
+            ring->threadId = (int)registry.rings.size() + 1;
+            registry.rings.push_back(ring);
+            localRing = ring.get();
+        }
+        return *localRing;
+    }
+}
+//==============================================================================
+int64_t Trace::now()
+{
+    static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void Trace::record(const char *name, int64_t start, int64_t duration)
+{
+    ThreadRing &ring = getLocalRing();
+    const uint64_t count = ring.count.load(std::memory_order_relaxed);
+    Event &event = ring.events[count & (eventsPerThread - 1)];
+    event.name = name;
+    event.start = start;
+    event.duration = duration;
+    ring.count.store(count + 1, std::memory_order_release);
+}
+
+void Trace::setThreadName(const char *name)
+{
+    ThreadRing &ring = getLocalRing();
+    std::lock_guard<std::mutex> guard(getRegistry().lock);
+    ring.name = name;
+}
+//==============================================================================
+bool Trace::writeChromeJson(const char *filename)
+{
+    FILE *file = fopen(filename, "w");
+    if (!file)
+    {
+        fprintf(stderr, "Trace: could not open %s\n", filename);
+        return false;
+    }
+
+    Registry &registry = getRegistry();
+    std::lock_guard<std::mutex> guard(registry.lock);
+    uint64_t dropped = 0;
+    bool first = true;
+
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    for (const std::shared_ptr<ThreadRing> &ring : registry.rings)
+    {
+        if (!ring->name.empty())
+        {
+            fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                    first ? "" : ",\n", ring->threadId, ring->name.c_str());
+            first = false;
+        }
+
+        const uint64_t count = ring->count.load(std::memory_order_acquire);
+        const uint64_t oldest = (count > eventsPerThread) ? count - eventsPerThread : 0;
+        dropped += oldest;
+        for (uint64_t i = oldest; i < count; ++i)
+        {
+            const Event &event = ring->events[i & (eventsPerThread - 1)];
+            fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                    first ? "" : ",\n", event.name, ring->threadId, event.start / 1000.0, event.duration / 1000.0);
+            first = false;
+        }
+    }
+    fprintf(file, "\n]}\n");
+
+    const bool success = (fclose(file) == 0);
+    if (dropped)
+    {
+        fprintf(stderr, "Trace: %llu oldest zones were overwritten\n", (unsigned long long)dropped);
+    }
+    return success;
+}
+
+void Trace::clear()
+{
+    Registry &registry = getRegistry();
+    std::lock_guard<std::mutex> guard(registry.lock);
+    for (const std::shared_ptr<ThreadRing> &ring : registry.rings)
+    {
+        ring->count.store(0);
+    }
+}
+//EOF
@@ -0,0 +1,91 @@
+/*
+ *  Trace: scoped timing zones exported as Chrome trace events
+ */
+//==============================================================================
+#ifndef Trace_hpp
+#define Trace_hpp
+//==============================================================================
+#include <cstddef>
+#include <cstdint>
+//==============================================================================
+/*!
+   @class Trace
+   @brief records how long named zones take on every thread, for viewing in
+   chrome://tracing or Perfetto.
+
+   @discussion Zones are marked with KS_TRACE_SCOPE("name"), which times the
+   rest of the enclosing block. The macro expands to nothing unless KS_TRACE
+   is defined, so release builds carry no cost; KS_TRACE_THREAD("name")
+   likewise names the calling thread. Zone names must be string literals,
+   only their pointers are stored.
+
+   Each thread records into its own ring of eventsPerThread events, written
+   without locks and keeping the newest events when it wraps. The first
+   event of a thread registers its ring, which allocates once; naming real
+   time threads when they start does that up front.
+
+   writeChromeJson() exports every ring as complete ("X") events, best done
+   once the threads being traced are idle.
+ */
+//==============================================================================
+class Trace
+{
+public:
+    /** one timed zone */
+    struct Event
+    {
+        /// zone name, a string literal
+        const char *name;
+        /// nanoseconds from the trace epoch
+        int64_t start;
+        int64_t duration;
+    };
+
+    /** times its lifetime as a zone */
+    class Scope
+    {
+    public:
+        explicit Scope(const char *zoneName) : name(zoneName), start(now()) {}
+        ~Scope() {record(name, start, now() - start);}
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    private:
+        const char *name;
+        int64_t start;
+    };
+    //==============================================================================
+    /** @returns nanoseconds since the trace epoch, the first call of the program */
+    static int64_t now();
+
+    /** adds a zone to the calling thread's ring */
+    static void record(const char *name, int64_t start, int64_t duration);
+
+    /** names the calling thread in the export and registers its ring
+       @param name thread name, copied
+     */
+    static void setThreadName(const char *name);
+
+    /** writes every recorded zone as Chrome trace event JSON
+       @param filename file to write
+       @returns true on success
+     */
+    static bool writeChromeJson(const char *filename);
+
+    /** discards recorded zones, only while no thread is recording */
+    static void clear();
+
+    /// events kept per thread, a power of two
+    static constexpr size_t eventsPerThread = 1 << 16;
+};
+//==============================================================================
+#ifdef KS_TRACE
+#define KS_TRACE_CONCAT_(a, b) a##b
+#define KS_TRACE_CONCAT(a, b) KS_TRACE_CONCAT_(a, b)
+#define KS_TRACE_SCOPE(name) Trace::Scope KS_TRACE_CONCAT(traceScope, __LINE__)(name)
+#define KS_TRACE_THREAD(name) Trace::setThreadName(name)
+#else
+#define KS_TRACE_SCOPE(name)
+#define KS_TRACE_THREAD(name)
+#endif
+#endif /* Trace_hpp */
@@ -0,0 +1,259 @@
+//
+//  WavChunkIndex.cpp
+//  KarplusStrongTest
+//
+#include "WavChunkIndex.hpp"
+#include "WavCodec.hpp"
+#include "MemoryAccounting.hpp"
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#if defined _WIN32 || defined _WIN64
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#endif
+//==============================================================================
+namespace
+{
+    /** cache entry, only valid while the file size and time match */
+    struct CacheEntry
+    {
+        int64_t fileSize;
+        /// nanoseconds, or 100 ns FILETIME ticks on Windows
+        int64_t modifiedTime;
+        std::shared_ptr<const WavChunkIndex> index;
+    };
+
+    std::mutex cacheLock;
+    std::map<std::string, CacheEntry> cache;
+    MemoryAccounting::Tracker cacheMemory(MemoryAccounting::Category::caches);
+
+    /** reports the size of the cache, called with cacheLock held */
+    void updateCacheMemory()
+    {
+        size_t bytes = 0;
+        for (const auto &entry : cache)
+        {
+            bytes += entry.first.capacity() + sizeof(entry) + sizeof(WavChunkIndex) +
+                     entry.second.index->getChunks().capacity() * sizeof(WavChunkIndex::Chunk);
+        }
+        cacheMemory.setBytes(bytes);
+    }
+
+    /** size and modification time at the finest resolution the system keeps,
+       whole seconds would miss a rewrite of the same size within a second
+     */
+    bool fileStats(const char *filename, int64_t &fileSize, int64_t &modifiedTime)
+    {
+#if defined _WIN32 || defined _WIN64
+        WIN32_FILE_ATTRIBUTE_DATA attributes;
+        if (!GetFileAttributesExA(filename, GetFileExInfoStandard, &attributes)) {return false;}
+        fileSize = (int64_t)(((uint64_t)attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow);
+        modifiedTime = (int64_t)(((uint64_t)attributes.ftLastWriteTime.dwHighDateTime << 32) |
+                                 attributes.ftLastWriteTime.dwLowDateTime);
+#else
+        struct stat st;
+        if (stat(filename, &st) != 0) {return false;}
+        fileSize = (int64_t)st.st_size;
+#if defined __APPLE__
+        modifiedTime = (int64_t)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+        modifiedTime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+#endif
+        return true;
+    }
+
+    /** @returns true if the chunk ID is still at the cached offset of f */
+    bool chunkStillThere(FILE *f, const WavChunkIndex::Chunk *chunk)
+    {
+        char id[4];
+        return chunk && WavCodec::seekFile(f, (int64_t)chunk->offset - 8, SEEK_SET) == 0 &&
+               fread(id, 4, 1, f) == 1 && !strncmp(id, chunk->id, 4);
+    }
+}
+//==============================================================================
+bool WavChunkIndex::build(FILE *f)
+{
+    chunks.clear();
+    riffSize = 0;
+
+    char format[4];
+    uint32_t riffSize32;
+    if (WavCodec::seekFile(f, 0, SEEK_SET) != 0 ||
+        fread(riffID, 4, 1, f) != 1 ||
+        fread(&riffSize32, 4, 1, f) != 1 ||
+        fread(format, 4, 1, f) != 1)
+    {
+        return false;
+    }
+
+    const bool isRF64 = !strncmp(riffID, "RF64", 4);
+    if ((strncmp(riffID, "RIFF", 4) && !isRF64) || strncmp(format, "WAVE", 4))
+    {
+        return false;
+    }
+    riffSize = riffSize32;
+
+    // 64 bit sizes from ds64, keyed by chunk ID
+    uint64_t ds64DataSize = 0;
+    std::vector<Chunk> ds64Table;
+
+    uint64_t offset = 12;
+    while (offset + 8 <= 8 + riffSize)
+    {
+        Chunk chunk;
+        uint32_t size32;
+        if (WavCodec::seekFile(f, (int64_t)offset, SEEK_SET) != 0 ||
+            fread(chunk.id, 4, 1, f) != 1 ||
+            fread(&size32, 4, 1, f) != 1)
+        {
+            break; // truncated file, keep what was found
+        }
+        chunk.offset = offset + 8;
+        chunk.size = size32;
+
+        if (!strncmp(chunk.id, "ds64", 4) && size32 >= 28)
+        {
+            uint64_t sizes[3];
+            uint32_t tableLength;
+            if (fread(sizes, sizeof(sizes), 1, f) != 1 ||
+                fread(&tableLength, 4, 1, f) != 1)
+            {
+                return false;
+            }
+            if (isRF64)
+            {
+                riffSize = sizes[0];
+            }
+            ds64DataSize = sizes[1];
+            for (uint32_t i = 0; i < tableLength && 28 + 12 * (i + 1) <= size32; ++i)
+            {
+                Chunk entry;
+                if (fread(entry.id, 4, 1, f) != 1 || fread(&entry.size, 8, 1, f) != 1)
+                {
+                    break;
+                }
+                ds64Table.push_back(entry);
+            }
+        }
+        else if (isRF64 && size32 == 0xFFFFFFFF)
+        {
+            if (!strncmp(chunk.id, "data", 4))
+            {
+                chunk.size = ds64DataSize;
+            }
+            for (const Chunk &entry : ds64Table)
+            {
+                if (!strncmp(entry.id, chunk.id, 4))
+                {
+                    chunk.size = entry.size;
+                    break;
+                }
+            }
+        }
+
+        chunks.push_back(chunk);
+        // chunks are word aligned
+        offset = chunk.offset + chunk.size + (chunk.size & 1);
+    }
+    return true;
+}
+//==============================================================================
+std::shared_ptr<const WavChunkIndex> WavChunkIndex::forFile(const char *filename, FILE *f)
+{
+    int64_t fileSize = -1;
+    int64_t modifiedTime = 0;
+    const bool haveStats = fileStats(filename, fileSize, modifiedTime);
+    std::shared_ptr<const WavChunkIndex> cached;
+
+    if (haveStats)
+    {
+        std::lock_guard<std::mutex> lock(cacheLock);
+        auto found = cache.find(filename);
+        if (found != cache.end() &&
+            found->second.fileSize == fileSize &&
+            found->second.modifiedTime == modifiedTime)
+        {
+            cached = found->second.index;
+        }
+    }
+    // file systems with coarse times can still miss a rewrite, so the chunks
+    // readers seek to are checked before the index is trusted
+    if (cached && chunkStillThere(f, cached->find("fmt ")) && chunkStillThere(f, cached->find("data")))
+    {
+        return cached;
+    }
+
+    auto index = std::make_shared<WavChunkIndex>();
+    if (!index->build(f))
+    {
+        return nullptr;
+    }
+
+    if (haveStats)
+    {
+        std::lock_guard<std::mutex> lock(cacheLock);
+        cache[filename] = {fileSize, modifiedTime, index};
+        updateCacheMemory();
+    }
+    return index;
+}
+//==============================================================================
+void WavChunkIndex::invalidate(const char *filename)
+{
+    std::lock_guard<std::mutex> lock(cacheLock);
+    cache.erase(filename);
+    updateCacheMemory();
+}
+
+void WavChunkIndex::clearCache()
+{
+    std::lock_guard<std::mutex> lock(cacheLock);
+    cache.clear();
+    updateCacheMemory();
+}
+//==============================================================================
+const WavChunkIndex::Chunk* WavChunkIndex::find(const char id[4]) const
+{
+    for (const Chunk &chunk : chunks)
+    {
+        if (!strncmp(chunk.id, id, 4))
+        {
+            return &chunk;
+        }
+    }
+    return nullptr;
+}
+//==============================================================================
+uint64_t WavChunkIndex::getDataOffset() const
+{
+    const Chunk *data = find("data");
+    return data ? data->offset : 0;
+}
+
+uint64_t WavChunkIndex::getDataSize() const
+{
+    const Chunk *data = find("data");
+    return data ? data->size : 0;
+}
+//==============================================================================
+bool WavChunkIndex::seekToData(FILE *f) const
+{
+    const Chunk *data = find("data");
+    return data && WavCodec::seekFile(f, (int64_t)data->offset, SEEK_SET) == 0;
+}
+
+bool WavChunkIndex::seekToFrame(FILE *f, uint64_t frame, int blockAlign) const
+{
+    const Chunk *data = find("data");
+    if (!data || blockAlign <= 0 || frame * blockAlign > data->size)
+    {
+        return false;
+    }
+    return WavCodec::seekFile(f, (int64_t)(data->offset + frame * blockAlign), SEEK_SET) == 0;
+}
+//EOF
@@ -0,0 +1,98 @@
+/*
+ *  WavChunkIndex: offsets and sizes of every chunk in a RIFF/RF64 file
+ */
+//==============================================================================
+#ifndef WavChunkIndex_hpp
+#define WavChunkIndex_hpp
+//==============================================================================
+#include <cstdio>
+#include <cstdint>
+#include <memory>
+#include <vector>
+//==============================================================================
+/*!
+   @class WavChunkIndex
+   @brief walks a wav file once and records where every chunk lives.
+
+   @discussion Wav files written by other tools often carry LIST, bext, JUNK
+   or other chunks between or after fmt and data. The index walks the whole
+   file once, taking 64 bit sizes from the ds64 chunk of RF64 files, so
+   readers can seek straight to any chunk or to any frame of the data chunk.
+
+   Indexes are cached per filename by forFile() and reused for as long as the
+   file size and modification time, to the nanosecond where the system keeps
+   it, are unchanged and the fmt and data chunk IDs are still where the index
+   puts them, so opening a file that has already been seen does not re-scan it.
+ */
+//==============================================================================
+class WavChunkIndex
+{
+public: // Type definitions
+    /** location of a single chunk */
+    struct Chunk
+    {
+        /** four character chunk ID */
+        char id[4];
+        /** file offset of the first byte of the chunk payload */
+        uint64_t offset;
+        /** payload size in bytes, not including padding */
+        uint64_t size;
+    };
+public:
+    //==============================================================================
+    /** walks all chunks of an open file
+       @param f open file, the position is changed
+       @returns true if the file starts with a RIFF or RF64 WAVE header
+     */
+    bool build(FILE *f);
+
+    /** returns the cached index of a file, building it if the file is new or
+       has changed since it was indexed
+       @param filename path of the file, used as the cache key
+       @param f the same file already opened for reading
+       @returns the index or nullptr if the file is not a wav file
+     */
+    static std::shared_ptr<const WavChunkIndex> forFile(const char *filename, FILE *f);
+
+    /** drops a single file from the cache, used when a file is rewritten
+       @param filename path of the file
+     */
+    static void invalidate(const char *filename);
+
+    /** empties the cache used by forFile() */
+    static void clearCache();
+    //==============================================================================
+    /** @param id four character chunk ID
+       @returns the first chunk with the ID or nullptr */
+    const Chunk* find(const char id[4]) const;
+    /** @returns all chunks in file order */
+    const std::vector<Chunk>& getChunks() const {return chunks;}
+    /** @returns "RIFF" or "RF64" */
+    const char* getRiffID() const {return riffID;}
+    /** @returns the RIFF size field, or the 64 bit size from ds64 */
+    uint64_t getRiffSize() const {return riffSize;}
+    /** @returns offset of the first byte of audio data, 0 if there is no data chunk */
+    uint64_t getDataOffset() const;
+    /** @returns size of the data chunk in bytes */
+    uint64_t getDataSize() const;
+    //==============================================================================
+    /** positions a file at the start of the data chunk
+       @returns true on success
+     */
+    bool seekToData(FILE *f) const;
+    /** positions a file at a frame of the data chunk
+       @param frame frame index from the start of the data
+       @param blockAlign bytes per frame
+       @returns true on success, false if frame is beyond the data
+     */
+    bool seekToFrame(FILE *f, uint64_t frame, int blockAlign) const;
+
+private:
+    /// chunks in file order
+    std::vector<Chunk> chunks;
+    /// RIFF or RF64
+    char riffID[4] = {0, 0, 0, 0};
+    /// size of RIFF payload
+    uint64_t riffSize = 0;
+};
+#endif /* WavChunkIndex_hpp */
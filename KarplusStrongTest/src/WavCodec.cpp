@@ -7,6 +7,13 @@
 //
 #ifndef WavCodec_hpp // WavCodec WavCodec
 #include "WavCodec.hpp"
+#include "WavWriter.hpp"
+#include "SimdKernels.hpp"
+#include "ThreadPool.hpp"
+#include "Trace.hpp"
+#include <atomic>
+#include <algorithm>
+#include <climits>
 #if defined _WIN32 || defined _WIN64
 #define fopen fopen_s
 #endif
@@ -28,7 +35,14 @@ void WavCodec::printWavHeader(const char *filename)
     }
     else
     {
-        fread(&hdr, 1, sizeof(hdr), f);
+        auto index = WavChunkIndex::forFile(filename, f);
+        if (!index || !readHeader(hdr, f, *index))
+        {
+            printf("NOT A WAV FILE\n");
+            fclose(f);
+            return;
+        }
+        const uint64_t dataSize = index->getDataSize();
         
         printf("--- .WAV HEADER --- \n\n");
         printf("Chunk ID        : %.4s\n", hdr.chunkID);
@@ -44,7 +58,14 @@ void WavCodec::printWavHeader(const char *filename)
         printf("Bits Per Samp   : %u\n", hdr.bitsPerSample);
         printf("Sub-Chunk 2     : %.4s\n", hdr.subChunk2ID);
         printf("Sub-Chunk 2 size: %u\n", hdr.subChunk2Size);
-        printf("Samples Per Chan: %u\n", hdr.subChunk2Size*8/(hdr.numChannels*hdr.bitsPerSample));
+        printf("Data size       : %llu\n", (unsigned long long)dataSize);
+        printf("Samples Per Chan: %llu\n", (unsigned long long)(dataSize*8/(hdr.numChannels*hdr.bitsPerSample)));
+        printf("Chunks          :");
+        for (const WavChunkIndex::Chunk &chunk : index->getChunks())
+        {
+            printf(" %.4s(%llu)", chunk.id, (unsigned long long)chunk.size);
+        }
+        printf("\n");
         printf("\n");
         fclose(f);
     }
@@ -55,45 +76,68 @@ void WavCodec::printWavHeader(const char *filename)
 
 //==============================================================================
 
-void WavCodec::writeWavSS(float **audioData, const char outputFile[], int numberOfFrames, float sampleRate)
+void WavCodec::writeWavSS(AudioBuffer &audioData, const char outputFile[], float sampleRate, SampleFormat format, float knownPeak)
 {
-    normaliseStereoBuffer(audioData[0], audioData[1] ,numberOfFrames);
-    FILE * file;
-    openFile(&file, outputFile, "w");
-    if (!file)
+    if (audioData.getNumChannels() != 2)
     {
-        printf("Could not open file to write: check file path\n");
+        printf("NOT A STEREO BUFFER\n");
         return;
     }
-    else
+    writeWav(audioData, outputFile, sampleRate, format, knownPeak);
+}
+
+//==============================================================================
+
+void WavCodec::writeWav(AudioBuffer &audioData, const char outputFile[], float sampleRate, SampleFormat format, float knownPeak)
+{
+    const int numChannels = audioData.getNumChannels();
+    const int numberOfFrames = (int)audioData.getNumFrames();
+    
+    if (format != SampleFormat::float32)
     {
-        stereo16bitWaveHeaderForLength(numberOfFrames,sampleRate);
-        writeWaveHeaderToFile(file);
-        int16_t sdata;
-        //	const float amp = 32000.0;
-        const float amp = 32767.0; // absolute peak value of 16-bit PCM
-        
-        for(int i = 0; i < numberOfFrames; ++i)
+        if (numChannels == 2)
         {
-            sdata = (int16_t)(audioData[0][i]*amp);
-            fwrite(&sdata, sizeof(int16_t), 1, file); //left channel
-            sdata = (int16_t)(audioData[1][i]*amp);
-            fwrite(&sdata, sizeof(int16_t), 1, file); //right channel
+            normaliseStereoBuffer(audioData.getChannel(0), audioData.getChannel(1), numberOfFrames, knownPeak);
+        }
+        else
+        {
+            float maxy = knownPeak;
+            if (maxy < 0.0f)
+            {
+                maxy = 0.0f;
+                for (int channel = 0; channel < numChannels; ++channel)
+                {
+                    maxy = std::max(maxy, SimdKernels::maxAbs(audioData.getChannel(channel), numberOfFrames));
+                }
+            }
+            for (int channel = 0; channel < numChannels; ++channel)
+            {
+                normaliseBuffer(audioData.getChannel(channel), numberOfFrames, maxy);
+            }
         }
-        printf("%d samples written to %s\n", numberOfFrames*2,outputFile);
     }
-    fclose(file);
-    
+    WavWriter writer;
+    // the peak level these files have always been written at
+    writer.setPcm16Scale(32767.0f);
+    if (!writer.open(outputFile, numChannels, sampleRate, format))
+    {
+        return;
+    }
+    writer.writePlanar(audioData.getChannelPointers(), numberOfFrames);
+    writer.close();
+    printf("%d samples written to %s\n", numberOfFrames*numChannels,outputFile);
 }
 
 //==============================================================================
 bool WavCodec::checkHeader(waveFormatHeader fileHeader)
 {
     
-    if ((strncmp(&fileHeader.chunkID[0], "RIFF", 4))	 ||
+    if ((strncmp(&fileHeader.chunkID[0], "RIFF", 4) &&
+         strncmp(&fileHeader.chunkID[0], "RF64", 4))     ||
         (strncmp(&fileHeader.format[0],  "WAVE", 4))     ||
         (strncmp(&fileHeader.subChunk1ID[0], "fmt ", 4)) ||
-        (strncmp(&fileHeader.subChunk2ID[0], "data", 4)))
+        (strncmp(&fileHeader.subChunk2ID[0], "data", 4)) ||
+        (fileHeader.audioFormat != formatPCM && fileHeader.audioFormat != formatIEEEFloat))
     {
         return false;
     }
@@ -103,30 +147,101 @@ bool WavCodec::checkHeader(waveFormatHeader fileHeader)
     }
 }
 //==============================================================================
-
-float* WavCodec::readWav(const char *filename, int *sampsPerChan, int *sampleRate)
+bool WavCodec::readHeader(waveFormatHeader &fileHeader, FILE *f, const WavChunkIndex &index)
+{
+    memset(&fileHeader, 0, sizeof(fileHeader));
+    memcpy(fileHeader.chunkID, index.getRiffID(), 4);
+    fileHeader.chunkSize = (uint32_t)std::min<uint64_t>(index.getRiffSize(), 0xFFFFFFFF);
+    memcpy(fileHeader.format, "WAVE", 4);
+    
+    const WavChunkIndex::Chunk *fmt = index.find("fmt ");
+    const WavChunkIndex::Chunk *data = index.find("data");
+    
+    // 16 bytes for PCM, 18 for float, 40 for WAVE_FORMAT_EXTENSIBLE
+    if (!fmt || fmt->size < 16 ||
+        seekFile(f, (int64_t)fmt->offset, SEEK_SET) != 0 ||
+        fread(&fileHeader.audioFormat, 16, 1, f) != 1)
+    {
+        return false;
+    }
+    memcpy(fileHeader.subChunk1ID, fmt->id, 4);
+    fileHeader.subChunk1Size = (uint32_t)fmt->size;
+    
+    if (fileHeader.audioFormat == formatExtensible && fmt->size >= 40)
+    {
+        // cbSize, validBitsPerSample, channelMask, then the sub-format GUID
+        // whose first two bytes are the actual format tag
+        uint8_t extension[24];
+        if (fread(extension, sizeof(extension), 1, f) != 1)
+        {
+            return false;
+        }
+        memcpy(&fileHeader.audioFormat, &extension[8], 2);
+    }
+    
+    if (!data)
+    {
+        return false;
+    }
+    memcpy(fileHeader.subChunk2ID, data->id, 4);
+    fileHeader.subChunk2Size = (uint32_t)std::min<uint64_t>(data->size, 0xFFFFFFFF);
+    return index.seekToData(f);
+}
+//==============================================================================
+FILE* WavCodec::openWavForRead(const char *filename)
 {
     FILE *f;
     openFile(&f, filename, "rb");
-    if (!f){return NULL;}
-    fread(&wavReadFileHeader, 1, sizeof(wavReadFileHeader), f);
+    if (!f)
+    {
+        return nullptr;
+    }
     
-    if(!checkHeader(wavReadFileHeader))
+    wavReadIndex = WavChunkIndex::forFile(filename, f);
+    if(!wavReadIndex ||
+       !readHeader(wavReadFileHeader, f, *wavReadIndex) ||
+       !checkHeader(wavReadFileHeader))
     {
         fclose(f);
         printf("NOT A WAV FILE\n");
-        return NULL;
+        return nullptr;
     }
+    wavReadDataSize = wavReadIndex->getDataSize();
+    return f;
+}
+//==============================================================================
+int WavCodec::seekFile(FILE *f, int64_t offset, int origin)
+{
+#if defined _WIN32 || defined _WIN64
+    return _fseeki64(f, offset, origin);
+#else
+    return fseeko(f, (off_t)offset, origin);
+#endif
+}
+//==============================================================================
+
+AudioBuffer WavCodec::readWav(const char *filename, int *sampleRate)
+{
+    AudioBuffer data;
+    FILE *f = openWavForRead(filename);
+    if (!f){return data;}
     
-    const int totalSamples = wavReadFileHeader.subChunk2Size * 8 /(wavReadFileHeader.bitsPerSample);
-    *sampsPerChan = totalSamples / (wavReadFileHeader.numChannels);
-    printf("Length: %d\tSamples: %d \n",totalSamples,*sampsPerChan);
+    const uint64_t totalSamples = wavReadDataSize * 8 /(wavReadFileHeader.bitsPerSample);
+    const size_t sampsPerChan = (size_t)(totalSamples / (wavReadFileHeader.numChannels));
+    printf("Length: %llu\tSamples: %zu \n",(unsigned long long)totalSamples,sampsPerChan);
     
-    float *data = new float[*sampsPerChan];
+    data.setCategory(MemoryAccounting::Category::ioBuffers);
+    data.setSize(1, sampsPerChan, false);
     
-    parseWavMonoFile(data, f);
+    const bool success = parseWavMonoFile(data.getChannel(0), f);
     fclose(f);
-    printf("%d samples read from %s\n",*sampsPerChan,filename);
+    if (!success)
+    {
+        // never hand back a partly decoded buffer
+        data.release();
+        return data;
+    }
+    printf("%zu samples read from %s\n",sampsPerChan,filename);
     *sampleRate = wavReadFileHeader.sampleRate;
     return data;
 }
@@ -135,39 +250,38 @@ float* WavCodec::readWav(const char *filename, int *sampsPerChan, int *sampleRat
 bool WavCodec::parseWavMonoFile(float* data, FILE *f)
 {
     const int byteNum = wavReadFileHeader.bitsPerSample/8;
+    const bool isFloat = (wavReadFileHeader.audioFormat == formatIEEEFloat);
+    const size_t numberOfFrames = (size_t)(wavReadDataSize * 8 /(wavReadFileHeader.bitsPerSample * wavReadFileHeader.numChannels));
+    
+    // mono float files are already in the destination format
+    if (isFloat && byteNum == sizeof(float) && wavReadFileHeader.numChannels == 1)
+    {
+        if (fread(data, sizeof(float), numberOfFrames, f) != numberOfFrames)
+        {
+            printf("FAILED FILE READ\n");
+            return false;
+        }
+        return true;
+    }
+    
     uint8_t *const buf = new uint8_t[byteNum];
-    const float wavBitScale = 1/pow(2,31);
-    const float wav8BitScale = 2/pow(2,wavReadFileHeader.bitsPerSample);
-    const int numberOfFrames = wavReadFileHeader.subChunk2Size * 8 /(wavReadFileHeader.bitsPerSample * wavReadFileHeader.numChannels);
-    const int byteOffset = (4-byteNum);
     
-    for (int sample = 0; sample < numberOfFrames; ++sample)
+    for (size_t sample = 0; sample < numberOfFrames; ++sample)
     {
         for (int channel = 0; channel < wavReadFileHeader.numChannels; ++channel)
         {
-            int32_t data_in_channel = 0;
             size_t readCheck = fread(buf, byteNum, 1, f);
             if(readCheck == 1)
             {
                 if (channel==0)
                 {
-                    if(byteNum==1)
-                    {
-                        data[sample] = ((float)buf[0]-127.5) * wav8BitScale;
-                    }
-                    else
-                    {
-                        for(int k = 0; k < byteNum; ++k)
-                        {
-                            data_in_channel |= (buf[k] << (k+byteOffset)*8);
-                        }
-                        data[sample] = ((float)data_in_channel) * wavBitScale;
-                    }
+                    data[sample] = decodeSample(buf, byteNum, isFloat);
                 }
             }
             else
             {
                 printf("FAILED FILE READ\n");
+                delete[] buf;
                 return false;
             }
         }
@@ -178,91 +292,221 @@ bool WavCodec::parseWavMonoFile(float* data, FILE *f)
 }
 
 //==============================================================================
-bool WavCodec::parseWavFile(float** data, FILE *f)
+bool WavCodec::parseWavFile(float *const *data, FILE *f)
+{
+    const size_t numberOfFrames = (size_t)(wavReadDataSize * 8 /(wavReadFileHeader.bitsPerSample * wavReadFileHeader.numChannels));
+    return parseWavRange(data, f, 0, numberOfFrames);
+}
+
+//==============================================================================
+bool WavCodec::parseWavRange(float *const *data, FILE *f, size_t startFrame, size_t numberOfFrames) const
 {
+    KS_TRACE_SCOPE("readWav");
     const int byteNum = wavReadFileHeader.bitsPerSample/8;
-    uint8_t *const buf = new uint8_t[byteNum];
-    const float wavBitScale = 1/pow(2,31);
-    const float wav8BitScale = 2/pow(2,wavReadFileHeader.bitsPerSample);
-    const int numberOfFrames = wavReadFileHeader.subChunk2Size * 8 /(wavReadFileHeader.bitsPerSample * wavReadFileHeader.numChannels);
-    const int byteOffset = (4-byteNum);
-    
-    for (int sample = 0; sample < numberOfFrames; ++sample)
+    const int numChannels = wavReadFileHeader.numChannels;
+    const bool isFloat = (wavReadFileHeader.audioFormat == formatIEEEFloat);
+    const size_t bytesPerFrame = (size_t)byteNum * numChannels;
+    
+    // read and decode in blocks, then deinterleave into the channel arrays
+    const size_t framesPerBlock = 4096;
+    uint8_t *const raw = new uint8_t[framesPerBlock * bytesPerFrame];
+    float *const decoded = new float[framesPerBlock * numChannels];
+    float **channelPointers = new float*[numChannels];
+    bool success = true;
+    
+    for (size_t frame = startFrame; frame < startFrame + numberOfFrames; frame += framesPerBlock)
     {
-        for (int channel = 0; channel < wavReadFileHeader.numChannels; ++channel)
+        const size_t framesNow = std::min(framesPerBlock, startFrame + numberOfFrames - frame);
+        if (fread(raw, bytesPerFrame, framesNow, f) != framesNow)
         {
-            int32_t data_in_channel = 0;
-            size_t readCheck = fread(buf, byteNum, 1, f);
-            if(readCheck == 1)
-            {
-                if(byteNum==1)
-                {
-                    data[channel][sample] = ((float)buf[0]-127.5) * wav8BitScale;
-                }
-                else
-                {
-                    for(int k = 0; k < byteNum; ++k)
-                    {
-                        data_in_channel |= (buf[k] << (k+byteOffset)*8);
-                    }
-                    
-                    data[channel][sample] = ((float)data_in_channel) * wavBitScale;
-                }
-            }
-            else
-            {
-                printf("FAILED FILE READ\n");
-                return false;
-            }
+            printf("FAILED FILE READ\n");
+            success = false;
+            break;
         }
+        decodeSamples(raw, framesNow * numChannels, byteNum, isFloat, decoded);
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            channelPointers[channel] = data[channel] + frame;
+        }
+        SimdKernels::deinterleave(decoded, numChannels, framesNow, channelPointers);
     }
-    delete[] buf;
-    return true;
+    
+    delete[] channelPointers;
+    delete[] decoded;
+    delete[] raw;
+    return success;
 }
 
 //==============================================================================
+bool WavCodec::parseWavFileParallel(float *const *data, const char *filename, ThreadPool &pool)
+{
+    const size_t numberOfFrames = (size_t)(wavReadDataSize * 8 /(wavReadFileHeader.bitsPerSample * wavReadFileHeader.numChannels));
+    
+    // a few ranges per thread evens out uneven disk and core speeds, ranges
+    // are multiples of 4 frames so the deinterleave kernels stay vectorised
+    const size_t numRanges = (size_t)pool.getNumThreads() * 2;
+    const size_t framesPerRange = ((numberOfFrames + numRanges - 1) / numRanges + 3) & ~(size_t)3;
+    std::atomic<bool> success {true};
+    
+    pool.parallelFor(numRanges, [&](size_t range)
+    {
+        const size_t startFrame = range * framesPerRange;
+        if (startFrame >= numberOfFrames)
+        {
+            return;
+        }
+        const size_t framesNow = std::min(framesPerRange, numberOfFrames - startFrame);
+        
+        // each range reads through its own handle so seeks do not collide
+        FILE *f;
+        openFile(&f, filename, "rb");
+        if (!f ||
+            !wavReadIndex->seekToFrame(f, startFrame, wavReadFileHeader.blockAlign) ||
+            !parseWavRange(data, f, startFrame, framesNow))
+        {
+            success = false;
+        }
+        if (f)
+        {
+            fclose(f);
+        }
+    });
+    return success;
+}
 
-float** WavCodec::readStereoWav(const char *filename, int *sampsPerChan, int *sampleRate)
+//==============================================================================
+void WavCodec::decodeSamples(const uint8_t *raw, size_t numSamples, int byteNum, bool isFloat, float *out)
 {
-    FILE *f;
-    openFile(&f, filename, "rb");
-    if (!f)
+    if (isFloat && byteNum == sizeof(float))
     {
-        return NULL;
+        memcpy(out, raw, numSamples * sizeof(float));
+        return;
+    }
+    if (!isFloat && byteNum == 2)
+    {
+        const float scale = 1.0f/32768.0f;
+        for (size_t n = 0; n < numSamples; ++n)
+        {
+            int16_t s;
+            memcpy(&s, raw + 2 * n, 2);
+            out[n] = s * scale;
+        }
+        return;
+    }
+    for (size_t n = 0; n < numSamples; ++n)
+    {
+        out[n] = decodeSample(raw + n * byteNum, byteNum, isFloat);
+    }
+}
+
+//==============================================================================
+float WavCodec::decodeSample(const uint8_t *buf, int byteNum, bool isFloat)
+{
+    if (isFloat)
+    {
+        if (byteNum == sizeof(double))
+        {
+            double d;
+            memcpy(&d, buf, sizeof(double));
+            return (float)d;
+        }
+        float v;
+        memcpy(&v, buf, sizeof(float));
+        return v;
     }
     
-    fread(&wavReadFileHeader, sizeof(wavReadFileHeader), 1 , f);
+    if (byteNum == 1)
+    {
+        return ((float)buf[0]-127.5f) * (2.0f/256.0f);
+    }
     
-    if(!checkHeader(wavReadFileHeader))
+    const float wavBitScale = 1.0f/2147483648.0f;
+    const int byteOffset = (4-byteNum);
+    int32_t data_in_channel = 0;
+    for(int k = 0; k < byteNum; ++k)
     {
-        fclose(f);
-        printf("NOT A WAV FILE\n");
-        return NULL;
+        data_in_channel |= (buf[k] << (k+byteOffset)*8);
+    }
+    return ((float)data_in_channel) * wavBitScale;
+}
+
+//==============================================================================
+
+AudioBuffer WavCodec::readStereoWav(const char *filename, int *sampleRate, ThreadPool *pool)
+{
+    AudioBuffer data;
+    FILE *f = openWavForRead(filename);
+    if (!f)
+    {
+        return data;
     }
     
     if ((wavReadFileHeader.numChannels != 2))
     {
         fclose(f);
         printf("NOT A STEREO FILE\n");
-        return NULL;
+        return data;
     }
     
-    const int totalSamples = wavReadFileHeader.subChunk2Size * 8 /(wavReadFileHeader.bitsPerSample);
-    *sampsPerChan	 = totalSamples/(wavReadFileHeader.numChannels);
-    float** data = new float*[wavReadFileHeader.numChannels];
-    if (!data)
+    const uint64_t totalSamples = wavReadDataSize * 8 /(wavReadFileHeader.bitsPerSample);
+    data.setCategory(MemoryAccounting::Category::ioBuffers);
+    data.setSize(wavReadFileHeader.numChannels, (size_t)(totalSamples/(wavReadFileHeader.numChannels)), false);
+    
+    bool success;
+    if (pool && data.getNumFrames() >= parallelDecodeMinFrames)
     {
-        return NULL;
+        fclose(f);
+        success = parseWavFileParallel(data.getChannelPointers(), filename, *pool);
     }
-    
-    for(int i = 0; i < wavReadFileHeader.numChannels; ++i)
+    else
+    {
+        success = parseWavFile(data.getChannelPointers(), f);
+        fclose(f);
+    }
+    if (!success)
+    {
+        // never hand back a partly decoded buffer
+        data.release();
+        return data;
+    }
+    printf("%llu samples read from %s\n",(unsigned long long)totalSamples,filename);
+    *sampleRate = wavReadFileHeader.sampleRate;
+    return data;
+}
+//==============================================================================
+
+AudioBuffer WavCodec::readMultiChannelWav(const char *filename, int *sampleRate, ThreadPool *pool)
+{
+    AudioBuffer data;
+    FILE *f = openWavForRead(filename);
+    if (!f)
     {
-        data[i] = new float[*sampsPerChan];
+        return data;
     }
     
-    parseWavFile(data, f);
-    fclose(f);
-    printf("%d samples read from %s\n",totalSamples,filename);
+    const int numChannels = wavReadFileHeader.numChannels;
+    const size_t sampsPerChan = (size_t)(wavReadDataSize * 8 /(wavReadFileHeader.bitsPerSample * numChannels));
+    data.setCategory(MemoryAccounting::Category::ioBuffers);
+    data.setSize(numChannels, sampsPerChan, false);
+    
+    bool success;
+    if (pool && data.getNumFrames() >= parallelDecodeMinFrames)
+    {
+        fclose(f);
+        success = parseWavFileParallel(data.getChannelPointers(), filename, *pool);
+    }
+    else
+    {
+        success = parseWavFile(data.getChannelPointers(), f);
+        fclose(f);
+    }
+    if (!success)
+    {
+        // never hand back a partly decoded buffer
+        data.release();
+        return data;
+    }
+    printf("%d x %zu samples read from %s\n",numChannels,sampsPerChan,filename);
     *sampleRate = wavReadFileHeader.sampleRate;
     return data;
 }
@@ -321,24 +565,15 @@ void WavCodec::mono16bitWaveHeaderForLength(size_t numberOfFrames,float sampleRa
 }
 //==============================================================================
 
-void WavCodec::normaliseBuffer(float *audioData, int numberOfFrames)
+void WavCodec::normaliseBuffer(float *audioData, int numberOfFrames, float knownPeak)
 {
-    float temp;
-    float maxy = 0.0; // Find max abs sample
-    
-    for(int n = 0; n < numberOfFrames; ++n)
-    {
-        if(fabs(audioData[n])>maxy) maxy = fabs(audioData[n]);
-    }
+    // Find max abs sample unless the caller tracked it while rendering
+    const float maxy = (knownPeak >= 0.0f) ? knownPeak : SimdKernels::maxAbs(audioData, numberOfFrames);
     
     // Normalise
-    if(maxy > 0.00001)
+    if(maxy > 0.00001 && maxy != 1.0f)
     {
-        for(int n = 0; n < numberOfFrames; ++n)
-        {
-            temp     = audioData[n];
-            audioData[n] = temp/maxy;
-        }
+        SimdKernels::scale(audioData, numberOfFrames, 1.0f / maxy);
     }
     
     // Smooth last 500 samples
@@ -359,28 +594,20 @@ void WavCodec::normaliseBuffer(float *audioData, int numberOfFrames)
 
 //==============================================================================
 
-void WavCodec::normaliseStereoBuffer(float *audioL, float *audioR, int numberOfFrames)
+void WavCodec::normaliseStereoBuffer(float *audioL, float *audioR, int numberOfFrames, float knownPeak)
 {
-    float temp;
-    float maxy = 0.0; // Find max abs sample
-    
-    for(int n = 0; n < numberOfFrames; ++n)
+    float maxy = knownPeak;
+    if (maxy < 0.0f)
     {
-        if(fabs(audioL[n])>maxy) maxy = fabs(audioL[n]);
-        if(fabs(audioR[n])>maxy) maxy = fabs(audioR[n]);
-        
+        maxy = std::max(SimdKernels::maxAbs(audioL, numberOfFrames),
+                        SimdKernels::maxAbs(audioR, numberOfFrames));
     }
     
     // Normalise
-    if(maxy > 0.00001)
+    if(maxy > 0.00001 && maxy != 1.0f)
     {
-        for(int n=0;n<numberOfFrames;++n)
-        {
-            temp      = audioL[n];
-            audioL[n]  = temp/maxy;
-            temp      = audioR[n];
-            audioR[n] = temp/maxy;
-        }
+        SimdKernels::scale(audioL, numberOfFrames, 1.0f / maxy);
+        SimdKernels::scale(audioR, numberOfFrames, 1.0f / maxy);
     }
     
     // Smooth last 500 samples
@@ -405,80 +632,70 @@ size_t WavCodec::writeWaveHeaderToFile(FILE * file)
     return fwrite(&wavWriteFileHeader, sizeof(waveFormatHeader), 1, file);
 }
 
-void WavCodec::writeWavMS(float* audio,const char outputFile[], int numberOfFrames, float sampleRate)
+void WavCodec::writeWavMS(float* audio,const char outputFile[], int numberOfFrames, float sampleRate, SampleFormat format, float knownPeak)
 {
-    normaliseBuffer(audio ,numberOfFrames);
-    
-    FILE * file;
-    openFile(&file, outputFile, "w");
-    if (!file)
+    if (format != SampleFormat::float32)
     {
-        printf("Could not open file to write: check file path\n");
-        return;
+        normaliseBuffer(audio ,numberOfFrames, knownPeak);
     }
-    else
+    WavWriter writer;
+    // mono files have always been written with headroom below full scale
+    writer.setPcm16Scale(32000.0f);
+    if (!writer.open(outputFile, 1, sampleRate, format))
     {
-        mono16bitWaveHeaderForLength(numberOfFrames,sampleRate);
-        writeWaveHeaderToFile(file);
-        int16_t sdata;
-        const float amp = 32000.0;
-        
-        for(int i=0;i<numberOfFrames;++i)
-        {
-            sdata = (int16_t)(audio[i]*amp);  //set sdata to PCM 16-bit
-            fwrite(&sdata, sizeof(int16_t), 1, file);
-        }
-        printf("%d samples written to %s\n", numberOfFrames,outputFile);
+        return;
     }
-    fclose(file);
+    writer.write(audio, numberOfFrames);
+    writer.close();
+    printf("%d samples written to %s\n", numberOfFrames,outputFile);
 }
 
 //==============================================================================
-float** WavCodec::whiteNoise(int sampsPerChan, int sampleRate)
+AudioBuffer WavCodec::whiteNoise(int sampsPerChan, int /*sampleRate*/)
 {
     const float lo = -1.;
     const float hi =  1.;
-    float** data = new float*[2];
-    
-    for(int i = 0; i < 2; ++i)
-    {
-        data[i] = new float[sampsPerChan];
-    }
+    AudioBuffer data(2, sampsPerChan);
+    float *left = data.getChannel(0);
+    float *right = data.getChannel(1);
     
     for(int i = 0; i < sampsPerChan; ++i)
     {
-        data[0][i] = lo + static_cast <float> (rand()) /( static_cast <float> (RAND_MAX/(hi-lo)));
-        data[1][i] = lo + static_cast <float> (rand()) /( static_cast <float> (RAND_MAX/(hi-lo)));
+        left[i] = lo + static_cast <float> (rand()) /( static_cast <float> (RAND_MAX/(hi-lo)));
+        right[i] = lo + static_cast <float> (rand()) /( static_cast <float> (RAND_MAX/(hi-lo)));
     }
     return data;
 }
 //==============================================================================
 char* WavCodec::readRawData(const char *filename, int *dataSize, int *sampleRate)
 {
-    FILE *f;
-    openFile(&f, filename, "rb");
+    FILE *f = openWavForRead(filename);
     if (!f)
     {
         return nullptr;
     }
     
-    fread(&wavReadFileHeader, 1, sizeof(wavReadFileHeader), f);
-    
-    if(!checkHeader(wavReadFileHeader))
+    // the int size of this interface cannot describe files over 2 GB
+    if (wavReadDataSize > (uint64_t)INT_MAX)
     {
         fclose(f);
-        printf("NOT A WAV FILE\n");
+        printf("DATA TOO LARGE FOR readRawData, use openRawData\n");
         return nullptr;
     }
     
-    const int totalSamples = wavReadFileHeader.subChunk2Size * 8 /(wavReadFileHeader.bitsPerSample);
-    *dataSize = wavReadFileHeader.subChunk2Size;
+    const int totalSamples = (int)(wavReadDataSize * 8 /(wavReadFileHeader.bitsPerSample));
+    *dataSize = (int)wavReadDataSize;
     printf("Number of Sample Size: %d\tData: %d KB \n",totalSamples, *dataSize/1000);
     char *data = new char[*dataSize];
     
-    for (int sample = 0; sample < *dataSize; ++sample)
+    if (fread(data, 1, *dataSize, f) != (size_t)*dataSize)
     {
-        size_t readCheck = fread(&data[sample], 1, 1, f);
+        // a truncated file leaves the end of data uninitialised
+        printf("FAILED FILE READ\n");
+        delete[] data;
+        fclose(f);
+        *dataSize = 0;
+        return nullptr;
     }
     
     fclose(f);
@@ -486,7 +703,28 @@ char* WavCodec::readRawData(const char *filename, int *dataSize, int *sampleRate
     return data;
 }
 //==============================================================================
-uint16_t WavCodec::getFileSampleRate()
+FILE* WavCodec::openRawData(const char *filename, uint64_t *dataSize)
+{
+    FILE *f = openWavForRead(filename);
+    if (f)
+    {
+        *dataSize = wavReadDataSize;
+    }
+    return f;
+}
+//==============================================================================
+size_t WavCodec::readInterleaved(FILE *f, uint8_t *raw, float *interleaved, size_t numberOfFrames) const
+{
+    const int byteNum = wavReadFileHeader.bitsPerSample/8;
+    const int numChannels = wavReadFileHeader.numChannels;
+    const bool isFloat = (wavReadFileHeader.audioFormat == formatIEEEFloat);
+    
+    const size_t framesRead = fread(raw, (size_t)byteNum * numChannels, numberOfFrames, f);
+    decodeSamples(raw, framesRead * numChannels, byteNum, isFloat, interleaved);
+    return framesRead;
+}
+//==============================================================================
+uint32_t WavCodec::getFileSampleRate()
 {
     return wavReadFileHeader.sampleRate;
 }
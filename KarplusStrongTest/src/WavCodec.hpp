@@ -8,8 +8,14 @@
 #include <iostream>
 #include <cmath>
 #include <cstdint>
+#include <cstring>
 #include <fstream>
 #include <ctime>
+#include <memory>
+#include "AudioBuffer.hpp"
+#include "WavChunkIndex.hpp"
+//==============================================================================
+class ThreadPool;
 //==============================================================================
 /*!
    @class WavCodec
@@ -19,12 +25,9 @@
    array between 1.0 and -1.0. Basic functionality to cover
 
    - Read wav file as a single stream
-   - Read multi-channel files and store as an array of pointer (2D Array)
-   - Read/Write Header files
-   - Memory allocation of read file
-
-    Currently memory allocation of written file is dealt with outside the class
-    but will be expanded upon
+   - Read multi-channel files and store in a planar AudioBuffer
+   - Read/Write Header files, including RF64 for files larger than 4 GB
+   - Memory allocation of read file, owned by the returned AudioBuffer
 
    @version 0.1
    @author Matthew Hamilton
@@ -68,6 +71,27 @@ public: // Type definitions
          */
         uint32_t subChunk2Size;
     };
+
+    /** sample encodings that can be written to file */
+    enum class SampleFormat
+    {
+        /** 16 bit signed integer PCM */
+        pcm16,
+        /** 24 bit signed integer PCM */
+        pcm24,
+        /** 32 bit IEEE float, written without quantisation */
+        float32
+    };
+
+    /** files shorter than this are decoded on one thread even when a pool is given */
+    static constexpr size_t parallelDecodeMinFrames = 1 << 18;
+
+    /** audioFormat tag for integer PCM */
+    static constexpr uint16_t formatPCM = 1;
+    /** audioFormat tag for IEEE float */
+    static constexpr uint16_t formatIEEEFloat = 3;
+    /** audioFormat tag for WAVE_FORMAT_EXTENSIBLE, the real format is in the sub-format GUID */
+    static constexpr uint16_t formatExtensible = 0xFFFE;
 public:
     /**
        Constructor
@@ -108,66 +132,112 @@ public:
        @param outputFile character array of path and filename
        @param numberOfFrames number of frames to be written
        @param sampleRate sampling rate of file
+       @param format sample encoding, float32 is written without normalising
+       @param knownPeak peak of the audio if already known, e.g. from SignalStats.
+       Negative values mean the audio will be scanned for its peak.
      */
-    void writeWavMS(float* audio,const char outputFile[], int numberOfFrames, float sampleRate);
+    void writeWavMS(float* audio,const char outputFile[], int numberOfFrames, float sampleRate,
+                    SampleFormat format = SampleFormat::pcm16, float knownPeak = -1.0f);
 
-    /** writes audio data to a mono wav file
-       @param audioData float pointer to a 2D array of audio data
-       audioData[channel][sample]
+    /** writes audio data to a stereo wav file
+       @param audioData stereo buffer, normalised in place unless format is float32
        @param outputFile character array of path and filename
-       @param numberOfFrames number of frames to be written
        @param sampleRate sampling rate of file
+       @param format sample encoding, float32 is written without normalising
+       @param knownPeak peak of the audio if already known, e.g. from SignalStats.
+       Negative values mean the audio will be scanned for its peak.
      */
-    void writeWavSS(float **audioData, const char outputFile[], int numberOfFrames, float sampleRate);
+    void writeWavSS(AudioBuffer &audioData, const char outputFile[], float sampleRate,
+                    SampleFormat format = SampleFormat::pcm16, float knownPeak = -1.0f);
+
+    /** writes planar audio data to an interleaved wav file of any channel count
+       @param audioData buffer to write, normalised in place unless format is float32
+       @param outputFile character array of path and filename
+       @param sampleRate sampling rate of file
+       @param format sample encoding, float32 is written without normalising
+       @param knownPeak peak across all channels if already known
+     */
+    void writeWav(AudioBuffer &audioData, const char outputFile[], float sampleRate,
+                  SampleFormat format = SampleFormat::pcm16, float knownPeak = -1.0f);
 
     //==============================================================================
 
     /** Read in wav file as a mono file.
        Will read first channel only on multichannel files
        @param filename pointer to character array of path and filename
-       @param sampsPerChan int pointer that will be set to number of samples per channel
        @param sampleRate int pointer sampling rate of file
-       @returns a pointer to a array of type float or NULL on error
+       @returns a single channel buffer, empty on error
      */
-    float *readWav(const char *filename, int *sampsPerChan, int *sampleRate);
+    AudioBuffer readWav(const char *filename, int *sampleRate);
 
-    /** Read in wav file as a mono file.
-       Will read first channel only on multichannel files
+    /** Read in a stereo wav file.
        @param filename pointer to character array of path and filename
-       @param sampsPerChan	int pointer that will be set to total number of samples
-       per channel
        @param sampleRate int pointer that is set to
        sampling rate of read file
-       @returns a float pointer to a 2D array of type float or NULL on error
-       audioData[channel][sample]
+       @param pool optional thread pool, large files are decoded in parallel ranges
+       @returns a two channel buffer, empty on error or if the file is not stereo
      */
-    float **readStereoWav(const char *filename, int *sampsPerChan, int *sampleRate);
+    AudioBuffer readStereoWav(const char *filename, int *sampleRate, ThreadPool *pool = nullptr);
+
+    /** Read in a wav file with any number of channels.
+       @param filename pointer to character array of path and filename
+       @param sampleRate int pointer that is set to sampling rate of read file
+       @param pool optional thread pool, large files are decoded in parallel ranges
+       @returns a buffer with one channel per file channel, empty on error
+     */
+    AudioBuffer readMultiChannelWav(const char *filename, int *sampleRate, ThreadPool *pool = nullptr);
 
     /** creates a stereo buffer of white noise of specified length
 
        @param sampsPerChan	int: number of samples for each channel
-       @param sampleRate  int: sampling rate
-       @returns a float pointer to a 2D array of type float or NULL on error
-       audioData[channel][sample]
+       @param sampleRate  int: sampling rate, unused since noise is the same at any rate
+       @returns a two channel buffer of noise
      */
-    float** whiteNoise(int sampsPerChan, int sampleRate);
+    AudioBuffer whiteNoise(int sampsPerChan, int sampleRate);
 
     /**
        raw byte data from given file
 
        @param filename wav filename
-       @param sampsPerChan integer whose value will be changed to number of samples per channel of filename
+       @param sampsPerChan integer whose value will be changed to the size of the audio data in bytes
        @param sampleRate integer whose value will be changed to sample rate of filename
-       @return return byte array
+       @return return byte array, nullptr if the file cannot be read in full
+       or the data is larger than an int can describe; use openRawData for
+       such files
      */
     char* readRawData(const char *filename, int *sampsPerChan, int *sampleRate);
+
+    /**
+       Opens a wav file for streaming, positioned at the first byte of audio
+       data, so callers can read the PCM region in chunks of their own size.
+       The format is available through the getFile...() methods afterwards.
+
+       @param filename wav filename
+       @param dataSize set to the size of the data chunk in bytes
+       @return open file to be closed with fclose, nullptr on error
+     */
+    FILE* openRawData(const char *filename, uint64_t *dataSize);
+
+    /**
+       Decodes the next frames of a file opened with openRawData(), for
+       streaming. The caller keeps track of how many frames the data chunk
+       holds so that trailing chunks are not read as audio.
+
+       @param f file from openRawData()
+       @param raw scratch space of numberOfFrames * getFileChannelNumber() *
+       getFileBitDepth() / 8 bytes
+       @param interleaved output of numberOfFrames * getFileChannelNumber() floats
+       @param numberOfFrames frames to decode
+       @return frames decoded, fewer than numberOfFrames on a short read
+     */
+    size_t readInterleaved(FILE *f, uint8_t *raw, float *interleaved, size_t numberOfFrames) const;
     //==========================================================================
     /**
        Get File Sample Rate of previously read file
 
-       @return uint16_t sample rate
+       @return sample rate in hz
      */
-    uint16_t getFileSampleRate();
+    uint32_t getFileSampleRate();
     /**
        Get number of channels of previously read file
 
@@ -191,15 +261,33 @@ public:
     /** Normalise an array of audio data to 1;
        @param audioData audio Data passed as a float
        @param numberOfFrames Number of samples per channel
+       @param knownPeak peak of audioData if already known, skips the search pass.
+       Negative values mean the buffer will be scanned for its peak.
      */
-    static void normaliseBuffer(float *audioData, int numberOfFrames);
+    static void normaliseBuffer(float *audioData, int numberOfFrames, float knownPeak = -1.0f);
 
     /** Normalise two arrays of audio data representing a stereo signal;
        @param audioL audio data left channel
        @param audioR audio data right channel
        @param numberOfFrames number of samples per channel
+       @param knownPeak peak of both channels if already known, skips the search pass
      */
-    static void normaliseStereoBuffer(float *audioL, float *audioR, int numberOfFrames);
+    static void normaliseStereoBuffer(float *audioL, float *audioR, int numberOfFrames, float knownPeak = -1.0f);
+
+    /**
+      File handling to accomodate bothe windows and unix
+      @param f pointer to FILE
+      @return true on success, false on failure
+    */
+    static bool openFile(FILE **f, const char *filename, const char *mode);
+    /**
+      64 bit safe fseek for files larger than 2 GB
+      @param f open file
+      @param offset byte offset
+      @param origin SEEK_SET, SEEK_CUR or SEEK_END
+      @return 0 on success
+    */
+    static int seekFile(FILE *f, int64_t offset, int origin);
 
 private: // Methods
     //==============================================================================
@@ -253,10 +341,31 @@ private: // Methods
        @returns true if it is a wav file or false if not
      */
     bool checkHeader (waveFormatHeader fileHeader);
+    /**
+       Fills in a header from an indexed file. fmt chunks longer than 16 bytes
+       are handled and for WAVE_FORMAT_EXTENSIBLE the sub-format is stored in
+       audioFormat. Sizes that do not fit 32 bits are clamped, the real data
+       size is in the index. On success the file is positioned at the first
+       byte of audio data.
+
+       @param fileHeader header to fill in
+       @param f open wav file
+       @param index chunk index of f
+       @return true if the fmt and data chunks could be found and read
+     */
+    static bool readHeader (waveFormatHeader &fileHeader, FILE *f, const WavChunkIndex &index);
+    /**
+       Opens a file, indexes its chunks and reads the header into
+       wavReadFileHeader.
+
+       @param filename path of wav file
+       @return open file positioned at the start of the data, or nullptr
+     */
+    FILE* openWavForRead (const char *filename);
     /**
        Reads through open wav file and returns data scaled to between -1 and 1
        in array. Reads the first channel of the wav file only. Bit-depth agnostic,
-       will parse data that is u8, 16, 24 or 32 bit.
+       will parse data that is u8, 16, 24 or 32 bit PCM or 32/64 bit float.
 
        @param data pointer to array of audio data of type float to be filled
        @param f an open wav file where the header has been read
@@ -265,23 +374,57 @@ private: // Methods
     bool parseWavMonoFile(float* data, FILE *f);
     /**
        Reads through an open wav file and save data to an array in a
-       range of -1 to 1. Will parse u8, 16, 24 and 32 bit files.
+       range of -1 to 1. Will parse u8, 16, 24 and 32 bit PCM and 32/64 bit
+       float files.
        \see parseWavMonoFile
 
        @param data 2D array in format data[channel][sampleIndex]
        @param f open wav file to be read
        @return true on success, false on failure
      */
-    bool parseWavFile(float** data, FILE *f);
-    
+    bool parseWavFile(float *const *data, FILE *f);
     /**
-      File handling to accomodate bothe windows and unix
-      @param f pointer to FILE
-      @return true on success, false on failure
-    */
-    static bool openFile(FILE **f, const char *filename, const char *mode);
-    
-    
+       Decodes a range of frames from an open wav file positioned at startFrame.
+       Only reads the header members, so several ranges of the same file can be
+       decoded at once from different threads.
+
+       @param data 2D array in format data[channel][sampleIndex]
+       @param f open wav file positioned at startFrame
+       @param startFrame first frame to decode, also the write offset into data
+       @param numberOfFrames frames to decode
+       @return true on success, false on failure
+     */
+    bool parseWavRange(float *const *data, FILE *f, size_t startFrame, size_t numberOfFrames) const;
+    /**
+       Splits the data chunk of the last opened file into frame aligned ranges
+       and decodes them concurrently straight into data.
+
+       @param data 2D array in format data[channel][sampleIndex]
+       @param filename file to open once per range
+       @param pool threads to decode on
+       @return true if every range decoded
+     */
+    bool parseWavFileParallel(float *const *data, const char *filename, ThreadPool &pool);
+    /**
+       Converts one sample of raw file data to a float between -1 and 1
+
+       @param buf bytes of a single sample
+       @param byteNum number of bytes in the sample
+       @param isFloat true if the data is IEEE float rather than integer PCM
+       @return sample value
+     */
+    static float decodeSample(const uint8_t *buf, int byteNum, bool isFloat);
+    /**
+       Converts a block of raw file data to floats between -1 and 1
+
+       @param raw bytes of numSamples samples
+       @param numSamples number of samples
+       @param byteNum number of bytes per sample
+       @param isFloat true if the data is IEEE float rather than integer PCM
+       @param out numSamples decoded samples, still interleaved
+     */
+    static void decodeSamples(const uint8_t *raw, size_t numSamples, int byteNum, bool isFloat, float *out);
+
 private: // Variables
     /***/
     int wavReadFileSampRate;
@@ -289,6 +432,10 @@ private: // Variables
     int wavFileFrameNum;
     /***/
     waveFormatHeader wavReadFileHeader;
+    /** size of the data chunk of the last read file, 64 bit for RF64 */
+    uint64_t wavReadDataSize = 0;
+    /** chunk index of the last read file */
+    std::shared_ptr<const WavChunkIndex> wavReadIndex;
     /***/
     waveFormatHeader wavWriteFileHeader;
     /***/
@@ -0,0 +1,400 @@
+//
+//  WavWriter.cpp
+//  KarplusStrongTest
+//
+#include "WavWriter.hpp"
+#include "SimdKernels.hpp"
+#include "Trace.hpp"
+#include <algorithm>
+#include <cstring>
+//==============================================================================
+namespace
+{
+    /** appends a little endian value to a byte vector */
+    template <typename T>
+    void put(std::vector<uint8_t> &bytes, T value)
+    {
+        const uint8_t *p = reinterpret_cast<const uint8_t*>(&value);
+        bytes.insert(bytes.end(), p, p + sizeof(T));
+    }
+
+    void putTag(std::vector<uint8_t> &bytes, const char tag[4])
+    {
+        bytes.insert(bytes.end(), tag, tag + 4);
+    }
+
+    /** payload size of a ds64 chunk without a table */
+    constexpr uint32_t ds64Size = 28;
+
+    /** default speaker positions for WAVE_FORMAT_EXTENSIBLE */
+    uint32_t defaultChannelMask(int numChannels)
+    {
+        switch (numChannels)
+        {
+            case 1: return 0x4;   // FC
+            case 2: return 0x3;   // FL FR
+            case 4: return 0x33;  // FL FR BL BR
+            case 6: return 0x3F;  // FL FR FC LFE BL BR
+            case 8: return 0x63F; // FL FR FC LFE BL BR SL SR
+            default: return 0;
+        }
+    }
+}
+//==============================================================================
+WavWriter::WavWriter(size_t bufferSizeInBytes)
+: buffer(bufferSizeInBytes)
+{
+    bufferMemory.setBytes(buffer.capacity());
+}
+//==============================================================================
+WavWriter::~WavWriter()
+{
+    if (file)
+    {
+        close();
+    }
+}
+//==============================================================================
+bool WavWriter::open(const char *filename, int channels, float sampleRate,
+                     WavCodec::SampleFormat format, bool extensible)
+{
+    if (file)
+    {
+        close();
+    }
+
+    if (channels < 1 || channels > maxPlanarChannels)
+    {
+        printf("WavWriter: channel count must be between 1 and %d\n", maxPlanarChannels);
+        return false;
+    }
+
+    WavCodec::openFile(&file, filename, "wb");
+    if (!file)
+    {
+        printf("Could not open file to write: check file path\n");
+        return false;
+    }
+
+    filePath = filename;
+    numChannels = channels;
+    sampleFormat = format;
+    switch (sampleFormat)
+    {
+        case WavCodec::SampleFormat::pcm16:   bytesPerSample = 2; break;
+        case WavCodec::SampleFormat::pcm24:   bytesPerSample = 3; break;
+        case WavCodec::SampleFormat::float32: bytesPerSample = 4; break;
+    }
+    bytesPerFrame = numChannels * bytesPerSample;
+    framesWritten = 0;
+    bufferUsed = 0;
+    stats.reset();
+    writeError = false;
+
+    if (buffer.size() < bytesPerFrame)
+    {
+        buffer.resize(bytesPerFrame);
+    }
+    interleaveBuffer.resize((buffer.size() / bytesPerFrame) * numChannels);
+    bufferMemory.setBytes(buffer.capacity() + interleaveBuffer.capacity() * sizeof(float));
+
+    buildHeader(sampleRate, extensible || numChannels > 2);
+    patchSizes();
+
+    if (fwrite(header.data(), 1, header.size(), file) != header.size())
+    {
+        printf("WavWriter: failed to write header\n");
+        fclose(file);
+        file = nullptr;
+        return false;
+    }
+    return true;
+}
+//==============================================================================
+size_t WavWriter::write(const float *audio, size_t numberOfFrames)
+{
+    if (!file || writeError)
+    {
+        return 0;
+    }
+
+    stats.update(audio, numberOfFrames * numChannels);
+
+    const size_t framesPerBuffer = buffer.size() / bytesPerFrame;
+    size_t framesDone = 0;
+
+    while (framesDone < numberOfFrames)
+    {
+        size_t framesFree = framesPerBuffer - bufferUsed / bytesPerFrame;
+        if (framesFree == 0)
+        {
+            if (!flushBuffer())
+            {
+                // frames of this call still in the lost buffer were not written
+                const size_t framesLost = std::min(framesDone, framesPerBuffer);
+                return framesDone - framesLost;
+            }
+            framesFree = framesPerBuffer;
+        }
+
+        const size_t framesNow = (numberOfFrames - framesDone < framesFree) ? numberOfFrames - framesDone : framesFree;
+        encode(audio + framesDone * numChannels,
+               framesNow * numChannels,
+               buffer.data() + bufferUsed,
+               bytesPerSample);
+
+        bufferUsed += framesNow * bytesPerFrame;
+        framesDone += framesNow;
+        framesWritten += framesNow;
+    }
+
+    return numberOfFrames;
+}
+//==============================================================================
+size_t WavWriter::writePlanar(const float *const *audio, size_t numberOfFrames)
+{
+    if (!file || writeError)
+    {
+        return 0;
+    }
+
+    for (int channel = 0; channel < numChannels; ++channel)
+    {
+        stats.update(audio[channel], numberOfFrames);
+    }
+
+    const size_t framesPerBuffer = buffer.size() / bytesPerFrame;
+    size_t framesDone = 0;
+
+    while (framesDone < numberOfFrames)
+    {
+        size_t framesFree = framesPerBuffer - bufferUsed / bytesPerFrame;
+        if (framesFree == 0)
+        {
+            if (!flushBuffer())
+            {
+                // frames of this call still in the lost buffer were not written
+                const size_t framesLost = std::min(framesDone, framesPerBuffer);
+                return framesDone - framesLost;
+            }
+            framesFree = framesPerBuffer;
+        }
+
+        const size_t framesNow = (numberOfFrames - framesDone < framesFree) ? numberOfFrames - framesDone : framesFree;
+
+        const float *channelPointers[maxPlanarChannels];
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            channelPointers[channel] = audio[channel] + framesDone;
+        }
+
+        if (sampleFormat == WavCodec::SampleFormat::float32)
+        {
+            // float needs no conversion, interleave straight into the buffer
+            SimdKernels::interleave(channelPointers, numChannels, framesNow,
+                                    reinterpret_cast<float*>(buffer.data() + bufferUsed));
+        }
+        else
+        {
+            SimdKernels::interleave(channelPointers, numChannels, framesNow, interleaveBuffer.data());
+            encode(interleaveBuffer.data(), framesNow * numChannels, buffer.data() + bufferUsed, bytesPerSample);
+        }
+
+        bufferUsed += framesNow * bytesPerFrame;
+        framesDone += framesNow;
+        framesWritten += framesNow;
+    }
+
+    return numberOfFrames;
+}
+//==============================================================================
+bool WavWriter::close()
+{
+    if (!file)
+    {
+        return false;
+    }
+
+    flushBuffer();
+
+    // word align the data chunk
+    if ((framesWritten * bytesPerFrame) & 1)
+    {
+        const uint8_t pad = 0;
+        fwrite(&pad, 1, 1, file);
+    }
+
+    patchSizes();
+
+    // seek back to the start and patch the RIFF and data chunk sizes
+    if (fseek(file, 0, SEEK_SET) != 0 ||
+        fwrite(header.data(), 1, header.size(), file) != header.size())
+    {
+        printf("WavWriter: failed to patch header\n");
+        writeError = true;
+    }
+
+    fclose(file);
+    file = nullptr;
+    // any cached chunk layout of a previous file at this path is stale
+    WavChunkIndex::invalidate(filePath.c_str());
+    return !writeError;
+}
+//==============================================================================
+bool WavWriter::flushBuffer()
+{
+    if (bufferUsed == 0)
+    {
+        return true;
+    }
+    KS_TRACE_SCOPE("fileWrite");
+
+    if (fwrite(buffer.data(), 1, bufferUsed, file) != bufferUsed)
+    {
+        printf("WavWriter: FAILED FILE WRITE\n");
+        writeError = true;
+        // the buffered frames never reached the file
+        framesWritten -= bufferUsed / bytesPerFrame;
+        bufferUsed = 0;
+        return false;
+    }
+    bufferUsed = 0;
+
+    // upgrade the header to RF64 as soon as the data crosses 4 GB
+    const uint64_t dataWritten = framesWritten * bytesPerFrame;
+    if (!rf64 && (header.size() - 8) + dataWritten > 0xFFFFFFFF)
+    {
+        patchSizes();
+        if (WavCodec::seekFile(file, 0, SEEK_SET) != 0 ||
+            fwrite(header.data(), 1, header.size(), file) != header.size() ||
+            WavCodec::seekFile(file, 0, SEEK_END) != 0)
+        {
+            printf("WavWriter: failed to upgrade header to RF64\n");
+            writeError = true;
+        }
+    }
+    return !writeError;
+}
+//==============================================================================
+void WavWriter::buildHeader(float sampleRate, bool extensible)
+{
+    const bool isFloat = (sampleFormat == WavCodec::SampleFormat::float32);
+    const uint16_t formatTag = isFloat ? WavCodec::formatIEEEFloat : WavCodec::formatPCM;
+
+    header.clear();
+    putTag(header, "RIFF");
+    put<uint32_t>(header, 0);                             // patched by patchSizes()
+    putTag(header, "WAVE");
+
+    // reserved for a ds64 chunk if the file outgrows RIFF
+    ds64Offset = header.size();
+    putTag(header, "JUNK");
+    put<uint32_t>(header, ds64Size);
+    header.insert(header.end(), ds64Size, 0);
+
+    putTag(header, "fmt ");
+    put<uint32_t>(header, extensible ? 40 : 16);
+    put<uint16_t>(header, extensible ? WavCodec::formatExtensible : formatTag);
+    put<uint16_t>(header, (uint16_t)numChannels);
+    put<uint32_t>(header, (uint32_t)sampleRate);
+    put<uint32_t>(header, (uint32_t)(sampleRate * bytesPerFrame));
+    put<uint16_t>(header, (uint16_t)bytesPerFrame);
+    put<uint16_t>(header, (uint16_t)(bytesPerSample * 8));
+
+    if (extensible)
+    {
+        // KSDATAFORMAT_SUBTYPE_PCM / _IEEE_FLOAT: xxxxxxxx-0000-0010-8000-00aa00389b71
+        static const uint8_t guidTail[14] = {0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80,
+                                             0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71};
+        put<uint16_t>(header, 22);                        // cbSize
+        put<uint16_t>(header, (uint16_t)(bytesPerSample * 8)); // valid bits
+        put<uint32_t>(header, defaultChannelMask(numChannels));
+        put<uint16_t>(header, formatTag);
+        header.insert(header.end(), guidTail, guidTail + sizeof(guidTail));
+    }
+
+    putTag(header, "data");
+    dataSizeOffset = header.size();
+    put<uint32_t>(header, 0);                             // patched by patchSizes()
+}
+//==============================================================================
+void WavWriter::patchSizes()
+{
+    const uint64_t dataSize = framesWritten * bytesPerFrame;
+    const uint64_t riffSize = (header.size() - 8) + dataSize + (dataSize & 1);
+
+    if (riffSize > 0xFFFFFFFF)
+    {
+        rf64 = true;
+    }
+
+    if (!rf64)
+    {
+        const uint32_t riffSize32 = (uint32_t)riffSize;
+        const uint32_t dataSize32 = (uint32_t)dataSize;
+        memcpy(&header[4], &riffSize32, 4);
+        memcpy(&header[dataSizeOffset], &dataSize32, 4);
+        return;
+    }
+
+    // RF64: the 32 bit sizes are set to -1 and the real ones live in ds64
+    const uint32_t sizeInDs64 = 0xFFFFFFFF;
+    const uint64_t sampleCount = framesWritten;
+    memcpy(&header[0], "RF64", 4);
+    memcpy(&header[4], &sizeInDs64, 4);
+    memcpy(&header[dataSizeOffset], &sizeInDs64, 4);
+    memcpy(&header[ds64Offset], "ds64", 4);
+    memcpy(&header[ds64Offset + 8], &riffSize, 8);
+    memcpy(&header[ds64Offset + 16], &dataSize, 8);
+    memcpy(&header[ds64Offset + 24], &sampleCount, 8);
+    // table length at ds64Offset + 32 stays 0
+}
+//==============================================================================
+void WavWriter::encode(const float *in, size_t numSamples, uint8_t *out, size_t outStride) const
+{
+    KS_TRACE_SCOPE("encode");
+    switch (sampleFormat)
+    {
+        case WavCodec::SampleFormat::pcm16:
+        {
+            for (size_t i = 0; i < numSamples; ++i, out += outStride)
+            {
+                float s = in[i] * pcm16Scale;
+                s = (s > 32767.0f) ? 32767.0f : ((s < -32768.0f) ? -32768.0f : s);
+                const int16_t sdata = (int16_t)s;
+                memcpy(out, &sdata, sizeof(int16_t));
+            }
+            break;
+        }
+        case WavCodec::SampleFormat::pcm24:
+        {
+            const float amp = 8388608.0f; // 2^23, as for 16-bit
+            for (size_t i = 0; i < numSamples; ++i, out += outStride)
+            {
+                float s = in[i] * amp;
+                s = (s > 8388607.0f) ? 8388607.0f : ((s < -8388608.0f) ? -8388608.0f : s);
+                const int32_t sdata = (int32_t)s;
+                out[0] = (uint8_t)(sdata);
+                out[1] = (uint8_t)(sdata >> 8);
+                out[2] = (uint8_t)(sdata >> 16);
+            }
+            break;
+        }
+        case WavCodec::SampleFormat::float32:
+        {
+            if (outStride == sizeof(float))
+            {
+                memcpy(out, in, numSamples * sizeof(float));
+            }
+            else
+            {
+                for (size_t i = 0; i < numSamples; ++i, out += outStride)
+                {
+                    memcpy(out, &in[i], sizeof(float));
+                }
+            }
+            break;
+        }
+    }
+}
+//EOF
@@ -0,0 +1,165 @@
+/*
+ *  WavWriter: buffered, streaming wav file writer
+ */
+//==============================================================================
+#ifndef WavWriter_hpp
+#define WavWriter_hpp
+//==============================================================================
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "WavCodec.hpp"
+#include "SignalStats.hpp"
+#include "MemoryAccounting.hpp"
+//==============================================================================
+/*!
+   @class WavWriter
+   @brief writes audio to a wav file block by block through a large buffer.
+
+   @discussion The number of frames does not have to be known when the file is
+   opened. A placeholder header is written on open() and the RIFF and data
+   chunk sizes are patched in on close(). Samples are converted in bulk into
+   the write buffer, which is only handed to fwrite when it is full.
+
+   - open() a file with a channel count, sample rate and sample format
+     (16 bit, 24 bit or 32 bit float, optionally WAVE_FORMAT_EXTENSIBLE)
+   - write() interleaved blocks or writePlanar() channel arrays of any length
+   - close() to flush the buffer and fix up the header
+
+   Space for a ds64 chunk is reserved as a JUNK chunk at the start of every
+   file. If the data grows past the 4 GB limit of the 32 bit RIFF sizes the
+   file is upgraded in place to RF64 when the header is patched.
+
+   The destructor will close a file that is still open.
+ */
+//==============================================================================
+class WavWriter
+{
+public:
+    /**
+       Constructor
+       @param bufferSizeInBytes size of the write buffer, rounded down to a
+       whole number of frames on open()
+     */
+    WavWriter(size_t bufferSizeInBytes = defaultBufferSize);
+    /**
+       Destructor: closes the file if it is still open
+     */
+    ~WavWriter();
+
+    WavWriter(const WavWriter&) = delete;
+    WavWriter& operator=(const WavWriter&) = delete;
+    //==============================================================================
+    /** opens a file for writing and writes a placeholder header
+       @param filename path and filename of the file to write
+       @param numChannels number of interleaved channels
+       @param sampleRate sampling rate of file
+       @param format sample encoding of the file
+       @param extensible write a WAVE_FORMAT_EXTENSIBLE fmt chunk. This is
+       always done for more than two channels.
+       @returns true on success, false if the file could not be opened
+     */
+    bool open(const char *filename, int numChannels, float sampleRate,
+              WavCodec::SampleFormat format = WavCodec::SampleFormat::pcm16,
+              bool extensible = false);
+
+    /** converts and buffers a block of interleaved audio
+       @param audio interleaved audio data between -1 and 1
+       @param numberOfFrames number of frames in audio
+       @returns number of frames accepted, fewer once a write to disk fails
+     */
+    size_t write(const float *audio, size_t numberOfFrames);
+
+    /** converts and buffers a block of planar audio
+       @param audio array of numChannels pointers to audio data, audio[channel][sample]
+       @param numberOfFrames number of frames per channel
+       @returns number of frames accepted, fewer once a write to disk fails
+     */
+    size_t writePlanar(const float *const *audio, size_t numberOfFrames);
+
+    /** flushes the buffer, patches the header sizes and closes the file
+       @returns true on success, false if any write or seek failed
+     */
+    bool close();
+    //==============================================================================
+    /** @returns true while a file is open */
+    bool isOpen() const {return file != nullptr;}
+    /** @returns number of frames written since open() */
+    uint64_t getFramesWritten() const {return framesWritten;}
+    /** @returns peak and RMS of everything written since open(), before
+       conversion, so a caller can decide on gain without a second pass */
+    const SignalStats& getStats() const {return stats;}
+    /** @returns true once the data has grown too large for a RIFF header */
+    bool isRF64() const {return rf64;}
+    /** @returns number of channels of the open file */
+    int getNumChannels() const {return numChannels;}
+
+    /** sets what 1.0 is multiplied by for 16 bit files, clipped to the
+       16 bit range. The default 2^15 is the scale the decoder divides by,
+       so decoded files encode back to identical bytes.
+     */
+    void setPcm16Scale(float scale) {pcm16Scale = scale;}
+
+    /// default size of the write buffer in bytes
+    static constexpr size_t defaultBufferSize = 1 << 20;
+    /// largest channel count that can be written
+    static constexpr int maxPlanarChannels = 64;
+
+private: // Methods
+    /** writes whatever is in the buffer to file
+       @returns true on success
+     */
+    bool flushBuffer();
+    /** builds header for the current format, sizes are filled by patchSizes() */
+    void buildHeader(float sampleRate, bool extensible);
+    /** writes the RIFF and data chunk sizes for the current frame count into header */
+    void patchSizes();
+    /** converts samples to the file format
+       @param in samples to convert
+       @param numSamples number of samples in
+       @param out first output byte
+       @param outStride bytes between consecutive output samples
+     */
+    void encode(const float *in, size_t numSamples, uint8_t *out, size_t outStride) const;
+
+private: // Variables
+    /// the open file or nullptr
+    FILE *file = nullptr;
+    /// path of the open file
+    std::string filePath;
+    /// serialised header kept so it can be rewritten on close
+    std::vector<uint8_t> header;
+    /// byte offset of the reserved JUNK/ds64 chunk in header
+    size_t ds64Offset = 0;
+    /// byte offset of the data chunk size field in header
+    size_t dataSizeOffset = 0;
+    /// set once the header has been upgraded to RF64
+    bool rf64 = false;
+    /// sample encoding of open file
+    WavCodec::SampleFormat sampleFormat = WavCodec::SampleFormat::pcm16;
+    /// bulk conversion buffer
+    std::vector<uint8_t> buffer;
+    /// planar audio is interleaved here before conversion to PCM
+    std::vector<float> interleaveBuffer;
+    /// number of bytes currently held in buffer
+    size_t bufferUsed = 0;
+    /// accounts buffer and interleaveBuffer
+    MemoryAccounting::Tracker bufferMemory {MemoryAccounting::Category::ioBuffers};
+    /// number of frames written since open
+    uint64_t framesWritten = 0;
+    /// channel count of open file
+    int numChannels = 0;
+    /// bytes in a single sample
+    size_t bytesPerSample = 0;
+    /// bytes in a single frame
+    size_t bytesPerFrame = 0;
+    /// running peak and RMS of written audio
+    SignalStats stats;
+    /// set when any fwrite fails
+    bool writeError = false;
+    /// 16 bit scale of a full scale sample
+    float pcm16Scale = 32768.0f;
+};
+#endif /* WavWriter_hpp */